@@ -0,0 +1,141 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file classify.c
+ *
+ * @brief Measures throughput of character classification kernels.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/classify.h"
+
+#define BUFFER_SIZE (64 * 1024 * 1024) ///< Size of generated input.
+#define REPEATS 5                      ///< The best of repeats is reported.
+
+/**
+ * @brief Generated input, NUL terminated.
+ */
+static char* BUFFER;
+
+/**
+ * @brief Generates huge command line of file arguments.
+ *
+ * @details Words are file paths of different length separated by single
+ * space, some of them are quoted.
+ *
+ * @param[in] min_word Minimal length of a word.
+ * @param[in] spread Difference between maximal and minimal length of a word.
+ */
+static void generate_line(size_t min_word, size_t spread) {
+    srand(42);
+    size_t i = 0;
+    while (i < BUFFER_SIZE) {
+        const size_t word = min_word + (size_t) rand() % spread;
+        for (size_t j = 0; j < word && i < BUFFER_SIZE; ++j) {
+            BUFFER[i++] = (j % 9 == 8) ? '/' : (char) ('a' + rand() % 26);
+        }
+        if (i < BUFFER_SIZE) {
+            BUFFER[i++] = (rand() % 16) ? ' ' : '"';
+        }
+    }
+    BUFFER[BUFFER_SIZE] = '\0';
+}
+
+/**
+ * @brief Gets monotonic time in seconds.
+ *
+ * @return Current time.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Splits the whole buffer at word boundaries like the scanner does.
+ *
+ * @param[in] kernel The kernel to measure.
+ *
+ * @return Throughput in GB/s.
+ */
+static double measure(ClassifyKernel kernel) {
+    double best = 0;
+    for (int r = 0; r < REPEATS; ++r) {
+        size_t boundaries = 0;
+        const double start = now();
+        for (size_t i = 0; i < BUFFER_SIZE; ++i) {
+            i += kernel(BUFFER + i, BUFFER_SIZE - i, WORD_END_CLASSES);
+            ++boundaries;
+        }
+        const double elapsed = now() - start;
+
+        const double speed = BUFFER_SIZE / elapsed / 1e9;
+        if (speed > best) {
+            best = speed;
+        }
+        // Keep boundaries alive, so loop is not optimized out
+        if (!boundaries) {
+            return 0;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Measures all kernels supported by CPU on generated line.
+ *
+ * @param[in] name Name of the input.
+ * @param[in] min_word Minimal length of a word.
+ * @param[in] spread Difference between maximal and minimal length of a word.
+ * @param[in] is_first True if it is the first result printed.
+ */
+static void run(const char name[], size_t min_word, size_t spread,
+                bool is_first) {
+    generate_line(min_word, spread);
+
+    printf("%s\n    \"%s\": {\"scalar_gbps\": %.2f", is_first ? "" : ",",
+           name, measure(find_class_scalar));
+#if defined(HAVE_SIMD_CLASSIFY)
+    printf(", \"sse2_gbps\": %.2f", measure(find_class_sse2));
+    if (has_avx2()) {
+        printf(", \"avx2_gbps\": %.2f", measure(find_class_avx2));
+    }
+#endif
+    printf("}");
+}
+
+int main(void) {
+    BUFFER = malloc(BUFFER_SIZE + 1);
+    if (!BUFFER) {
+        perror("bench");
+        return EXIT_FAILURE;
+    }
+
+    printf("  \"classify\": {");
+    run("file-args", 8, 48, true);
+    run("long-words", 512, 1024, false);
+    printf("\n  }");
+
+    free(BUFFER);
+    return 0;
+}
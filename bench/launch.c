@@ -0,0 +1,216 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file launch.c
+ *
+ * @brief Measures end-to-end throughput of commands, launch latency of
+ * pipelines and pipe throughput by running kara -c on generated scripts.
+ *
+ * @details Startup of the shell is measured separately and subtracted, so
+ * results show cost of the commands only.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define REPEATS 3           ///< The best of repeats is reported.
+#define COMMANDS 2000       ///< Amount of commands in throughput script.
+#define PIPELINES 200       ///< Amount of pipelines in latency script.
+#define MAX_STAGES 16       ///< The longest pipeline measured.
+#define TRUE_PATH "/bin/true" ///< External command doing nothing.
+#define PIPE_BYTES (512 * 1024 * 1024) ///< Data moved through measured pipe.
+
+extern char** environ;
+
+/**
+ * @brief Path to kara binary.
+ */
+static const char* KARA;
+
+/**
+ * @brief Gets monotonic time in seconds.
+ *
+ * @return Current time.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Runs script in kara with output discarded.
+ *
+ * @param[in] script Commands separated by new lines.
+ * @param[in] backend Value of KARA_LAUNCH.
+ *
+ * @return The best wall time of repeats in seconds, negative on failure.
+ */
+static double run(const char script[], const char backend[]) {
+    setenv("KARA_LAUNCH", backend, 1);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+    char* argv[] = {(char*) KARA, "-c", (char*) script, NULL};
+    double best = -1;
+    for (int r = 0; r < REPEATS; ++r) {
+        const double start = now();
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, KARA, &actions, NULL, argv, environ) ||
+            waitpid(pid, &status, 0) == -1 || status) {
+            best = -1;
+            break;
+        }
+        const double elapsed = now() - start;
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return best;
+}
+
+/**
+ * @brief Generates script of repeated line.
+ *
+ * @param[in] amount Amount of lines.
+ * @param[in] stages Amount of commands in every pipeline.
+ * @param[in] command The command to repeat.
+ *
+ * @return Script separated by new lines, or NULL on failure.
+ */
+static char* generate_script(size_t amount, size_t stages,
+                             const char command[]) {
+    const size_t line = stages * (strlen(command) + 3);
+    char* script = malloc(amount * line + 1);
+    if (!script) {
+        return NULL;
+    }
+    char* end = script;
+    for (size_t i = 0; i < amount; ++i) {
+        for (size_t j = 0; j < stages; ++j) {
+            end = stpcpy(end, command);
+            end = stpcpy(end, (j + 1 < stages) ? " | " : "\n");
+        }
+    }
+    *end = '\0';
+    return script;
+}
+
+/**
+ * @brief Measures time of lines in the script without shell startup.
+ *
+ * @param[in] amount Amount of lines.
+ * @param[in] stages Amount of commands in every pipeline.
+ * @param[in] command The command to repeat.
+ * @param[in] backend Value of KARA_LAUNCH.
+ * @param[in] startup Time of empty shell run.
+ *
+ * @return Time of a single line in seconds, negative on failure.
+ */
+static double measure(size_t amount, size_t stages, const char command[],
+                      const char backend[], double startup) {
+    char* script = generate_script(amount, stages, command);
+    if (!script) {
+        return -1;
+    }
+    const double elapsed = run(script, backend);
+    free(script);
+    if (elapsed < 0) {
+        return -1;
+    }
+    return (elapsed > startup ? elapsed - startup : 0) / (double) amount;
+}
+
+/**
+ * @brief Prints throughput of commands.
+ *
+ * @param[in] name Name of the result.
+ * @param[in] command The command to repeat.
+ * @param[in] backend Value of KARA_LAUNCH.
+ * @param[in] startup Time of empty shell run.
+ */
+static void print_throughput(const char name[], const char command[],
+                             const char backend[], double startup) {
+    const double line = measure(COMMANDS, 1, command, backend, startup);
+    printf("    \"%s\": {\"commands\": %d, \"commands_per_s\": %.0f},\n",
+           name, COMMANDS, line > 0 ? 1 / line : 0);
+}
+
+/**
+ * @brief Prints throughput of data piped between two commands for every
+ * pipe size.
+ *
+ * @param[in] startup Time of empty shell run.
+ */
+static void print_pipe_throughput(double startup) {
+    static const char* const SIZES[] = {"64K", "256K", "1M"};
+
+    printf("    \"pipe_mb_per_s\": {");
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i) {
+        char script[128];
+        snprintf(script, sizeof(script),
+                 "pipesize %s head -c %d /dev/zero | cat > /dev/null",
+                 SIZES[i], PIPE_BYTES);
+        const double elapsed = run(script, "spawn") - startup;
+        printf("%s\"%s\": %.0f", i ? ", " : "", SIZES[i],
+               elapsed > 0 ? PIPE_BYTES / elapsed / 1e6 : 0);
+    }
+    printf("},\n");
+}
+
+int main(int argc, char* argv[]) {
+    KARA = (argc > 1) ? argv[1] : "./kara";
+
+    const double startup = run("true", "spawn");
+    if (startup < 0) {
+        fprintf(stderr, "bench: failed to run %s\n", KARA);
+        return EXIT_FAILURE;
+    }
+
+    printf("  \"launch\": {\n");
+    printf("    \"startup_us\": %.0f,\n", startup * 1e6);
+    print_throughput("builtin", "true", "spawn", startup);
+    print_throughput("external-spawn", TRUE_PATH, "spawn", startup);
+    print_throughput("external-fork", TRUE_PATH, "fork", startup);
+    print_pipe_throughput(startup);
+
+    printf("    \"pipeline_us\": {");
+    for (size_t stages = 1; stages <= MAX_STAGES; stages *= 2) {
+        const double line = measure(PIPELINES, stages, TRUE_PATH, "spawn",
+                                    startup);
+        printf("%s\"%zu\": %.1f", (stages == 1) ? "" : ", ", stages,
+               line * 1e6);
+    }
+    printf("}\n  }");
+    return 0;
+}
@@ -0,0 +1,147 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file parse.c
+ *
+ * @brief Measures latency of tokenize(), parse() and free_ast() on generated
+ * script lines.
+ *
+ * @details Lines are fed through the same input() path the shell uses in
+ * script mode, so reading a line from the buffer is measured as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/parser.h"
+#include "../src/scanner.h"
+
+#define REPEATS 5 ///< The best of repeats is reported.
+
+/**
+ * @brief Generated input kind.
+ */
+struct Input {
+    const char* name;   ///< Name of the input in results.
+    size_t lines;       ///< Amount of lines in one repeat.
+    size_t words;       ///< Amount of words in every line.
+    const char* word;   ///< Word repeated in line.
+    const char* joiner; ///< Text placed between words.
+};
+
+/**
+ * @brief Inputs to measure.
+ */
+static const struct Input INPUTS[] = {
+        {"short-lines",   20000, 4,      "ls",          " "},
+        {"huge-args",     4,     100000, "file.txt",    " "},
+        {"deep-pipeline", 40,    1000,   "grep 'a b'",  " | "},
+        {"and-or-list",   200,   100,    "true",        " && "}
+};
+
+/**
+ * @brief Gets monotonic time in seconds.
+ *
+ * @return Current time.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Generates script of all repeats of every input.
+ *
+ * @return Script separated by new lines, or NULL on failure.
+ */
+static char* generate_script(void) {
+    size_t size = 1;
+    for (size_t i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); ++i) {
+        const struct Input* kind = &INPUTS[i];
+        const size_t line = kind->words * (strlen(kind->word) +
+                                             strlen(kind->joiner)) + 1;
+        size += REPEATS * kind->lines * line;
+    }
+
+    char* script = malloc(size);
+    if (!script) {
+        return NULL;
+    }
+    char* end = script;
+    for (size_t i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); ++i) {
+        const struct Input* kind = &INPUTS[i];
+        for (size_t j = 0; j < REPEATS * kind->lines; ++j) {
+            for (size_t k = 0; k < kind->words; ++k) {
+                end = stpcpy(end, kind->word);
+                if (k + 1 < kind->words) {
+                    end = stpcpy(end, kind->joiner);
+                }
+            }
+            *end++ = '\n';
+        }
+    }
+    *end = '\0';
+    return script;
+}
+
+/**
+ * @brief Measures lines of the input, which are the next in the script.
+ *
+ * @param[in] kind The input to measure.
+ * @param[in] is_first True if it is the first result printed.
+ */
+static void measure(const struct Input* kind, bool is_first) {
+    double best = 0;
+    for (int r = 0; r < REPEATS; ++r) {
+        const double start = now();
+        for (size_t i = 0; i < kind->lines; ++i) {
+            free_ast(parse(input()));
+        }
+        const double elapsed = now() - start;
+        if (!r || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    const size_t line = kind->words * strlen(kind->word) +
+                        (kind->words - 1) * strlen(kind->joiner);
+    printf("%s\n    \"%s\": {\"lines\": %zu, \"bytes_per_line\": %zu, "
+           "\"ns_per_line\": %.0f, \"mb_per_s\": %.1f}",
+           is_first ? "" : ",", kind->name, kind->lines, line,
+           best / (double) kind->lines * 1e9,
+           (double) (line * kind->lines) / best / 1e6);
+}
+
+int main(void) {
+    char* script = generate_script();
+    if (!script || !read_script_string(script)) {
+        perror("bench");
+        return EXIT_FAILURE;
+    }
+    free(script);
+
+    printf("  \"parse\": {");
+    for (size_t i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); ++i) {
+        measure(&INPUTS[i], !i);
+    }
+    printf("\n  }");
+    return 0;
+}
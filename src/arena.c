@@ -0,0 +1,124 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file arena.c
+ *
+ * @brief Implementation of bump allocator with chained blocks.
+ */
+
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "utility.h"
+
+#define BLOCK_SIZE (16 * 1024) ///< Default size of block data.
+
+/// Alignment of every allocation.
+#define ALIGNMENT alignof(max_align_t)
+
+struct Arena line_arena;
+
+/**
+ * @brief Print statistics on every arena_reset() call.
+ */
+static bool PRINT_STATS = false;
+
+void set_arena_stats(void) {
+    PRINT_STATS = getenv(ARENA_STATS_ENV) != NULL;
+}
+
+/**
+ * @brief Allocates new block and makes it arena head.
+ *
+ * @param[in,out] arena The arena to add block to.
+ * @param[in] size Minimal size of block data.
+ *
+ * @return True if allocation succeeded, otherwise false.
+ */
+static bool add_block(struct Arena* arena, size_t size) {
+    if (size < BLOCK_SIZE) {
+        size = BLOCK_SIZE;
+    }
+    struct ArenaBlock* block = malloc(sizeof(struct ArenaBlock) + size);
+    if (!block) {
+        return check_alloc(block, "arena block");
+    }
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+    arena->blocks++;
+    return true;
+}
+
+void* arena_alloc(struct Arena* arena, size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    struct ArenaBlock* block = arena->head;
+    if (!block || block->size - block->used < size) {
+        if (!add_block(arena, size)) {
+            return NULL;
+        }
+        block = arena->head;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->allocations++;
+    arena->bytes += size;
+    return ptr;
+}
+
+char* arena_strndup(struct Arena* arena, const char string[], size_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    if (copy) {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+void arena_reset(struct Arena* arena) {
+    if (PRINT_STATS && arena->allocations) {
+        fprintf(stderr, "kara: arena: %zu allocations, %zu mallocs, %zu bytes\n",
+                arena->allocations, arena->blocks, arena->bytes);
+    }
+
+    struct ArenaBlock* block = arena->head;
+    while (block && block->next) {
+        struct ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    // Keep the first block unless it was allocated for huge data
+    if (block && block->size != BLOCK_SIZE) {
+        free(block);
+        block = NULL;
+    }
+    if (block) {
+        block->used = 0;
+    }
+
+    arena->head = block;
+    arena->allocations = 0;
+    arena->blocks = 0;
+    arena->bytes = 0;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file arena.h
+ *
+ * @brief Bump allocator for data that lives as long as one input line.
+ *
+ * @see arena.c
+ */
+
+#ifndef KARASHI_ARENA_H
+#define KARASHI_ARENA_H
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ARENA_STATS_ENV "KARA_ARENA_STATS" ///< Enables per line statistics.
+
+/**
+ * @brief Memory block owned by Arena.
+ */
+struct ArenaBlock {
+    struct ArenaBlock* next;          ///< Previously allocated block.
+    size_t size;                      ///< Size of data.
+    size_t used;                      ///< Amount of used bytes of data.
+    alignas(max_align_t) char data[]; ///< Memory to hand out, aligned.
+};
+
+/**
+ * @brief Bump allocator, everything allocated is released at once.
+ */
+struct Arena {
+    struct ArenaBlock* head; ///< Block to allocate from.
+    size_t allocations;      ///< Amount of arena_alloc() calls since reset.
+    size_t blocks;           ///< Amount of malloc() calls since reset.
+    size_t bytes;            ///< Amount of handed out bytes since reset.
+};
+
+extern struct Arena line_arena; ///< Holds Tokens and AbstractSyntaxTree.
+
+/**
+ * @brief Enables statistics printing when ARENA_STATS_ENV is set.
+ */
+void set_arena_stats(void);
+
+/**
+ * @brief Allocates memory from arena.
+ *
+ * @details Memory is aligned for any type. Prints error message on failure.
+ *
+ * @param[in,out] arena The arena to allocate from.
+ * @param[in] size Amount of bytes to allocate.
+ *
+ * @return Pointer to allocated memory, or NULL on failure.
+ */
+void* arena_alloc(struct Arena* arena, size_t size);
+
+/**
+ * @brief Copies first length characters of string into arena.
+ *
+ * @param[in,out] arena The arena to allocate from.
+ * @param[in] string The string to copy.
+ * @param[in] length Amount of characters to copy.
+ *
+ * @return Null terminated copy, or NULL on failure.
+ */
+char* arena_strndup(struct Arena* arena, const char string[], size_t length);
+
+/**
+ * @brief Releases everything allocated from arena.
+ *
+ * @details Keeps the first block for reuse. Prints statistics of the arena
+ * before reset when ARENA_STATS_ENV is set.
+ *
+ * @param[in,out] arena The arena to reset.
+ */
+void arena_reset(struct Arena* arena);
+
+#endif //KARASHI_ARENA_H
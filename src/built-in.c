@@ -17,35 +17,917 @@
 /**
  * @file built-in.c
  *
- * @brief Contents shell built-in commands table.
+ * @brief Contents shell built-in commands table and implementation of the
+ * commands which are executed inside shell process.
  */
 
+#define _GNU_SOURCE
+
 #include "built-in.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "child.h"
+#include "hash.h"
+#include "histfile.h"
+#include "parallel.h"
+#include "utility.h"
+#include "variables.h"
+
+#define OUTPUT_SIZE 4096 ///< Size of built-in commands output buffer.
+#define SPEC_SIZE 32     ///< Max length of printf conversion specification.
 
 /**
- * @brief Defining the maximum length of a command.
+ * @brief Buffered output of built-in command.
+ */
+struct Output {
+    int fd;                     ///< File descriptor to write to.
+    bool failed;                ///< True if any write failed.
+    size_t used;                ///< Amount of buffered bytes.
+    char buffer[OUTPUT_SIZE];   ///< Buffered bytes.
+};
+
+/**
+ * @brief Writes data to file descriptor, retrying on partial writes.
  *
- * @details C programming language forbid to define arrays with two empty
- * square brackets (table[][] is not allowed), so we must determine some
- * arbitrary number to use in TABLE.
+ * @param[in,out] out The output to write to.
+ * @param[in] data The data to write.
+ * @param[in] length Amount of bytes to write.
  */
-#define COMMAND_MAX_LEN 8
+static void write_all(struct Output* out, const char data[], size_t length) {
+    while (length && !out->failed) {
+        ssize_t written = write(out->fd, data, length);
+        if (written < 0) {
+            out->failed = errno != EINTR;
+            continue;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+}
 
 /**
- * @brief Table of built-in commands.
+ * @brief Writes buffered data.
+ *
+ * @param[in,out] out The output to flush.
  */
-static const char TABLE[][COMMAND_MAX_LEN] = {
-        CD,
-        EXIT
-};
+static void flush_output(struct Output* out) {
+    write_all(out, out->buffer, out->used);
+    out->used = 0;
+}
+
+/**
+ * @brief Appends data to output buffer.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] data The data to append.
+ * @param[in] length Amount of bytes to append.
+ */
+static void put(struct Output* out, const char data[], size_t length) {
+    if (length > OUTPUT_SIZE - out->used) {
+        flush_output(out);
+        if (length >= OUTPUT_SIZE) {
+            write_all(out, data, length);
+            return;
+        }
+    }
+    memcpy(out->buffer + out->used, data, length);
+    out->used += length;
+}
+
+/**
+ * @brief Appends single character to output buffer.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] c The character to append.
+ */
+static void put_char(struct Output* out, char c) {
+    put(out, &c, 1);
+}
+
+/**
+ * @brief Appends formatted string to output buffer.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] format Format of the string, printf() style.
+ */
+static void put_format(struct Output* out, const char format[], ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t) length < sizeof(buffer)) {
+        put(out, buffer, (size_t) length);
+        return;
+    }
+
+    char* big_buffer = malloc((size_t) length + 1);
+    if (!check_alloc(big_buffer, "printf output")) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(big_buffer, (size_t) length + 1, format, args);
+    va_end(args);
+    put(out, big_buffer, (size_t) length);
+    free(big_buffer);
+}
+
+/**
+ * @brief Appends character denoted by backslash escape sequence.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] escape Characters after backslash.
+ * @param[in] zero_octal Octal numbers must start with "0", as in echo.
+ *
+ * @return Amount of consumed characters after backslash.
+ */
+static size_t put_escape(struct Output* out, const char escape[],
+                         bool zero_octal) {
+    static const char LETTERS[] = "\\abfnrtv";
+    static const char VALUES[] = "\\\a\b\f\n\r\t\v";
+
+    const char* letter = escape[0] ? strchr(LETTERS, escape[0]) : NULL;
+    if (letter) {
+        put_char(out, VALUES[letter - LETTERS]);
+        return 1;
+    }
+
+    size_t i = (zero_octal && escape[0] == '0') ? 1 : 0;
+    if (zero_octal && !i) {
+        put_char(out, '\\');
+        return 0;
+    }
+    const size_t digits_start = i;
+    unsigned value = 0;
+    while (i < digits_start + 3 && escape[i] >= '0' && escape[i] <= '7') {
+        value = value * 8 + (unsigned) (escape[i++] - '0');
+    }
+    if (i == digits_start && !zero_octal) {
+        put_char(out, '\\');
+        return 0;
+    }
+    put_char(out, (char) value);
+    return i;
+}
+
+/**
+ * @brief Appends string interpreting backslash escape sequences.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] string The string to append.
+ * @param[in] zero_octal Octal numbers must start with "0", as in echo.
+ */
+static void put_escaped(struct Output* out, const char string[],
+                        bool zero_octal) {
+    while (*string) {
+        const char* backslash = strchrnul(string, '\\');
+        put(out, string, (size_t) (backslash - string));
+        if (!*backslash) {
+            return;
+        }
+        string = backslash + 1;
+        string += put_escape(out, string, zero_octal);
+    }
+}
+
+void print_builtin_error(const int fds[], const char format[], ...) {
+    char message[OUTPUT_SIZE];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    dprintf(fds[STDERR_FILENO], BOLD_RED "kara: %s" RESET "\n", message);
+}
+
+/**
+ * @brief Resolves path against logical current directory.
+ *
+ * @details "." and ".." components are removed lexically, so "cd .." after
+ * following a symbolic link returns to the directory containing the link.
+ *
+ * @param[in] path The path to resolve.
+ *
+ * @return Allocated absolute path, or NULL if allocation failed.
+ */
+static char* logical_path(const char path[]) {
+    const char* base = path[0] == '/' ? "" : get_variable("PWD", 3);
+    char* cwd = NULL;
+    if (path[0] != '/' && (!base || base[0] != '/')) {
+        cwd = getcwd(NULL, 0);
+        if (!cwd) {
+            char* copy = strdup(path);
+            check_alloc(copy, "cd path");
+            return copy;
+        }
+        base = cwd;
+    }
+
+    const size_t base_length = strlen(base);
+    const size_t path_length = strlen(path);
+    char* result = malloc(base_length + path_length + 3);
+    if (!result) {
+        check_alloc(result, "cd path");
+        free(cwd);
+        return NULL;
+    }
+    size_t length = 0;
+    const char* parts[] = {base, path};
+    for (size_t i = 0; i < 2; ++i) {
+        const char* component = parts[i];
+        while (*component) {
+            const char* end = strchrnul(component, '/');
+            const size_t size = (size_t) (end - component);
+            if (size == 2 && component[0] == '.' && component[1] == '.') {
+                while (length && result[length - 1] != '/') {
+                    --length;
+                }
+                length -= length > 0;
+            } else if (size && !(size == 1 && component[0] == '.')) {
+                result[length++] = '/';
+                memcpy(result + length, component, size);
+                length += size;
+            }
+            component = *end ? end + 1 : end;
+        }
+    }
+    if (!length) {
+        result[length++] = '/';
+    }
+    result[length] = '\0';
+    free(cwd);
+    return result;
+}
+
+/**
+ * @brief Change current working directory, HOME by default.
+ *
+ * @details Keeps PWD as logical path of the new directory and OLDPWD as the
+ * previous one. If logical path does not exist, the path is changed to
+ * physically like in other shells.
+ */
+static int cd_builtin(int argc, char* argv[], const int fds[]) {
+    const char* path = (argc > 1) ? argv[1] : get_variable("HOME", 4);
+    if (!path) {
+        print_builtin_error(fds, "cd: HOME is not set");
+        return EXIT_FAILURE;
+    }
+    char* pwd = logical_path(path);
+    if (!pwd) {
+        return EXIT_FAILURE;
+    }
+    if (chdir(pwd)) {
+        free(pwd);
+        if (chdir(path)) {
+            print_builtin_error(fds, "cd: %s: %s", path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        pwd = getcwd(NULL, 0);
+        if (!pwd) {
+            print_builtin_error(fds, "cd: %s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char* old_pwd = get_variable("PWD", 3);
+    if (old_pwd) {
+        set_variable("OLDPWD", old_pwd);
+    }
+    set_variable("PWD", pwd);
+    free(pwd);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Quit shell with optional exit status.
+ */
+static int exit_builtin(int argc, char* argv[], const int fds[]) {
+    (void) fds;
+    exit((argc > 1) ? atoi(argv[1]) : EXIT_SUCCESS);
+}
+
+/**
+ * @brief Print arguments separated by spaces, supports "-n", "-e" and "-E".
+ */
+static int echo_builtin(int argc, char* argv[], const int fds[]) {
+    bool new_line = true;
+    bool escapes = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) {
+            break;
+        }
+        for (const char* option = argv[i] + 1; *option; ++option) {
+            if (*option == 'n') {
+                new_line = false;
+            } else {
+                escapes = *option == 'e';
+            }
+        }
+    }
+
+    struct Output out = {fds[STDOUT_FILENO], false, 0, {0}};
+    for (const int first = i; i < argc; ++i) {
+        if (i != first) {
+            put_char(&out, ' ');
+        }
+        if (escapes) {
+            put_escaped(&out, argv[i], true);
+        } else {
+            put(&out, argv[i], strlen(argv[i]));
+        }
+    }
+    if (new_line) {
+        put_char(&out, '\n');
+    }
+    flush_output(&out);
+    return out.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Print current working directory, logical one from PWD if it is set.
+ */
+static int pwd_builtin(int argc, char* argv[], const int fds[]) {
+    (void) argc;
+    (void) argv;
+
+    const char* pwd = get_variable("PWD", 3);
+    char* const CWD = pwd ? NULL : getcwd(NULL, 0);
+    if (!pwd && !CWD) {
+        print_builtin_error(fds, "pwd: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    pwd = pwd ? pwd : CWD;
+    struct Output out = {fds[STDOUT_FILENO], false, 0, {0}};
+    put(&out, pwd, strlen(pwd));
+    put_char(&out, '\n');
+    flush_output(&out);
+    free(CWD);
+    return out.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads single line from file descriptor.
+ *
+ * @details Reads one byte at a time, so nothing after the new line is
+ * consumed from shared input. Backslash escapes next character unless raw.
+ *
+ * @param[in] fd The file descriptor to read from.
+ * @param[in] raw Do not interpret backslashes.
+ * @param[out] is_eof Set to true if end of file was reached.
+ *
+ * @return Allocated line without new line character, or NULL on failure.
+ * Line is truncated if it does not fit in memory.
+ */
+static char* read_line(int fd, bool raw, bool* is_eof) {
+    size_t size = 128;
+    size_t length = 0;
+    char* line = malloc(size);
+    if (!line) {
+        check_alloc(line, "read line");
+        return NULL;
+    }
+
+    bool is_escaped = false;
+    *is_eof = true;
+    char c;
+    ssize_t got;
+    while ((got = read(fd, &c, 1)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (!raw && !is_escaped && c == '\\') {
+            is_escaped = true;
+            continue;
+        }
+        if (c == '\n') {
+            if (is_escaped) { // Line continuation
+                is_escaped = false;
+                continue;
+            }
+            *is_eof = false;
+            break;
+        }
+        is_escaped = false;
+
+        if (length + 1 == size) {
+            char* bigger = realloc(line, size * 2);
+            if (!check_alloc(bigger, "read line")) {
+                break; // Keep what is already read
+            }
+            line = bigger;
+            size *= 2;
+        }
+        line[length++] = c;
+    }
+    line[length] = '\0';
+    return line;
+}
+
+/**
+ * @brief Read a line from stdin and assign its fields to variables.
+ *
+ * @details Fields are separated by whitespace, the last variable gets the
+ * rest of the line. Variables are shell variables, they are exported only
+ * if they were exported before.
+ */
+static int read_builtin(int argc, char* argv[], const int fds[]) {
+    int i = 1;
+    const bool raw = i < argc && !strcmp(argv[i], "-r");
+    if (raw) {
+        ++i;
+    }
+    if (i == argc) {
+        print_builtin_error(fds, "read: variable name expected");
+        return 2;
+    }
+
+    bool is_eof;
+    char* line = read_line(fds[STDIN_FILENO], raw, &is_eof);
+    if (!line) {
+        return EXIT_FAILURE;
+    }
+
+    static const char IFS[] = " \t\n";
+    char* field = line + strspn(line, IFS);
+    for (; i < argc; ++i) {
+        char* end;
+        if (i == argc - 1) { // The last variable gets the rest of the line
+            end = field + strlen(field);
+            while (end > field && strchr(IFS, end[-1])) {
+                --end;
+            }
+        } else {
+            end = field + strcspn(field, IFS);
+        }
+        const bool is_last_field = !*end;
+        *end = '\0';
+
+        if (!is_variable_name(argv[i], strlen(argv[i]))) {
+            print_builtin_error(fds, "read: %s: not a valid identifier",
+                                argv[i]);
+            free(line);
+            return EXIT_FAILURE;
+        }
+        if (!set_variable(argv[i], field)) {
+            free(line);
+            return EXIT_FAILURE;
+        }
+        field = is_last_field ? end : end + 1;
+        field += strspn(field, IFS);
+    }
+
+    free(line);
+    return is_eof ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-bool is_in_table(const char string[]) {
-    for (size_t i = 0; i < sizeof(TABLE) / sizeof(char*); ++i) {
-        if (!strcmp(string, TABLE[i])) {
+/**
+ * @brief Parses numeric argument of printf, prints error if it is invalid.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] string The argument to parse.
+ * @param[out] value Parsed value.
+ *
+ * @return True if whole argument is a number, otherwise false.
+ */
+static bool parse_printf_number(const int fds[], const char string[],
+                                long long* value) {
+    if (string[0] == '\'' || string[0] == '"') { // Character code
+        *value = (unsigned char) string[1];
+        return true;
+    }
+    char* end;
+    errno = 0;
+    *value = strtoll(string, &end, 0);
+    if (errno || *end || end == string) {
+        if (*string) {
+            print_builtin_error(fds, "printf: %s: invalid number", string);
+            return false;
+        }
+        *value = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends single conversion of printf format.
+ *
+ * @param[in,out] out The output to append to.
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] spec Conversion specification without length modifier.
+ * @param[in] value The argument to convert.
+ *
+ * @return False on invalid argument or specification, otherwise true.
+ */
+static bool put_conversion(struct Output* out, const int fds[], char spec[],
+                           const char value[]) {
+    const size_t length = strlen(spec);
+    const char conversion = spec[length - 1];
+
+    if (conversion == 's') {
+        put_format(out, spec, value);
+        return true;
+    }
+    if (conversion == 'c') {
+        put_format(out, spec, value[0]);
+        return true;
+    }
+    if (conversion == 'b') {
+        put_escaped(out, value, true);
+        return true;
+    }
+    if (!strchr("diouxX", conversion)) {
+        print_builtin_error(fds, "printf: %%%c: invalid conversion",
+                            conversion);
+        return false;
+    }
+
+    long long number;
+    const bool is_valid = parse_printf_number(fds, value, &number);
+    // Insert "ll" length modifier before conversion character
+    char long_spec[SPEC_SIZE + 2];
+    memcpy(long_spec, spec, length - 1);
+    strcpy(long_spec + length - 1, "ll");
+    long_spec[length + 1] = conversion;
+    long_spec[length + 2] = '\0';
+
+    if (conversion == 'd' || conversion == 'i') {
+        put_format(out, long_spec, number);
+    } else {
+        put_format(out, long_spec, (unsigned long long) number);
+    }
+    return is_valid;
+}
+
+/**
+ * @brief Formatted output, format is reused while arguments remain.
+ */
+static int printf_builtin(int argc, char* argv[], const int fds[]) {
+    if (argc < 2) {
+        print_builtin_error(fds, "printf: usage: printf format [arguments]");
+        return 2;
+    }
+
+    struct Output out = {fds[STDOUT_FILENO], false, 0, {0}};
+    int status = EXIT_SUCCESS;
+    int arg = 2;
+    do {
+        const int first_arg = arg;
+        for (const char* f = argv[1]; *f; ++f) {
+            if (*f == '\\') {
+                f += put_escape(&out, f + 1, false);
+                continue;
+            }
+            if (*f != '%') {
+                const char* next = strpbrk(f, "\\%");
+                const size_t length = next ? (size_t) (next - f) : strlen(f);
+                put(&out, f, length);
+                f += length - 1;
+                continue;
+            }
+            if (f[1] == '%') {
+                put_char(&out, '%');
+                ++f;
+                continue;
+            }
+
+            const size_t length = strspn(f + 1, "-+ #0123456789.") + 2;
+            if (length >= SPEC_SIZE || !f[length - 1]) {
+                print_builtin_error(fds, "printf: invalid format");
+                flush_output(&out);
+                return EXIT_FAILURE;
+            }
+            char spec[SPEC_SIZE];
+            memcpy(spec, f, length);
+            spec[length] = '\0';
+            f += length - 1;
+
+            const char* value = (arg < argc) ? argv[arg++] : "";
+            if (!put_conversion(&out, fds, spec, value)) {
+                status = EXIT_FAILURE;
+            }
+        }
+        if (arg == first_arg) {
+            break;
+        }
+    } while (arg < argc);
+
+    flush_output(&out);
+    return out.failed ? EXIT_FAILURE : status;
+}
+
+/**
+ * @brief Parses integer operand of test.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] string The operand to parse.
+ * @param[out] value Parsed value.
+ *
+ * @return True if operand is integer, otherwise false.
+ */
+static bool parse_test_integer(const int fds[], const char string[],
+                               long long* value) {
+    char* end;
+    errno = 0;
+    *value = strtoll(string, &end, 10);
+    if (errno || *end || end == string) {
+        print_builtin_error(fds, "test: %s: integer expected", string);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Evaluates unary test expression.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] op The operator.
+ * @param[in] operand The operand.
+ *
+ * @return 0 if expression is true, 1 if false and 2 on error.
+ */
+static int test_unary(const int fds[], const char op[], const char operand[]) {
+    if (op[0] != '-' || !op[1] || op[2]) {
+        print_builtin_error(fds, "test: %s: unary operator expected", op);
+        return 2;
+    }
+    if (op[1] == 'n' || op[1] == 'z') {
+        return (op[1] == 'n') == !operand[0];
+    }
+    if (op[1] == 't') {
+        return !isatty(atoi(operand));
+    }
+    if (strchr("rwx", op[1])) {
+        const int mode = (op[1] == 'r') ? R_OK : (op[1] == 'w') ? W_OK : X_OK;
+        return access(operand, mode) != 0;
+    }
+
+    struct stat st;
+    const bool is_link = op[1] == 'L' || op[1] == 'h';
+    if (!strchr("efdsLhpSbc", op[1])) {
+        print_builtin_error(fds, "test: %s: unary operator expected", op);
+        return 2;
+    }
+    if ((is_link ? lstat(operand, &st) : stat(operand, &st))) {
+        return 1;
+    }
+    switch (op[1]) {
+        case 'f':
+            return !S_ISREG(st.st_mode);
+        case 'd':
+            return !S_ISDIR(st.st_mode);
+        case 's':
+            return st.st_size <= 0;
+        case 'L':
+        case 'h':
+            return !S_ISLNK(st.st_mode);
+        case 'p':
+            return !S_ISFIFO(st.st_mode);
+        case 'S':
+            return !S_ISSOCK(st.st_mode);
+        case 'b':
+            return !S_ISBLK(st.st_mode);
+        case 'c':
+            return !S_ISCHR(st.st_mode);
+        default: // 'e'
+            return 0;
+    }
+}
+
+/**
+ * @brief Determine if string is binary operator of test.
+ *
+ * @param[in] op The string to check.
+ *
+ * @return True if op is binary operator.
+ */
+static bool is_binary_operator(const char op[]) {
+    static const char* const OPERATORS[] = {
+            "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+            "-ge", "-nt", "-ot"
+    };
+    for (size_t i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); ++i) {
+        if (!strcmp(op, OPERATORS[i])) {
             return true;
         }
     }
     return false;
 }
+
+/**
+ * @brief Evaluates binary test expression.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] left The left operand.
+ * @param[in] op The binary operator, checked by is_binary_operator().
+ * @param[in] right The right operand.
+ *
+ * @return 0 if expression is true, 1 if false and 2 on error.
+ */
+static int test_binary(const int fds[], const char left[], const char op[],
+                       const char right[]) {
+    if (op[0] != '-') {
+        const int order = strcmp(left, right);
+        switch (op[0]) {
+            case '=':
+                return order != 0;
+            case '!':
+                return order == 0;
+            case '<':
+                return order >= 0;
+            default: // '>'
+                return order <= 0;
+        }
+    }
+
+    if (op[1] == 'n' && op[2] == 't') {
+        struct stat left_st, right_st;
+        if (stat(left, &left_st)) {
+            return 1;
+        }
+        if (stat(right, &right_st)) {
+            return 0;
+        }
+        const struct timespec* l = &left_st.st_mtim;
+        const struct timespec* r = &right_st.st_mtim;
+        return l->tv_sec < r->tv_sec ||
+               (l->tv_sec == r->tv_sec && l->tv_nsec <= r->tv_nsec);
+    }
+    if (op[1] == 'o' && op[2] == 't') {
+        return test_binary(fds, right, "-nt", left);
+    }
+
+    long long a, b;
+    if (!parse_test_integer(fds, left, &a) ||
+        !parse_test_integer(fds, right, &b)) {
+        return 2;
+    }
+    if (!strcmp(op, "-eq")) {
+        return !(a == b);
+    } else if (!strcmp(op, "-ne")) {
+        return !(a != b);
+    } else if (!strcmp(op, "-lt")) {
+        return !(a < b);
+    } else if (!strcmp(op, "-le")) {
+        return !(a <= b);
+    } else if (!strcmp(op, "-gt")) {
+        return !(a > b);
+    }
+    return !(a >= b);
+}
+
+/**
+ * @brief Negates result of test expression, preserving error status.
+ *
+ * @param[in] status Result of test expression.
+ *
+ * @return Negated result.
+ */
+static int test_negate(int status) {
+    return (status == 2) ? 2 : !status;
+}
+
+/**
+ * @brief Evaluates test expression according to amount of operands.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] argc Amount of operands.
+ * @param[in] argv Operands.
+ *
+ * @return 0 if expression is true, 1 if false and 2 on error.
+ */
+static int test_expression(const int fds[], int argc, char* argv[]) {
+    switch (argc) {
+        case 0:
+            return 1;
+        case 1:
+            return !argv[0][0];
+        case 2:
+            if (!strcmp(argv[0], "!")) {
+                return test_negate(test_expression(fds, 1, argv + 1));
+            }
+            return test_unary(fds, argv[0], argv[1]);
+        case 3:
+            if (is_binary_operator(argv[1])) {
+                return test_binary(fds, argv[0], argv[1], argv[2]);
+            }
+            if (!strcmp(argv[0], "!")) {
+                return test_negate(test_expression(fds, 2, argv + 1));
+            }
+            print_builtin_error(fds, "test: %s: binary operator expected",
+                                argv[1]);
+            return 2;
+        case 4:
+            if (!strcmp(argv[0], "!")) {
+                return test_negate(test_expression(fds, 3, argv + 1));
+            }
+            // fall through
+        default:
+            print_builtin_error(fds, "test: too many arguments");
+            return 2;
+    }
+}
+
+/**
+ * @brief Evaluate conditional expression.
+ */
+static int test_builtin(int argc, char* argv[], const int fds[]) {
+    return test_expression(fds, argc - 1, argv + 1);
+}
+
+/**
+ * @brief Same as test, but last argument must be "]".
+ */
+static int bracket_builtin(int argc, char* argv[], const int fds[]) {
+    if (strcmp(argv[argc - 1], "]") != 0) {
+        print_builtin_error(fds, "[: missing ]");
+        return 2;
+    }
+    return test_expression(fds, argc - 2, argv + 1);
+}
+
+/**
+ * @brief Do nothing successfully.
+ */
+static int true_builtin(int argc, char* argv[], const int fds[]) {
+    (void) argc;
+    (void) argv;
+    (void) fds;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Do nothing unsuccessfully.
+ */
+static int false_builtin(int argc, char* argv[], const int fds[]) {
+    (void) argc;
+    (void) argv;
+    (void) fds;
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Table of built-in commands.
+ *
+ * @details Must be sorted by name in strcmp() order for find_builtin().
+ */
+static const struct BuiltIn TABLE[] = {
+        {"[",        bracket_builtin},
+        {"bg",       bg_builtin},
+        {"cd",       cd_builtin},
+        {"echo",     echo_builtin},
+        {"exit",     exit_builtin},
+        {"export",   export_builtin},
+        {"false",    false_builtin},
+        {"fg",       fg_builtin},
+        {"hash",     hash_builtin},
+        {"history",  history_builtin},
+        {"jobs",     jobs_builtin},
+        {"parallel", parallel_builtin},
+        {"printf",   printf_builtin},
+        {"pwd",      pwd_builtin},
+        {"read",     read_builtin},
+        {"readonly", readonly_builtin},
+        {"test",     test_builtin},
+        {"true",     true_builtin},
+        {"unset",    unset_builtin},
+        {"wait",     wait_builtin},
+};
+
+/**
+ * @brief Compares name with name of built-in command for bsearch().
+ *
+ * @param[in] name The name to compare.
+ * @param[in] builtin The entry of TABLE.
+ *
+ * @return Result of strcmp() of names.
+ */
+static int compare_name(const void* name, const void* builtin) {
+    return strcmp(name, ((const struct BuiltIn*) builtin)->name);
+}
+
+const struct BuiltIn* find_builtin(const char name[]) {
+    return bsearch(name, TABLE, sizeof(TABLE) / sizeof(TABLE[0]),
+                   sizeof(TABLE[0]), compare_name);
+}
+
+const struct BuiltIn* get_builtins(size_t* amount) {
+    *amount = sizeof(TABLE) / sizeof(TABLE[0]);
+    return TABLE;
+}
@@ -26,18 +26,54 @@
 #define KARASHI_BUILT_IN_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
-// Shell built-in commands
-#define CD "cd"     ///< Change current working directory.
-#define EXIT "exit" ///< Quit shell.
+/**
+ * @brief Handler of built-in command executed inside shell process.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Exit status of the command.
+ */
+typedef int (*BuiltInHandler)(int argc, char* argv[], const int fds[]);
 
 /**
- * @brief Determine if string is built-in command.
+ * @brief Entry of built-in commands table.
+ */
+struct BuiltIn {
+    const char* name;       ///< Name of the command.
+    BuiltInHandler handler; ///< Implementation of the command.
+};
+
+/**
+ * @brief Finds built-in command by name.
+ *
+ * @details Table is sorted by name at compile time, so lookup is a binary
+ * search.
+ *
+ * @param[in] name The command name.
  *
- * @param[in] string The string to check.
+ * @return Built-in command, or NULL if there is no such command.
+ */
+const struct BuiltIn* find_builtin(const char name[]);
+
+/**
+ * @brief Gets table of all built-in commands.
+ *
+ * @param[out] amount Amount of built-in commands.
+ *
+ * @return Table sorted by name.
+ */
+const struct BuiltIn* get_builtins(size_t* amount);
+
+/**
+ * @brief Prints error message of built-in command in bold red.
  *
- * @return True if the string is in the table, and false otherwise.
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] format Format of the message, printf() style.
  */
-bool is_in_table(const char string[]);
+void print_builtin_error(const int fds[], const char format[], ...);
 
 #endif //KARASHI_BUILT_IN_H
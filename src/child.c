@@ -17,42 +17,665 @@
 /**
  * @file child.c
  *
- * @brief Contents unique shell semaphore and array for child processes ids.
+ * @brief Contents start gate, table of jobs and job control built-in
+ * commands.
  */
 
+#define _GNU_SOURCE
+
 #include "child.h"
 
 #include <stdio.h>
-#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 
+#include "built-in.h"
+#include "events.h"
 #include "utility.h"
 
-#define MAX_CHILD 1024 ///< Max amount of commands in pipe queue
-#define MAX_LEN 16     ///< Max length for unique semaphore name
+#define PROCESSES_CAPACITY 4 ///< Initial capacity of job processes array.
+#define JOBS_CAPACITY 8      ///< Initial capacity of jobs table.
+#define PIDFDS_LIMIT 64      ///< Max amount of pidfds open at once.
+
+struct Job** jobs = NULL;
+size_t jobs_amount = 0;
+
+/**
+ * @brief Capacity of jobs table.
+ */
+static size_t jobs_capacity = 0;
+
+/**
+ * @brief Amount of open pidfds of processes.
+ *
+ * @details Limited by PIDFDS_LIMIT, so long pipeline does not need a
+ * descriptor per stage. Processes above the limit are reaped on SIGCHLD.
+ */
+static size_t pidfds_amount = 0;
+
+/**
+ * @brief Job which receives forwarded signals, NULL if shell waits for none.
+ */
+static struct Job* foreground_job = NULL;
+
+/**
+ * @brief True in forked child, which must not touch jobs of the shell.
+ */
+static bool is_detached = false;
+
+/**
+ * @brief Set by SIGINT when there is no foreground job.
+ */
+static bool is_interrupted = false;
 
-pid_t child_pid[MAX_CHILD];
-size_t child_amount;
+/**
+ * @brief Start gate pipe, -1 when closed.
+ *
+ * @details Children read from gate[0] until EOF, which happens once every
+ * copy of gate[1] is closed.
+ */
+static int gate[2] = {-1, -1};
 
-sem_t* sem;
-char sem_name[MAX_LEN];
+/**
+ * @brief Closes file descriptor and marks it as closed.
+ *
+ * @param[in,out] fd The file descriptor to close.
+ */
+static void close_gate_end(int* fd) {
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
 
-void set_sem_name(void) {
-    sprintf(sem_name, "kara.%d", getpid());
+bool open_start_gate(void) {
+    if (pipe2(gate, O_CLOEXEC)) {
+        print_errno();
+        return false;
+    }
+    return true;
+}
+
+void wait_start_gate(void) {
+    close_gate_end(&gate[1]);
+
+    char byte;
+    while (read(gate[0], &byte, sizeof(byte)) < 0 && errno == EINTR) {
+    }
+    close_gate_end(&gate[0]);
+}
+
+void release_start_gate(void) {
+    close_gate_end(&gate[1]);
+    close_gate_end(&gate[0]);
+}
+
+/**
+ * @brief Finds process of any job by id.
+ *
+ * @param[in] pid The process id.
+ *
+ * @return The process, or NULL if there is no such process.
+ */
+static struct Process* find_process(pid_t pid) {
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        for (size_t j = 0; j < jobs[i]->amount; ++j) {
+            if (jobs[i]->processes[j].pid == pid) {
+                return &jobs[i]->processes[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Closes pidfd of the process.
+ *
+ * @param[in,out] process The process.
+ */
+static void close_pidfd(struct Process* process) {
+    if (process->pidfd != -1) {
+        close(process->pidfd);
+        process->pidfd = -1;
+        --pidfds_amount;
+    }
+}
+
+/**
+ * @brief Records exit of reaped process.
+ *
+ * @param[in,out] process The process.
+ * @param[in] status Wait status of the process.
+ * @param[in] usage Resource usage of the process.
+ */
+static void finish_process(struct Process* process, int status,
+                           const struct rusage* usage) {
+    process->state = DONE;
+    process->status = status;
+    process->usage = *usage;
+    clock_gettime(CLOCK_MONOTONIC, &process->finished);
+    close_pidfd(process);
+}
+
+void reap_process(struct Process* process) {
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    do {
+        pid = wait4(process->pid, &status, WNOHANG, &usage);
+    } while (pid < 0 && errno == EINTR);
+    if (pid == process->pid) {
+        finish_process(process, status, &usage);
+    }
+}
+
+void update_children(void) {
+    while (true) {
+        int status;
+        struct rusage usage;
+        const pid_t pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED,
+                                &usage);
+        if (pid < 0 && errno == EINTR) {
+            continue;
+        } else if (pid <= 0) {
+            break;
+        }
+        struct Process* process = find_process(pid);
+        if (!process) {
+            continue;
+        }
+        if (WIFCONTINUED(status)) {
+            process->state = RUNNING;
+        } else if (WIFSTOPPED(status)) {
+            process->state = STOPPED;
+            process->status = status;
+        } else {
+            finish_process(process, status, &usage);
+        }
+    }
+}
+
+struct Job* create_job(char command[], bool is_background) {
+    struct Job* job = calloc(1, sizeof(struct Job));
+    if (!job) {
+        free(command);
+        check_alloc(job, "job");
+        return NULL;
+    }
+    job->command = command;
+    job->is_background = is_background;
+    job->reported = RUNNING;
+
+    bool is_added = true;
+    if (jobs_amount == jobs_capacity) {
+        const size_t capacity = jobs_capacity ? jobs_capacity * 2
+                                              : JOBS_CAPACITY;
+        struct Job** table = realloc(jobs, capacity * sizeof(struct Job*));
+        if (check_alloc(table, "jobs table")) {
+            jobs = table;
+            jobs_capacity = capacity;
+        } else {
+            is_added = false;
+        }
+    }
+    if (is_added) {
+        job->id = jobs_amount ? jobs[jobs_amount - 1]->id + 1 : 1;
+        jobs[jobs_amount++] = job;
+    }
+
+    if (!is_added) {
+        free(command);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void start_process(struct Process* process, pid_t pid) {
+    *process = (struct Process) {.pid = pid, .pidfd = -1, .state = RUNNING};
+    if (pidfds_amount < PIDFDS_LIMIT) {
+        process->pidfd = open_pidfd(pid);
+        pidfds_amount += process->pidfd != -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &process->started);
+}
+
+bool add_process(struct Job* job, pid_t pid) {
+    bool is_added = true;
+    if (job->amount == job->capacity) {
+        const size_t capacity = job->capacity ? job->capacity * 2
+                                              : PROCESSES_CAPACITY;
+        struct Process* processes = realloc(job->processes,
+                                            capacity * sizeof(struct Process));
+        if (check_alloc(processes, "job processes")) {
+            job->processes = processes;
+            job->capacity = capacity;
+        } else {
+            is_added = false;
+        }
+    }
+    if (is_added) {
+        start_process(&job->processes[job->amount++], pid);
+        if (job->is_background && !job->pgid) {
+            job->pgid = pid;
+        }
+    }
+    return is_added;
+}
+
+void remove_job(struct Job* job) {
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        if (jobs[i] == job) {
+            memmove(&jobs[i], &jobs[i + 1],
+                    (jobs_amount - i - 1) * sizeof(struct Job*));
+            --jobs_amount;
+            break;
+        }
+    }
+    if (foreground_job == job) {
+        foreground_job = NULL;
+    }
+
+    for (size_t i = 0; i < job->amount; ++i) {
+        close_pidfd(&job->processes[i]);
+    }
+    free(job->command);
+    free(job->processes);
+    free(job);
+}
+
+/**
+ * @brief Moves job to the end of the table, so it becomes current job.
+ *
+ * @param[in] job The job to move.
+ */
+static void make_current(struct Job* job) {
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        if (jobs[i] == job) {
+            memmove(&jobs[i], &jobs[i + 1],
+                    (jobs_amount - i - 1) * sizeof(struct Job*));
+            jobs[jobs_amount - 1] = job;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Computes state of the job from states of its processes.
+ *
+ * @details Job is running while any process runs, and is done when all
+ * processes are done.
+ *
+ * @param[in] job The job to check.
+ *
+ * @return State of the job.
+ */
+static enum ProcessState get_job_state(const struct Job* job) {
+    enum ProcessState state = DONE;
+    for (size_t i = 0; i < job->amount; ++i) {
+        if (job->processes[i].state == RUNNING) {
+            return RUNNING;
+        }
+        if (job->processes[i].state == STOPPED) {
+            state = STOPPED;
+        }
+    }
+    return state;
+}
+
+/**
+ * @brief Returns waitpid() status of the last process of the job.
+ *
+ * @param[in] job The job to check.
+ *
+ * @return The status, 0 if the job has no processes.
+ */
+static int get_job_status(const struct Job* job) {
+    return job->amount ? job->processes[job->amount - 1].status : 0;
 }
 
-void send_signal_to_child(int sig) {
-    for (size_t i = 0; i < child_amount; ++i) {
-        if (child_pid[i] && kill(child_pid[i], sig)) {
+int get_exit_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Handles events until the job stops running.
+ *
+ * @param[in] job The job to wait for.
+ * @param[in] is_interruptible True if SIGINT stops waiting.
+ */
+static void wait_job(const struct Job* job, bool is_interruptible) {
+    while (get_job_state(job) == RUNNING &&
+           !(is_interruptible && is_interrupted)) {
+        if (wait_events(NULL, 0) < 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Gives the terminal to process group if shell controls it.
+ *
+ * @details SIGTTOU is blocked, because shell may be in background group when
+ * it takes the terminal back.
+ *
+ * @param[in] pgid The process group.
+ */
+static void give_terminal(pid_t pgid) {
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+    sigset_t mask;
+    sigset_t old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief Prints state of the job.
+ *
+ * @param[in] fd The file descriptor to print to.
+ * @param[in] job The job to print.
+ * @param[in] state State of the job.
+ */
+static void print_job(int fd, const struct Job* job, enum ProcessState state) {
+    char marker = ' ';
+    if (jobs_amount && job == jobs[jobs_amount - 1]) {
+        marker = '+';
+    } else if (jobs_amount > 1 && job == jobs[jobs_amount - 2]) {
+        marker = '-';
+    }
+
+    char description[32] = "Running";
+    if (state == STOPPED) {
+        strcpy(description, "Stopped");
+    } else if (state == DONE) {
+        const int status = get_job_status(job);
+        if (WIFSIGNALED(status)) {
+            snprintf(description, sizeof(description), "%s",
+                     strsignal(WTERMSIG(status)));
+        } else if (WEXITSTATUS(status)) {
+            snprintf(description, sizeof(description), "Exit %d",
+                     WEXITSTATUS(status));
+        } else {
+            strcpy(description, "Done");
+        }
+    }
+    dprintf(fd, "[%zu]%c  %-24s%s\n", job->id, marker, description,
+            job->command);
+}
+
+void set_foreground_job(struct Job* job) {
+    foreground_job = job;
+}
+
+int wait_foreground_job(struct Job* job) {
+    foreground_job = job;
+    if (job->pgid) {
+        give_terminal(job->pgid);
+    }
+
+    wait_job(job, false);
+
+    if (job->pgid) {
+        give_terminal(getpgrp());
+    }
+    foreground_job = NULL;
+
+    const int status = get_job_status(job);
+    if (get_job_state(job) == STOPPED) {
+        job->is_background = true;
+        job->reported = STOPPED;
+        make_current(job);
+        fflush(stdout);
+        dprintf(STDOUT_FILENO, "\n");
+        print_job(STDOUT_FILENO, job, STOPPED);
+    }
+    return status;
+}
+
+void collect_jobs(bool is_reported) {
+    if (is_detached) {
+        return;
+    }
+    fflush(stdout);
+
+    size_t i = 0;
+    while (i < jobs_amount) {
+        struct Job* job = jobs[i];
+        const enum ProcessState state = get_job_state(job);
+        if (job->is_background && state != job->reported) {
+            if (is_reported && state != RUNNING) {
+                print_job(STDOUT_FILENO, job, state);
+            }
+            job->reported = state;
+        }
+        if (job->is_background && state == DONE) {
+            remove_job(job);
+        } else {
+            ++i;
+        }
+    }
+}
+
+bool has_job_reports(void) {
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        const enum ProcessState state = get_job_state(jobs[i]);
+        if (jobs[i]->is_background && state != jobs[i]->reported &&
+            state != RUNNING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void detach_jobs(void) {
+    is_detached = true;
+    foreground_job = NULL;
+
+    // Processes of the shell are not children of this process
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        for (size_t j = 0; j < jobs[i]->amount; ++j) {
+            close_pidfd(&jobs[i]->processes[j]);
+        }
+    }
+    detach_events();
+}
+
+/**
+ * @brief Finds job by job specification.
+ *
+ * @details Supports "%N" and "N" for job number, "%%" and "%+" for current
+ * job, "%-" for previous job. Process id is accepted if is_pid_allowed is
+ * set and specification does not start with "%".
+ *
+ * @param[in] spec The job specification, NULL for current job.
+ * @param[in] is_pid_allowed True if plain number is process id.
+ *
+ * @return The job, or NULL if there is no such job.
+ */
+static struct Job* find_job(const char spec[], bool is_pid_allowed) {
+    if (!spec || !strcmp(spec, "%%") || !strcmp(spec, "%+")) {
+        return jobs_amount ? jobs[jobs_amount - 1] : NULL;
+    }
+    if (!strcmp(spec, "%-")) {
+        return jobs_amount > 1 ? jobs[jobs_amount - 2] : NULL;
+    }
+
+    const bool is_job_id = spec[0] == '%' || !is_pid_allowed;
+    const char* number = (spec[0] == '%') ? spec + 1 : spec;
+    char* end;
+    const long id = strtol(number, &end, 10);
+    if (!*number || *end || id <= 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        if (is_job_id && jobs[i]->id == (size_t) id) {
+            return jobs[i];
+        }
+        for (size_t j = 0; !is_job_id && j < jobs[i]->amount; ++j) {
+            if (jobs[i]->processes[j].pid == (pid_t) id) {
+                return jobs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sends SIGCONT to stopped processes of the job.
+ *
+ * @param[in,out] job The job to continue.
+ */
+static void continue_job(struct Job* job) {
+    for (size_t i = 0; i < job->amount; ++i) {
+        struct Process* process = &job->processes[i];
+        if (process->state == STOPPED) {
+            process->state = RUNNING;
+            if (kill(process->pid, SIGCONT)) {
+                print_errno();
+            }
+        }
+    }
+    job->reported = RUNNING;
+}
+
+int jobs_builtin(int argc, char* argv[], const int fds[]) {
+    (void) argc;
+    (void) argv;
+
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        const enum ProcessState state = get_job_state(jobs[i]);
+        print_job(fds[STDOUT_FILENO], jobs[i], state);
+        // Listed state is not reported again before the next prompt
+        jobs[i]->reported = state;
+    }
+    return EXIT_SUCCESS;
+}
+
+int wait_builtin(int argc, char* argv[], const int fds[]) {
+    is_interrupted = false;
+
+    if (argc == 1) {
+        for (size_t i = 0; i < jobs_amount && !is_interrupted; ++i) {
+            wait_job(jobs[i], true);
+        }
+        collect_jobs(false);
+        return is_interrupted ? 128 + SIGINT : EXIT_SUCCESS;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 1; i < argc; ++i) {
+        struct Job* job = find_job(argv[i], true);
+        if (!job) {
+            print_builtin_error(fds, "wait: no such job %s", argv[i]);
+            status = 127;
+            continue;
+        }
+        wait_job(job, true);
+        if (is_interrupted) {
+            return 128 + SIGINT;
+        }
+        status = get_exit_code(get_job_status(job));
+        if (get_job_state(job) == DONE) {
+            remove_job(job);
+        }
+    }
+    return status;
+}
+
+int fg_builtin(int argc, char* argv[], const int fds[]) {
+    struct Job* job = find_job((argc > 1) ? argv[1] : NULL, false);
+    if (!job) {
+        print_builtin_error(fds, "fg: no such job");
+        return EXIT_FAILURE;
+    }
+    dprintf(fds[STDOUT_FILENO], "%s\n", job->command);
+
+    job->is_background = false;
+    continue_job(job);
+    const int status = wait_foreground_job(job);
+    if (!job->is_background) {
+        remove_job(job);
+    }
+    return get_exit_code(status);
+}
+
+int bg_builtin(int argc, char* argv[], const int fds[]) {
+    struct Job* job = find_job((argc > 1) ? argv[1] : NULL, false);
+    if (!job) {
+        print_builtin_error(fds, "bg: no such job");
+        return EXIT_FAILURE;
+    }
+    if (get_job_state(job) != STOPPED) {
+        print_builtin_error(fds, "bg: job %zu is not stopped", job->id);
+        return EXIT_FAILURE;
+    }
+
+    job->is_background = true;
+    continue_job(job);
+    dprintf(fds[STDOUT_FILENO], "[%zu] %s &\n", job->id, job->command);
+    return EXIT_SUCCESS;
+}
+
+void forward_signal(int sig, bool is_from_terminal) {
+    if (!foreground_job) {
+        if (sig == SIGINT) {
+            is_interrupted = true;
+        }
+        return;
+    }
+    // Terminal sends keyboard signals to the whole foreground group itself
+    if (is_from_terminal) {
+        return;
+    }
+    if (foreground_job->pgid) {
+        if (killpg(foreground_job->pgid, sig)) {
             print_errno();
         }
+        return;
     }
+    for (size_t i = 0; i < foreground_job->amount; ++i) {
+        const struct Process* process = &foreground_job->processes[i];
+        if (process->state != DONE && kill(process->pid, sig)) {
+            print_errno();
+        }
+    }
+}
+
+bool take_interrupt(void) {
+    const bool was_interrupted = is_interrupted;
+    is_interrupted = false;
+    return was_interrupted;
 }
 
 void clear_child(void) {
-    send_signal_to_child(SIGTERM);
-    child_amount = 0;
-    sem_close(sem);
-    sem_unlink(sem_name);
+    if (!is_detached) {
+        for (size_t i = 0; i < jobs_amount; ++i) {
+            for (size_t j = 0; j < jobs[i]->amount; ++j) {
+                const struct Process* process = &jobs[i]->processes[j];
+                if (process->state != DONE) {
+                    kill(process->pid, SIGTERM);
+                    kill(process->pid, SIGCONT);
+                }
+            }
+        }
+    }
+    release_start_gate();
 }
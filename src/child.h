@@ -17,8 +17,8 @@
 /**
  * @file child.h
  *
- * @brief Provide interface for communication with child processes during pipe
- * handling.
+ * @brief Provide interface for communication with child processes and table
+ * of foreground and background jobs.
  *
  * @see child.c
  */
@@ -26,29 +26,267 @@
 #ifndef KARASHI_CHILD_H
 #define KARASHI_CHILD_H
 
+#include <stdbool.h>
 #include <stddef.h>
-#include <semaphore.h>
+#include <signal.h>
 
-extern pid_t child_pid[];   ///< Array of child processes ids.
-extern size_t child_amount; ///< Amount of current child processes.
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
 
-extern sem_t* sem;      ///< Used for child sync during pipes handling.
-extern char sem_name[]; ///< Unique semaphore name.
+/**
+ * @brief State of a child process or a whole job.
+ */
+enum ProcessState {
+    RUNNING, ///< Process is running or continued.
+    STOPPED, ///< Process is stopped by a signal.
+    DONE,    ///< Process exited or was killed and is reaped.
+};
+
+/**
+ * @brief Single child process of a job.
+ */
+struct Process {
+    pid_t pid;                ///< Process id.
+    int pidfd;                ///< Pidfd polled for exit, -1 if closed.
+    int status;               ///< Last status reported by wait4().
+    enum ProcessState state;  ///< Current state of the process.
+    struct rusage usage;      ///< Resource usage, valid when process is done.
+    struct timespec started;  ///< Monotonic time of launch.
+    struct timespec finished; ///< Monotonic time of reaping.
+};
+
+/**
+ * @brief Pipeline launched by the shell.
+ *
+ * @details Processes are updated by wait_events() in the order children
+ * change state, never asynchronously.
+ */
+struct Job {
+    size_t id;                  ///< Job number shown to user, starts at 1.
+    pid_t pgid;                 ///< Process group, 0 if job is in shell group.
+    char* command;              ///< Command line of the job.
+    struct Process* processes;  ///< Array of processes.
+    size_t amount;              ///< Amount of processes.
+    size_t capacity;            ///< Capacity of processes array.
+    bool is_background;         ///< True if shell does not wait for the job.
+    enum ProcessState reported; ///< Last state reported to user.
+};
+
+extern struct Job** jobs;  ///< Table of jobs, the last one is current job.
+extern size_t jobs_amount; ///< Amount of jobs in the table.
+
+/**
+ * @brief Opens start gate used for child sync during pipes handling.
+ *
+ * @details The gate is an anonymous pipe: children block on reading it and
+ * all of them are released at once when the shell closes the write end, so
+ * no filesystem objects are created and no one spins.
+ *
+ * @return True if the gate was opened, otherwise false.
+ */
+bool open_start_gate(void);
+
+/**
+ * @brief Blocks child process until shell releases the start gate.
+ *
+ * @details Called in child process right after fork.
+ */
+void wait_start_gate(void);
+
+/**
+ * @brief Releases all child processes waiting on the start gate.
+ */
+void release_start_gate(void);
+
+/**
+ * @brief Reaps exited process.
+ *
+ * @details Called when pidfd of the process is readable. Does nothing if the
+ * process has not exited yet.
+ *
+ * @param[in,out] process The process.
+ */
+void reap_process(struct Process* process);
 
 /**
- * @brief Creates a semaphore name based on the shell process ID.
+ * @brief Updates stopped, continued and exited processes after SIGCHLD.
+ *
+ * @details Reaps every exited child, so processes without pidfd are reaped
+ * here, as well as ones whose pidfd was not polled yet.
+ */
+void update_children(void);
+
+/**
+ * @brief Adds a new job without processes to the table.
+ *
+ * @param[in] command Command line of the job, the job takes ownership.
+ * @param[in] is_background True if shell does not wait for the job.
+ *
+ * @return The new job, or NULL if allocation failed.
+ */
+struct Job* create_job(char command[], bool is_background);
+
+/**
+ * @brief Fills process entry for launched process.
+ *
+ * @details Entry of reaped process may be reused, so long running job does
+ * not grow with every launched process.
+ *
+ * @param[out] process The entry to fill.
+ * @param[in] pid The process id.
+ */
+void start_process(struct Process* process, pid_t pid);
+
+/**
+ * @brief Adds launched process to the job.
+ *
+ * @details The first process of background job becomes its group leader.
+ *
+ * @param[in,out] job The job to add the process to.
+ * @param[in] pid The process id.
+ *
+ * @return True on success, otherwise false.
+ */
+bool add_process(struct Job* job, pid_t pid);
+
+/**
+ * @brief Removes job from the table and frees it.
+ *
+ * @param[in] job The job to remove.
+ */
+void remove_job(struct Job* job);
+
+/**
+ * @brief Converts waitpid() status into shell exit status.
+ *
+ * @param[in] status The status to convert.
+ *
+ * @return Exit code, or 128 + signal number for killed and stopped processes.
+ */
+int get_exit_code(int status);
+
+/**
+ * @brief Selects job which receives signals forwarded by the shell.
+ *
+ * @details Used by built-in commands which wait for their own processes.
+ *
+ * @param[in] job The job, NULL if shell waits for none.
+ */
+void set_foreground_job(struct Job* job);
+
+/**
+ * @brief Waits until foreground job is done or stopped.
+ *
+ * @details The terminal is given to the job process group while waiting.
+ * Stopped job becomes background one. Done job stays in the table, so
+ * caller can inspect its processes and then remove it with remove_job().
+ *
+ * @param[in] job The job to wait for.
+ *
+ * @return wait4() status of the last process, 0 if there is no processes.
+ */
+int wait_foreground_job(struct Job* job);
+
+/**
+ * @brief Removes finished background jobs from the table.
+ *
+ * @param[in] is_reported True to print state changes of background jobs.
+ */
+void collect_jobs(bool is_reported);
+
+/**
+ * @brief Determine if state of any background job has to be reported.
+ *
+ * @return True if collect_jobs() would print something.
+ */
+bool has_job_reports(void);
+
+/**
+ * @brief Forgets jobs of the shell in forked child process.
+ *
+ * @details Jobs stay readable, but the child does not terminate or reap
+ * them, their pidfds are closed. Keyboard signals get default actions.
+ */
+void detach_jobs(void);
+
+/**
+ * @brief Implementation of jobs built-in command.
+ *
+ * @details Lists jobs of the table with their state and command line.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Always zero.
+ */
+int jobs_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Implementation of wait built-in command.
+ *
+ * @details Without arguments waits for all background jobs, otherwise for the
+ * given jobs "%N" or process ids. SIGINT interrupts waiting.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Exit status of the last waited job, 127 for unknown job.
+ */
+int wait_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Implementation of fg built-in command.
+ *
+ * @details Continues the given or current job and waits for it.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Exit status of the job, or 128 + signal number if it is stopped
+ * or killed.
+ */
+int fg_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Implementation of bg built-in command.
+ *
+ * @details Continues the given or current stopped job without waiting for it.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero on success, otherwise one.
+ */
+int bg_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Passes signal received by the shell to the foreground job.
+ *
+ * @details Process group of the job gets the signal with single killpg().
+ * Signals from the terminal are not sent again, since the terminal delivers
+ * them to the foreground group itself. If there is no foreground job, SIGINT
+ * interrupts "wait" built-in and the line being edited.
+ *
+ * @param[in] sig The signal.
+ * @param[in] is_from_terminal True if the signal was generated by terminal.
  */
-void set_sem_name(void);
+void forward_signal(int sig, bool is_from_terminal);
 
 /**
- * @brief Sends a signal to all the child processes.
+ * @brief Checks and resets SIGINT received without foreground job.
  *
- * @param[in] sig The signal to send to the child processes.
+ * @return True if the shell was interrupted since the last call.
  */
-void send_signal_to_child(int sig);
+bool take_interrupt(void);
 
 /**
- * @brief Force termination of all child processes if any and close semaphore.
+ * @brief Force termination of all child processes if any and close start
+ * gate.
  */
 void clear_child(void);
 
@@ -0,0 +1,182 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file classify.c
+ *
+ * @brief Scalar, SSE2 and AVX2 kernels with runtime dispatch.
+ */
+
+#include "classify.h"
+
+#include <stdint.h>
+
+#if defined(HAVE_SIMD_CLASSIFY)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Class of every character for scalar kernel.
+ */
+static unsigned char TABLE[256];
+
+/**
+ * @brief Kernel used by find_class(), NULL until the first call.
+ */
+static ClassifyKernel KERNEL = NULL;
+
+/**
+ * @brief Fills TABLE of character classes.
+ */
+static void fill_table(void) {
+    for (size_t c = 0; c < sizeof(TABLE); ++c) {
+        TABLE[c] = OTHER_CLASS;
+    }
+    for (const char* c = " \t\n\v\f\r"; *c; ++c) {
+        TABLE[(unsigned char) *c] = SPACE_CLASS;
+    }
+    for (const char* c = "'\"\\"; *c; ++c) {
+        TABLE[(unsigned char) *c] = QUOTE_CLASS;
+    }
+    for (const char* c = "|&;<>"; *c; ++c) {
+        TABLE[(unsigned char) *c] = OPERATOR_CLASS;
+    }
+    TABLE['$'] = DOLLAR_CLASS;
+    TABLE['~'] = TILDE_CLASS;
+}
+
+size_t find_class_scalar(const char string[], size_t length,
+                         unsigned classes) {
+    if (TABLE[0] != OTHER_CLASS) {
+        fill_table();
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (TABLE[(unsigned char) string[i]] & classes) {
+            return i;
+        }
+    }
+    return length;
+}
+
+#if defined(HAVE_SIMD_CLASSIFY)
+
+/**
+ * @brief Generates vector kernel for specific register width.
+ *
+ * @details Every class is computed with a few byte comparisons and combined
+ * into bit mask of requested classes, one bit per character.
+ *
+ * @param NAME Name of the kernel function.
+ * @param ATTRIBUTE Target attribute of the kernel.
+ * @param VEC Vector type.
+ * @param WIDTH Amount of bytes in vector.
+ * @param SET1 Broadcast intrinsic.
+ * @param LOAD Unaligned load intrinsic.
+ * @param CMPEQ Byte comparison intrinsic.
+ * @param OR Bitwise or intrinsic.
+ * @param SUB Byte subtraction intrinsic.
+ * @param MIN Unsigned byte minimum intrinsic.
+ * @param MOVEMASK Byte mask extraction intrinsic.
+ */
+#define DEFINE_KERNEL(NAME, ATTRIBUTE, VEC, WIDTH, SET1, LOAD, CMPEQ, OR,      \
+                      SUB, MIN, MOVEMASK)                                      \
+ATTRIBUTE                                                                      \
+size_t NAME(const char string[], size_t length, unsigned classes) {            \
+    const VEC SPACE = SET1(' ');                                               \
+    const VEC TAB = SET1('\t');                                                \
+    const VEC CONTROL_RANGE = SET1('\r' - '\t');                               \
+    const VEC SINGLE_QUOTE = SET1('\'');                                       \
+    const VEC DOUBLE_QUOTE = SET1('"');                                        \
+    const VEC BACKSLASH = SET1('\\');                                          \
+    const VEC DOLLAR = SET1('$');                                              \
+    const VEC TILDE = SET1('~');                                               \
+    const VEC PIPE = SET1('|');                                                \
+    const VEC AMPERSAND = SET1('&');                                           \
+    const VEC SEMICOLON = SET1(';');                                           \
+    const VEC LESS = SET1('<');                                                \
+    const VEC GREATER = SET1('>');                                             \
+                                                                               \
+    size_t i = 0;                                                              \
+    for (; i + WIDTH <= length; i += WIDTH) {                                  \
+        const VEC chunk = LOAD((const VEC*) (string + i));                     \
+        /* '\t'..'\r' are consecutive, so a single range check is enough */    \
+        const VEC control = SUB(chunk, TAB);                                   \
+        const VEC space = OR(CMPEQ(chunk, SPACE),                              \
+                             CMPEQ(MIN(control, CONTROL_RANGE), control));     \
+        const VEC quote = OR(OR(CMPEQ(chunk, SINGLE_QUOTE),                    \
+                                CMPEQ(chunk, DOUBLE_QUOTE)),                   \
+                             CMPEQ(chunk, BACKSLASH));                         \
+        const VEC dollar = CMPEQ(chunk, DOLLAR);                               \
+        const VEC tilde = CMPEQ(chunk, TILDE);                                 \
+        const VEC operator = OR(OR(OR(CMPEQ(chunk, PIPE), CMPEQ(chunk, LESS)), \
+                                   CMPEQ(chunk, SEMICOLON)),                   \
+                                OR(CMPEQ(chunk, GREATER),                      \
+                                   CMPEQ(chunk, AMPERSAND)));                  \
+                                                                               \
+        uint32_t mask = 0;                                                     \
+        if (classes & SPACE_CLASS) {                                           \
+            mask |= (uint32_t) MOVEMASK(space);                                \
+        }                                                                      \
+        if (classes & QUOTE_CLASS) {                                           \
+            mask |= (uint32_t) MOVEMASK(quote);                                \
+        }                                                                      \
+        if (classes & DOLLAR_CLASS) {                                          \
+            mask |= (uint32_t) MOVEMASK(dollar);                               \
+        }                                                                      \
+        if (classes & TILDE_CLASS) {                                           \
+            mask |= (uint32_t) MOVEMASK(tilde);                                \
+        }                                                                      \
+        if (classes & OPERATOR_CLASS) {                                        \
+            mask |= (uint32_t) MOVEMASK(operator);                             \
+        }                                                                      \
+        if (classes & OTHER_CLASS) {                                           \
+            const VEC special = OR(OR(OR(space, quote), OR(dollar, tilde)),    \
+                                   operator);                                  \
+            mask |= ~(uint32_t) MOVEMASK(special) &                            \
+                    (uint32_t) ((1ULL << WIDTH) - 1);                          \
+        }                                                                      \
+        if (mask) {                                                            \
+            return i + (size_t) __builtin_ctz(mask);                           \
+        }                                                                      \
+    }                                                                          \
+    return i + find_class_scalar(string + i, length - i, classes);             \
+}
+
+DEFINE_KERNEL(find_class_sse2, , __m128i, 16, _mm_set1_epi8, _mm_loadu_si128,
+              _mm_cmpeq_epi8, _mm_or_si128, _mm_sub_epi8, _mm_min_epu8,
+              _mm_movemask_epi8)
+
+DEFINE_KERNEL(find_class_avx2, __attribute__((target("avx2"))), __m256i, 32,
+              _mm256_set1_epi8, _mm256_loadu_si256, _mm256_cmpeq_epi8,
+              _mm256_or_si256, _mm256_sub_epi8, _mm256_min_epu8,
+              _mm256_movemask_epi8)
+
+bool has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+size_t find_class(const char string[], size_t length, unsigned classes) {
+    if (!KERNEL) {
+        KERNEL = find_class_scalar;
+#if defined(HAVE_SIMD_CLASSIFY)
+        KERNEL = has_avx2() ? find_class_avx2 : find_class_sse2;
+#endif
+    }
+    return KERNEL(string, length, classes);
+}
@@ -0,0 +1,104 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file classify.h
+ *
+ * @brief Vectorized classification of characters for the scanner.
+ *
+ * @see classify.c
+ */
+
+#ifndef KARASHI_CLASSIFY_H
+#define KARASHI_CLASSIFY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Classes of characters significant for the scanner.
+ *
+ * @details Every character belongs to exactly one class.
+ */
+enum CharClass {
+    SPACE_CLASS = 1 << 0,    ///< Whitespace characters " \t\n\v\f\r".
+    QUOTE_CLASS = 1 << 1,    ///< Quotes and backslash "'\"\\".
+    DOLLAR_CLASS = 1 << 2,   ///< Variable expansion "$".
+    TILDE_CLASS = 1 << 3,    ///< Home directory expansion "~".
+    OPERATOR_CLASS = 1 << 4, ///< Operator characters "|&;<>".
+    OTHER_CLASS = 1 << 5,    ///< Any other character.
+};
+
+/// Characters which terminate plain part of a word.
+#define WORD_END_CLASSES (SPACE_CLASS | QUOTE_CLASS | OPERATOR_CLASS)
+
+/**
+ * @brief Signature of classification kernel.
+ *
+ * @param[in] string The string to scan.
+ * @param[in] length Amount of characters to scan.
+ * @param[in] classes Bitwise or of CharClass values to look for.
+ *
+ * @return Offset of the first character of any of the classes, or length if
+ * there is no such character.
+ */
+typedef size_t (*ClassifyKernel)(const char string[], size_t length,
+                                 unsigned classes);
+
+/**
+ * @brief Finds the first character of any of the classes.
+ *
+ * @details Uses the widest kernel supported by the CPU, selected on the first
+ * call.
+ *
+ * @param[in] string The string to scan.
+ * @param[in] length Amount of characters to scan.
+ * @param[in] classes Bitwise or of CharClass values to look for.
+ *
+ * @return Offset of the first character of any of the classes, or length if
+ * there is no such character.
+ */
+size_t find_class(const char string[], size_t length, unsigned classes);
+
+/**
+ * @brief Portable kernel processing one character at a time.
+ */
+size_t find_class_scalar(const char string[], size_t length, unsigned classes);
+
+#if defined(__x86_64__)
+#define HAVE_SIMD_CLASSIFY ///< SSE2 and AVX2 kernels are available.
+
+/**
+ * @brief Kernel processing 16 characters at a time.
+ */
+size_t find_class_sse2(const char string[], size_t length, unsigned classes);
+
+/**
+ * @brief Kernel processing 32 characters at a time.
+ *
+ * @details Must be called only if has_avx2() returns true.
+ */
+size_t find_class_avx2(const char string[], size_t length, unsigned classes);
+
+/**
+ * @brief Determine if CPU supports AVX2 instructions.
+ *
+ * @return True if find_class_avx2() is safe to call.
+ */
+bool has_avx2(void);
+#endif
+
+#endif //KARASHI_CLASSIFY_H
@@ -0,0 +1,365 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file completion.c
+ *
+ * @brief Sorted index of command names for readline completion.
+ */
+
+#define _GNU_SOURCE
+
+#include "completion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Including GNU readline library.
+#include <readline.h>
+
+#include "built-in.h"
+#include "utility.h"
+#include "variables.h"
+
+/**
+ * @brief Executables of single PATH directory.
+ */
+struct PathDirectory {
+    char* path;            ///< Path of the directory.
+    struct timespec mtime; ///< Modification time when it was read.
+    bool is_read;          ///< True if directory was read.
+    char** names;          ///< Names of executables.
+    size_t amount;         ///< Amount of names.
+};
+
+/**
+ * @brief Directories of PATH in order.
+ */
+static struct PathDirectory* DIRECTORIES = NULL;
+
+/**
+ * @brief Amount of DIRECTORIES.
+ */
+static size_t DIRECTORIES_AMOUNT = 0;
+
+/**
+ * @brief Copy of PATH value the directories were taken from.
+ */
+static char* INDEXED_PATH = NULL;
+
+/**
+ * @brief Sorted unique command names, borrowed from directories and
+ * built-in table.
+ */
+static const char** INDEX = NULL;
+
+/**
+ * @brief Amount of names in INDEX.
+ */
+static size_t INDEX_AMOUNT = 0;
+
+/**
+ * @brief Frees names of the directory.
+ *
+ * @param[in,out] directory The directory.
+ */
+static void free_names(struct PathDirectory* directory) {
+    for (size_t i = 0; i < directory->amount; ++i) {
+        free(directory->names[i]);
+    }
+    free(directory->names);
+    directory->names = NULL;
+    directory->amount = 0;
+}
+
+/**
+ * @brief Reads names of executables in the directory.
+ *
+ * @details Directory, which cannot be read, has no names.
+ *
+ * @param[in,out] directory The directory to read, its mtime is already set.
+ */
+static void read_directory(struct PathDirectory* directory) {
+    free_names(directory);
+    DIR* dir = opendir(directory->path);
+    if (!dir) {
+        return;
+    }
+
+    size_t capacity = 0;
+    const struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        struct stat st;
+        if (entry->d_name[0] == '.' ||
+            fstatat(dirfd(dir), entry->d_name, &st, 0) ||
+            !S_ISREG(st.st_mode) ||
+            !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+            continue;
+        }
+        if (directory->amount == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** names = realloc(directory->names,
+                                   capacity * sizeof(char*));
+            if (!check_alloc(names, "completion names")) {
+                break;
+            }
+            directory->names = names;
+        }
+        char* name = strdup(entry->d_name);
+        if (!check_alloc(name, "completion name")) {
+            break;
+        }
+        directory->names[directory->amount++] = name;
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief Splits PATH into directories, keeping already read ones.
+ *
+ * @param[in] path_env Value of PATH variable.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool split_path(const char path_env[]) {
+    size_t amount = 1;
+    for (const char* c = path_env; *c; ++c) {
+        amount += *c == ':';
+    }
+    struct PathDirectory* directories = calloc(amount,
+                                               sizeof(*directories));
+    char* indexed_path = strdup(path_env);
+    if (!check_alloc(directories, "completion directories") ||
+        !check_alloc(indexed_path, "completion PATH")) {
+        free(directories);
+        free(indexed_path);
+        return false;
+    }
+
+    for (size_t i = 0; i < amount; ++i) {
+        const char* end = strchrnul(path_env, ':');
+        // Empty PATH entry means current directory
+        const size_t length = (size_t) (end - path_env);
+        directories[i].path = length ? strndup(path_env, length)
+                                     : strdup(".");
+        check_alloc(directories[i].path, "completion directory");
+
+        for (size_t j = 0; directories[i].path && j < DIRECTORIES_AMOUNT;
+             ++j) {
+            if (DIRECTORIES[j].path &&
+                !strcmp(DIRECTORIES[j].path, directories[i].path)) {
+                directories[i].mtime = DIRECTORIES[j].mtime;
+                directories[i].is_read = DIRECTORIES[j].is_read;
+                directories[i].names = DIRECTORIES[j].names;
+                directories[i].amount = DIRECTORIES[j].amount;
+                DIRECTORIES[j].names = NULL;
+                DIRECTORIES[j].amount = 0;
+                break;
+            }
+        }
+        path_env = *end ? end + 1 : end;
+    }
+
+    for (size_t i = 0; i < DIRECTORIES_AMOUNT; ++i) {
+        free_names(&DIRECTORIES[i]);
+        free(DIRECTORIES[i].path);
+    }
+    free(DIRECTORIES);
+    free(INDEXED_PATH);
+    DIRECTORIES = directories;
+    DIRECTORIES_AMOUNT = amount;
+    INDEXED_PATH = indexed_path;
+    return true;
+}
+
+/**
+ * @brief Compares names for qsort().
+ *
+ * @param[in] a Pointer to the first name.
+ * @param[in] b Pointer to the second name.
+ *
+ * @return Result of strcmp().
+ */
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+/**
+ * @brief Merges names of directories and built-in commands into the index.
+ */
+static void build_index(void) {
+    size_t builtins_amount;
+    const struct BuiltIn* builtins = get_builtins(&builtins_amount);
+    size_t amount = builtins_amount;
+    for (size_t i = 0; i < DIRECTORIES_AMOUNT; ++i) {
+        amount += DIRECTORIES[i].amount;
+    }
+
+    const char** index = malloc(amount * sizeof(char*));
+    if (!check_alloc(index, "completion index")) {
+        return;
+    }
+    size_t position = 0;
+    for (size_t i = 0; i < builtins_amount; ++i) {
+        index[position++] = builtins[i].name;
+    }
+    for (size_t i = 0; i < DIRECTORIES_AMOUNT; ++i) {
+        for (size_t j = 0; j < DIRECTORIES[i].amount; ++j) {
+            index[position++] = DIRECTORIES[i].names[j];
+        }
+    }
+    qsort(index, amount, sizeof(char*), compare_names);
+
+    // The same name may be found in several directories
+    size_t unique = 0;
+    for (size_t i = 0; i < amount; ++i) {
+        if (!unique || strcmp(index[unique - 1], index[i])) {
+            index[unique++] = index[i];
+        }
+    }
+
+    free(INDEX);
+    INDEX = index;
+    INDEX_AMOUNT = unique;
+}
+
+/**
+ * @brief Brings the index up to date with PATH.
+ *
+ * @details Only modification times of directories are checked when nothing
+ * changed, a changed directory is read again and the index is merged anew.
+ */
+static void refresh_index(void) {
+    const char* path_env = get_variable("PATH", strlen("PATH"));
+    if (!path_env) {
+        path_env = "";
+    }
+    bool is_changed = !INDEX;
+    if (!INDEXED_PATH || strcmp(INDEXED_PATH, path_env)) {
+        if (!split_path(path_env)) {
+            return;
+        }
+        is_changed = true;
+    }
+
+    for (size_t i = 0; i < DIRECTORIES_AMOUNT; ++i) {
+        struct PathDirectory* directory = &DIRECTORIES[i];
+        struct stat st;
+        // Missing directory is read again when it appears
+        if (!directory->path || stat(directory->path, &st)) {
+            st.st_mtim = (struct timespec) {0, 0};
+        }
+        if (directory->is_read &&
+            st.st_mtim.tv_sec == directory->mtime.tv_sec &&
+            st.st_mtim.tv_nsec == directory->mtime.tv_nsec) {
+            continue;
+        }
+        directory->mtime = st.st_mtim;
+        directory->is_read = true;
+        if (directory->path) {
+            read_directory(directory);
+        }
+        is_changed = true;
+    }
+
+    if (is_changed) {
+        build_index();
+    }
+}
+
+/**
+ * @brief Finds the first name which is not less than the prefix.
+ *
+ * @param[in] prefix The prefix.
+ *
+ * @return Position in the index.
+ */
+static size_t lower_bound(const char prefix[]) {
+    size_t low = 0;
+    size_t high = INDEX_AMOUNT;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (strcmp(INDEX[middle], prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Generates command names for rl_completion_matches().
+ *
+ * @param[in] text The prefix to complete.
+ * @param[in] state Zero for the first call of completion.
+ *
+ * @return Allocated name, or NULL when there are no more names.
+ */
+static char* generate_command(const char text[], int state) {
+    static size_t position;
+    if (!state) {
+        position = lower_bound(text);
+    }
+    if (position < INDEX_AMOUNT &&
+        !strncmp(INDEX[position], text, strlen(text))) {
+        return strdup(INDEX[position++]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Determine if word of the line is command name.
+ *
+ * @param[in] start Offset of the word in readline buffer.
+ *
+ * @return True for the first word of the line and of each pipeline.
+ */
+static bool is_command_position(int start) {
+    while (start > 0 && strchr(" \t", rl_line_buffer[start - 1])) {
+        --start;
+    }
+    return !start || strchr("|;&(", rl_line_buffer[start - 1]);
+}
+
+/**
+ * @brief Completion function of readline.
+ *
+ * @param[in] text The word to complete.
+ * @param[in] start Offset of the word in readline buffer.
+ * @param[in] end End of the word in readline buffer.
+ *
+ * @return Matches, or NULL to complete file names.
+ */
+static char** complete(const char text[], int start, int end) {
+    (void) end;
+    if (!is_command_position(start) || strchr(text, '/')) {
+        return NULL;
+    }
+    refresh_index();
+    return rl_completion_matches(text, generate_command);
+}
+
+void setup_completion(void) {
+    rl_attempted_completion_function = complete;
+}
@@ -0,0 +1,39 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file completion.h
+ *
+ * @brief Tab completion of command names from PATH and built-in commands.
+ *
+ * @see completion.c
+ */
+
+#ifndef KARASHI_COMPLETION_H
+#define KARASHI_COMPLETION_H
+
+/**
+ * @brief Installs completion function into readline.
+ *
+ * @details Command names are completed from sorted index of executables in
+ * PATH directories and built-in commands. The index is built on the first
+ * completion, and only directories which modification time changed are read
+ * again later. Words with "/" and arguments are completed as file names by
+ * readline.
+ */
+void setup_completion(void);
+
+#endif //KARASHI_COMPLETION_H
@@ -0,0 +1,220 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file events.c
+ *
+ * @brief Single poll() over signalfd, pidfds of children and descriptors
+ * of the caller.
+ */
+
+#define _GNU_SOURCE
+
+#include "events.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+
+#include "child.h"
+#include "utility.h"
+
+#define SIGNALS_BATCH 8 ///< Amount of signals read from signalfd at once.
+
+/**
+ * @brief Signals read from signalfd, keyboard ones go first.
+ */
+static const int SIGNALS[] = {SIGINT, SIGQUIT, SIGTSTP, SIGCONT, SIGCHLD};
+
+/**
+ * @brief Amount of keyboard signals at the start of SIGNALS.
+ */
+static const size_t KEYBOARD_SIGNALS = 4;
+
+/**
+ * @brief Descriptor of signalfd, -1 before init_events().
+ */
+static int SIGNAL_FD = -1;
+
+/**
+ * @brief Signal mask the shell was started with, restored in children.
+ */
+static sigset_t STARTUP_MASK;
+
+/**
+ * @brief Poll set reused between calls, processes own pidfds of it.
+ */
+static struct pollfd* POLLED = NULL;
+
+/**
+ * @brief Processes owning pidfds of POLLED, at the same positions.
+ */
+static struct Process** OWNERS = NULL;
+
+/**
+ * @brief Capacity of POLLED and OWNERS.
+ */
+static size_t POLLED_CAPACITY = 0;
+
+/**
+ * @brief Fills set with signals of the shell.
+ *
+ * @param[out] set The set to fill.
+ * @param[in] amount Amount of the first SIGNALS to add.
+ */
+static void fill_signals(sigset_t* set, size_t amount) {
+    sigemptyset(set);
+    for (size_t i = 0; i < amount; ++i) {
+        sigaddset(set, SIGNALS[i]);
+    }
+}
+
+void init_events(void) {
+    sigset_t mask;
+    fill_signals(&mask, sizeof(SIGNALS) / sizeof(SIGNALS[0]));
+    sigprocmask(SIG_BLOCK, &mask, &STARTUP_MASK);
+
+    SIGNAL_FD = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (SIGNAL_FD < 0) {
+        print_errno();
+        exit(EXIT_FAILURE);
+    }
+}
+
+void detach_events(void) {
+    sigset_t mask;
+    fill_signals(&mask, KEYBOARD_SIGNALS);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+void restore_signals(void) {
+    sigprocmask(SIG_SETMASK, &STARTUP_MASK, NULL);
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void) pid;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Makes poll set big enough.
+ *
+ * @param[in] capacity The required capacity.
+ *
+ * @return False if allocation failed.
+ */
+static bool reserve_polled(size_t capacity) {
+    if (capacity <= POLLED_CAPACITY) {
+        return true;
+    }
+    struct pollfd* polled = realloc(POLLED, capacity * sizeof(*polled));
+    if (!check_alloc(polled, "poll set")) {
+        return false;
+    }
+    POLLED = polled;
+    struct Process** owners = realloc(OWNERS, capacity * sizeof(*owners));
+    if (!check_alloc(owners, "poll set")) {
+        return false;
+    }
+    OWNERS = owners;
+    POLLED_CAPACITY = capacity;
+    return true;
+}
+
+/**
+ * @brief Reads pending signals and handles them.
+ */
+static void read_signals(void) {
+    bool is_child_changed = false;
+    struct signalfd_siginfo infos[SIGNALS_BATCH];
+    ssize_t length;
+    while ((length = read(SIGNAL_FD, infos, sizeof(infos))) > 0) {
+        const size_t amount = (size_t) length / sizeof(infos[0]);
+        for (size_t i = 0; i < amount; ++i) {
+            const int sig = (int) infos[i].ssi_signo;
+            if (sig == SIGCHLD) {
+                is_child_changed = true;
+            } else {
+                forward_signal(sig, infos[i].ssi_code == SI_KERNEL);
+            }
+        }
+    }
+    if (is_child_changed) {
+        update_children();
+    }
+}
+
+int wait_events(struct pollfd fds[], size_t amount) {
+    size_t children = 0;
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        for (size_t j = 0; j < jobs[i]->amount; ++j) {
+            children += jobs[i]->processes[j].pidfd != -1;
+        }
+    }
+    if (!reserve_polled(1 + children + amount)) {
+        return -1;
+    }
+
+    POLLED[0] = (struct pollfd) {SIGNAL_FD, POLLIN, 0};
+    size_t polled = 1;
+    for (size_t i = 0; i < jobs_amount; ++i) {
+        for (size_t j = 0; j < jobs[i]->amount; ++j) {
+            struct Process* process = &jobs[i]->processes[j];
+            if (process->pidfd != -1) {
+                OWNERS[polled] = process;
+                POLLED[polled++] = (struct pollfd) {process->pidfd, POLLIN, 0};
+            }
+        }
+    }
+    for (size_t i = 0; i < amount; ++i) {
+        POLLED[polled + i] = fds[i];
+        POLLED[polled + i].revents = 0;
+    }
+
+    int ready;
+    do {
+        ready = poll(POLLED, polled + amount, -1);
+    } while (ready < 0 && errno == EINTR);
+    if (ready < 0) {
+        print_errno();
+        return -1;
+    }
+
+    int ready_fds = 0;
+    for (size_t i = 0; i < amount; ++i) {
+        fds[i].revents = POLLED[polled + i].revents;
+        ready_fds += fds[i].revents != 0;
+    }
+    for (size_t i = 1; i < polled; ++i) {
+        if (POLLED[i].revents) {
+            reap_process(OWNERS[i]);
+        }
+    }
+    if (POLLED[0].revents) {
+        read_signals();
+    }
+    return ready_fds;
+}
@@ -0,0 +1,84 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file events.h
+ *
+ * @brief Event loop of the shell: signals, exits of children and readiness
+ * of descriptors are waited for by single poll().
+ *
+ * @see events.c
+ */
+
+#ifndef KARASHI_EVENTS_H
+#define KARASHI_EVENTS_H
+
+#include <stddef.h>
+
+#include <poll.h>
+#include <sys/types.h>
+
+/**
+ * @brief Blocks signals handled by the shell and opens signalfd for them.
+ *
+ * @details SIGINT, SIGQUIT, SIGTSTP, SIGCONT and SIGCHLD are never delivered
+ * asynchronously, they are read by wait_events() instead, so no code runs
+ * inside signal handlers. Quits the shell if signalfd cannot be opened.
+ */
+void init_events(void);
+
+/**
+ * @brief Restores default actions of keyboard signals in forked child.
+ *
+ * @details SIGCHLD stays blocked, so the child is still able to wait for its
+ * own children with wait_events().
+ */
+void detach_events(void);
+
+/**
+ * @brief Restores signal mask the shell was started with.
+ *
+ * @details Called in forked child right before exec, so the program does not
+ * inherit blocked signals.
+ */
+void restore_signals(void);
+
+/**
+ * @brief Opens pidfd of the child process.
+ *
+ * @param[in] pid The process id.
+ *
+ * @return The pidfd, or -1 if kernel does not support it. Exit of process
+ * without pidfd is noticed by SIGCHLD.
+ */
+int open_pidfd(pid_t pid);
+
+/**
+ * @brief Waits until a signal arrives, a child process exits or any of the
+ * descriptors is ready, and handles the signals and children.
+ *
+ * @details Exited children are reaped through their pidfds or on SIGCHLD,
+ * which also reports stopped and continued ones. Keyboard signals are passed to
+ * forward_signal().
+ *
+ * @param[in,out] fds Additional descriptors to wait for, revents are set.
+ * @param[in] amount Amount of additional descriptors.
+ *
+ * @return Amount of ready additional descriptors, or -1 on error.
+ */
+int wait_events(struct pollfd fds[], size_t amount);
+
+#endif //KARASHI_EVENTS_H
@@ -20,35 +20,130 @@
  * @brief Analyze AbstractSyntaxTree, handle I/O redirections and pipes.
  */
 
-#include "executor.h"
-
 #define _GNU_SOURCE
 
+#include "executor.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 
+#include "arena.h"
 #include "built-in.h"
 #include "child.h"
+#include "events.h"
+#include "expansion.h"
+#include "hash.h"
+#include "multios.h"
+#include "pipesize.h"
+#include "spawn.h"
+#include "substitution.h"
+#include "timing.h"
+#include "trace.h"
 #include "utility.h"
 
+#define COMMAND_NOT_FOUND 127 ///< Exit status of not found command.
+
+int last_status = EXIT_SUCCESS;
+
+/**
+ * @brief Shared page where forked child stamps time just before exec, NULL
+ * if tracing is off.
+ */
+static uint64_t* exec_stamp = NULL;
+
+/**
+ * @brief Opens redirection files of the command.
+ *
+ * @param[in] command The command to open redirections for.
+ * @param[in,out] fds Standard streams, opened files replace them.
+ *
+ * @return True if all files were opened, otherwise false.
+ */
+static bool open_redirections(const struct Command* command, int fds[]) {
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
+        if (command->redirect[i]) {
+            fds[i] = open(command->redirect[i], REDIRECT_FLAGS | O_CLOEXEC,
+                          REDIRECT_MODE);
+            if (fds[i] < 0) {
+                fds[i] = i;
+                print_errno();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Closes files opened by open_redirections() and pipes of streams.
+ *
+ * @param[in] fds Standard streams of the command.
+ */
+static void close_redirections(const int fds[]) {
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
+        if (fds[i] != i) {
+            close(fds[i]);
+        }
+    }
+}
+
+/**
+ * @brief Runs built-in command or assigns variables of ASSIGNMENT command.
+ *
+ * @param[in] command The command to run.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Exit status of the command.
+ */
+static int run_builtin(const struct Command* command, const int fds[]) {
+    if (command->type == ASSIGNMENT) {
+        return assign_variables(command->assignments) ? EXIT_SUCCESS
+                                                      : EXIT_FAILURE;
+    }
+    return find_builtin(command->name)->handler(
+            (int) command->args_amount - 1, command->args, fds);
+}
+
 /**
- * @brief Executes shell built-in commands whose declared in built-in.h.
+ * @brief Executes shell built-in command inside shell process.
+ *
+ * @details Redirections are passed to the command as file descriptors, so
+ * shell standard streams stay untouched.
  *
  * @param[in] command The command to execute.
+ * @param[in] pipes Pipes to use as stdin, stdout and stderr, equal to the
+ * stream itself if it is not piped, they are closed after execution.
+ *
+ * @return Exit status of the command.
  */
-static void execute_builtin_command(struct Command* command) {
-    if (!strcmp(command->name, CD) && command->args) {
-        if (chdir(command->args[1])) {
-            print_errno();
+static int execute_builtin_command(const struct Command* command,
+                                   const int pipes[]) {
+    int fds[TOTAL_STREAMS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+
+    int status = EXIT_FAILURE;
+    const bool is_ready = open_redirections(command, fds);
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
+        if (pipes[i] != i) {
+            if (fds[i] != i) {
+                close(fds[i]);
+            }
+            fds[i] = pipes[i];
         }
-    } else if (!strcmp(command->name, EXIT)) {
-        exit(EXIT_SUCCESS);
     }
+    if (is_ready) {
+        // Keep shell messages in order with output of the command
+        fflush(stdout);
+        status = run_builtin(command, fds);
+    }
+    close_redirections(fds);
+    return status;
 }
 
 /**
@@ -59,11 +154,9 @@ static void execute_builtin_command(struct Command* command) {
  * @param[in] command The command to execute.
  */
 static void setup_std_streams(const struct Command* command) {
-    for (int i = 0; i < 3; ++i) {
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
         if (command->redirect[i]) {
-            int fd = open(command->redirect[i],
-                          O_RDWR | O_CREAT,
-                          S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+            int fd = open(command->redirect[i], REDIRECT_FLAGS, REDIRECT_MODE);
 
             if (fd < 0 || dup2(fd, i) < 0) {
                 print_errno();
@@ -74,136 +167,790 @@ static void setup_std_streams(const struct Command* command) {
 }
 
 /**
- * @brief Called after fork in child process in execute_external_command().
+ * @brief Called after fork in child process in launch_stage().
  *
- * @details Sets up the child process's standard streams, waits until it's its
- * turn to execute, and then execute.
+ * @details Sets up the child process's standard streams, waits until the
+ * whole pipeline is forked, and then execute. Built-in commands run right in
+ * the child process without exec.
  *
  * @param[in] command The command to execute
- * @param[in] id The id of the process (not pid). This is used to determine
- * execution order during pipe handling.
- * @param[in] write_pipe The file descriptor of the write end of the pipe.
- * @param[in] read_pipe The file descriptor of the read end of the pipe.
+ * @param[in] path The path to the command executable, NULL for built-in.
+ * @param[in] fds Pipes to use as stdin, stdout and stderr, equal to the
+ * stream itself if it is not piped.
+ * @param[in] next_pipe The read end of the pipe for the next command, -1 if
+ * there is no next command.
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
  */
-static void child_process_handler(const struct Command* command, int id,
-                                  int write_pipe, int read_pipe) {
+static void child_process_handler(const struct Command* command,
+                                  const char path[], const int fds[],
+                                  int next_pipe, pid_t pgid) {
+    // Siblings belong to the shell, not to this process
+    detach_jobs();
+    if (pgid != -1) {
+        setpgid(0, pgid);
+    }
+
     setup_std_streams(command);
 
-    if (write_pipe != -1 && dup2(write_pipe, STDOUT_FILENO) == -1) {
-        exit(errno);
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
+        if (fds[i] != i && dup2(fds[i], i) == -1) {
+            exit(errno);
+        }
+    }
+
+    // Wait until all pipeline stages are forked
+    wait_start_gate();
+
+    if (exec_stamp) {
+        *exec_stamp = trace_now();
     }
-    if (read_pipe != -1 && dup2(read_pipe, STDIN_FILENO) == -1) {
-        exit(errno);
+
+    if (command->type != ASSIGNMENT) {
+        export_assignments(command->assignments);
     }
+    if (command->type != EXTERNAL) {
+        // Pipes are closed on exec only, so close them manually
+        close_redirections(fds);
+        if (next_pipe != -1) {
+            close(next_pipe);
+        }
 
-    // Wait until our turn to exec
-    int value = 0;
-    do {
-        sem_getvalue(sem, &value);
-    } while (value != id);
-    sem_wait(sem);
+        const int std_fds[TOTAL_STREAMS] = {
+                STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO
+        };
+        int status = run_builtin(command, std_fds);
+        fflush(stdout);
+        _exit(status);
+    }
 
-    sem_unlink(sem_name);
-    execvp(command->name, command->args);
+    restore_signals();
+    execv(path, command->args);
     abort();
 }
 
 /**
- * @brief Execute sequence of programs whose is stored on drive.
+ * @brief Launches command of pipeline, spawns it when possible and forks
+ * otherwise.
  *
- * @details Algorithm:
- * 1. Create n-1 pipes, when n is amount of commands
- * 2. Create semaphore for synchronization parent and child process
- * 3. Fork n child processes. In each child process setup redirections and pipes
- * 4. Start child process execution
- * 5. Close all pipes in shell process
- * 6. Wait for child process exit
- *
- * @param[in] ast The AbstractSyntaxTree to execute.
- */
-static void execute_external_command(struct AbstractSyntaxTree ast) {
-    // Create n-1 pipes, when n is amount of commands
-    const size_t PIPE_SIZE = ast.amount - 1;
-    int pipes[PIPE_SIZE][2];
-
-    for (size_t i = 0; i < PIPE_SIZE; ++i) {
-        if (pipe2(pipes[i], O_CLOEXEC)) {
-            print_errno();
-            return;
+ * @details Errors are printed to fds[2], so output of parallel commands
+ * collects them too.
+ *
+ * @param[in] command The command to launch.
+ * @param[in] fds Pipes to use as stdin, stdout and stderr, equal to the
+ * stream itself if it is not piped.
+ * @param[in] next_pipe The read end of the next pipe, -1 for none.
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
+ *
+ * @return Pid of the child, 0 if command is not launched, -1 if fork failed.
+ */
+static pid_t launch_stage(const struct Command* command, const int fds[],
+                          int next_pipe, pid_t pgid) {
+    const char* path = NULL;
+    if (command->type == EXTERNAL && !(path = hash_lookup(command->name))) {
+        print_builtin_error(fds, "command not found: %s", command->name);
+        return 0;
+    }
+
+    if (can_spawn(command)) {
+        const pid_t pid = spawn_command(command, path, fds, pgid);
+        if (pid < 0) {
+            return 0;
         }
+        // posix_spawn() returns after exec
+        if (exec_stamp) {
+            *exec_stamp = trace_now();
+        }
+        return pid;
     }
 
-    // Create semaphore for synchronization parent and child process
-    sem = sem_open(sem_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR, 1);
-    if (sem == SEM_FAILED) {
+    const pid_t pid = fork();
+    if (pid < 0) {
         print_errno();
-        return;
+        return -1;
+    } else if (!pid) { // Child process
+        child_process_handler(command, path, fds, next_pipe, pgid);
     }
+    // Set group in both processes, so no one depends on scheduling
+    if (pgid != -1) {
+        setpgid(pid, pgid ? pgid : pid);
+    }
+    return pid;
+}
 
-    // Fork n child processes. In each child process setup redirections and pipes
-    for (size_t i = 0; i < ast.amount; ++i) {
-        sem_post(sem);
-        child_pid[child_amount] = fork();
-        if (child_pid[child_amount] < 0) {
-            print_errno();
-            return;
-        } else if (child_pid[child_amount]) { // Parent process
-            ++child_amount;
-        } else { // Child process
-            int write_pipe = (i == ast.amount - 1) ? -1 : pipes[i][1];
-            int read_pipe = (i == 0) ? -1 : pipes[i - 1][0];
-            child_process_handler(&ast.nodes[i], (int) i + 1,
-                                  write_pipe, read_pipe);
+/**
+ * @brief Launches pump for every output stream of the command, which has
+ * several outputs, and adds pumps to the job.
+ *
+ * @param[in,out] command The command to launch pumps for, its copied streams
+ * are not redirected anymore.
+ * @param[in,out] fds Streams of the command, copied ones are replaced by
+ * pipes to pumps.
+ * @param[in] next_pipe The read end of the next pipe, -1 for none.
+ * @param[in,out] job The job of the pipeline.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool launch_pumps(struct Command* command, int fds[], int next_pipe,
+                         struct Job* job) {
+    for (int i = STDOUT_FILENO; i < TOTAL_STREAMS; ++i) {
+        if (!has_multios(command, i, next_pipe != -1)) {
+            continue;
+        }
+        const int target_pipe = (fds[i] != i) ? fds[i] : -1;
+        // Pump must not hold the rest of pipes shell keeps open
+        const int inherited[] = {
+                (fds[STDIN_FILENO] != STDIN_FILENO) ? fds[STDIN_FILENO] : -1,
+                next_pipe,
+                (i == STDERR_FILENO && fds[STDOUT_FILENO] != STDOUT_FILENO)
+                ? fds[STDOUT_FILENO] : -1
+        };
+        const pid_t pgid = job->is_background ? job->pgid : -1;
+        int write_end;
+        const pid_t pid = launch_pump(command, i, target_pipe, inherited,
+                                      sizeof(inherited) / sizeof(inherited[0]),
+                                      pgid, &write_end);
+        if (pid < 0) {
+            return false;
+        }
+        if (target_pipe != -1) {
+            close(target_pipe);
+        }
+        fds[i] = write_end;
+        command->redirect[i] = NULL;
+        command->multios[i] = NULL;
+
+        if (!add_process(job, pid)) {
+            kill(pid, SIGKILL);
         }
     }
+    return true;
+}
 
-    // Start child process execution
-    sem_wait(sem);
+/**
+ * @brief Counts the most processes pipeline may launch.
+ *
+ * @param[in] pipeline The pipeline to count processes of.
+ *
+ * @return Amount of stages, their pumps and substitutions.
+ */
+static size_t count_processes(const struct Pipeline* pipeline) {
+    // Every stage has at most two pumps
+    size_t amount = pipeline->amount * TOTAL_STREAMS;
+    for (size_t i = 0; i < pipeline->amount; ++i) {
+        amount += count_substitutions(&pipeline->nodes[i]);
+    }
+    return amount;
+}
 
-    // Close all pipes in main kara process
-    for (size_t i = 0; i < PIPE_SIZE; ++i) {
-        if (close(pipes[i][0]) || close(pipes[i][1])) {
-            print_errno();
-            return;
+/**
+ * @brief Determine if any of the first commands is launched by fork().
+ *
+ * @param[in] pipeline The pipeline to check.
+ * @param[in] amount Amount of commands to check.
+ *
+ * @return True if at least one command cannot be spawned.
+ */
+static bool needs_fork(const struct Pipeline* pipeline, size_t amount) {
+    for (size_t i = 0; i < amount; ++i) {
+        if (!can_spawn(&pipeline->nodes[i])) {
+            return true;
         }
     }
+    return false;
+}
+
+/**
+ * @brief Appends text to the description.
+ *
+ * @param[out] description Where to write, NULL to only measure length.
+ * @param[in] length Current length of the description.
+ * @param[in] text The text to append.
+ *
+ * @return New length of the description.
+ */
+static size_t put_text(char description[], size_t length, const char text[]) {
+    const size_t text_length = strlen(text);
+    if (description) {
+        memcpy(description + length, text, text_length);
+    }
+    return length + text_length;
+}
+
+/**
+ * @brief Writes command line of the pipeline.
+ *
+ * @param[in] pipeline The pipeline to describe.
+ * @param[out] description Where to write, NULL to only measure length.
+ * @param[in] length Current length of the description.
+ *
+ * @return New length of the description.
+ */
+static size_t describe_pipeline(const struct Pipeline* pipeline,
+                                char description[], size_t length) {
+    static const char* const REDIRECT_OPERATORS[TOTAL_STREAMS] = {
+            " < ", " > ", " 2> "
+    };
 
-    // Wait for child process exit
-    int status;
-    for (size_t i = 0; i < ast.amount; ++i) {
-        if (waitpid(child_pid[i], &status, 0) < 0) {
+    for (size_t i = 0; i < pipeline->amount; ++i) {
+        const struct Command* command = &pipeline->nodes[i];
+        if (i) {
+            length = put_text(description, length, " | ");
+        }
+        bool is_first = true;
+        for (const struct Assignment* assignment = command->assignments;
+             assignment; assignment = assignment->next) {
+            if (!is_first) {
+                length = put_text(description, length, " ");
+            }
+            length = put_text(description, length, assignment->name);
+            length = put_text(description, length, "=");
+            length = put_text(description, length, assignment->value);
+            is_first = false;
+        }
+        for (size_t j = 0; command->args[j]; ++j) {
+            if (!is_first) {
+                length = put_text(description, length, " ");
+            }
+            length = put_text(description, length, command->args[j]);
+            is_first = false;
+        }
+        for (int j = 0; j < TOTAL_STREAMS; ++j) {
+            if (command->redirect[j]) {
+                length = put_text(description, length,
+                                  REDIRECT_OPERATORS[j]);
+                length = put_text(description, length, command->redirect[j]);
+            }
+            for (const struct Multio* multio = command->multios[j]; multio;
+                 multio = multio->next) {
+                length = put_text(description, length,
+                                  REDIRECT_OPERATORS[j]);
+                length = put_text(description, length, multio->path);
+            }
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Writes command line of the tree node.
+ *
+ * @param[in] node The node to describe.
+ * @param[out] description Where to write, NULL to only measure length.
+ * @param[in] length Current length of the description.
+ *
+ * @return New length of the description.
+ */
+static size_t describe_node(const struct Node* node, char description[],
+                            size_t length) {
+    if (node->type == PIPELINE_NODE) {
+        return describe_pipeline(&node->pipeline, description, length);
+    }
+
+    length = describe_node(node->left, description, length);
+    if (node->type == BACKGROUND_NODE) {
+        return put_text(description, length, " &");
+    }
+
+    const char* operator = " && ";
+    if (node->type == OR_NODE) {
+        operator = " || ";
+    } else if (node->type == SEQUENCE_NODE) {
+        operator = (node->left->type == BACKGROUND_NODE) ? " " : "; ";
+    }
+    length = put_text(description, length, operator);
+    return describe_node(node->right, description, length);
+}
+
+/**
+ * @brief Builds command line of the node shown in jobs list.
+ *
+ * @param[in] node The node to describe.
+ *
+ * @return Allocated string, or NULL if allocation failed.
+ */
+static char* describe(const struct Node* node) {
+    const size_t length = describe_node(node, NULL, 0);
+    char* description = malloc(length + 1);
+    if (!description) {
+        check_alloc(description, "job command line");
+        return NULL;
+    }
+    describe_node(node, description, 0);
+    description[length] = '\0';
+    return description;
+}
+
+/**
+ * @brief Allocates timings of pipeline stages in line arena.
+ *
+ * @param[in] pipeline The timed pipeline.
+ *
+ * @return Stages marked as not run, or NULL if allocation failed.
+ */
+static struct StageTiming* create_stages(const struct Pipeline* pipeline) {
+    struct StageTiming* stages = arena_alloc(&line_arena, pipeline->amount *
+                                                          sizeof(*stages));
+    if (!stages) {
+        return NULL;
+    }
+    for (size_t i = 0; i < pipeline->amount; ++i) {
+        stages[i] = (struct StageTiming) {
+                .name = pipeline->nodes[i].name,
+                .pid = NOT_RUN_PID,
+                .status = COMMAND_NOT_FOUND,
+        };
+    }
+    return stages;
+}
+
+/**
+ * @brief Executes built-in command inside shell process and measures it.
+ *
+ * @param[in] command The command to execute.
+ * @param[in] pipes Pipes to use as stdin, stdout and stderr.
+ * @param[out] stage Timing of the stage, NULL if pipeline is not timed.
+ *
+ * @return Exit status of the command.
+ */
+static int execute_timed_builtin(const struct Command* command,
+                                 const int pipes[],
+                                 struct StageTiming* stage) {
+    if (!stage) {
+        return execute_builtin_command(command, pipes);
+    }
+
+    struct rusage before;
+    struct rusage after;
+    struct timespec started;
+    struct timespec finished;
+    getrusage(RUSAGE_SELF, &before);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    const int status = execute_builtin_command(command, pipes);
+
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    getrusage(RUSAGE_SELF, &after);
+    stage->pid = IN_SHELL_PID;
+    stage->status = status;
+    stage->real = get_elapsed(&started, &finished);
+    stage->usage = subtract_usage(&before, &after);
+    return status;
+}
+
+/**
+ * @brief Collects timings of launched stages from the job and prints them.
+ *
+ * @param[in] pipeline The timed pipeline.
+ * @param[in,out] stages Timings of stages.
+ * @param[in] job The done job, NULL if no process was launched.
+ * @param[in] started Monotonic time of pipeline start.
+ */
+static void report_timing(const struct Pipeline* pipeline,
+                          struct StageTiming stages[], const struct Job* job,
+                          const struct timespec* started) {
+    for (size_t i = 0; job && i < pipeline->amount; ++i) {
+        for (size_t j = 0; stages[i].pid > 0 && j < job->amount; ++j) {
+            const struct Process* process = &job->processes[j];
+            if (process->pid == stages[i].pid) {
+                stages[i].status = get_exit_code(process->status);
+                stages[i].real = get_elapsed(&process->started,
+                                             &process->finished);
+                stages[i].usage = process->usage;
+            }
+        }
+    }
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    fflush(stdout);
+    print_timing(STDERR_FILENO, pipeline->time_format, stages,
+                 pipeline->amount, get_elapsed(started, &finished));
+}
+
+/**
+ * @brief Records fork to exec and exec to exit spans of every process.
+ *
+ * @param[in] job Finished foreground job.
+ * @param[in] stamps Launch and exec stamps indexed by process.
+ * @param[in] amount Amount of stages stamps are created for.
+ */
+static void trace_processes(const struct Job* job, const uint64_t stamps[],
+                            size_t amount) {
+    for (size_t i = 0; i < job->amount; ++i) {
+        // Pumps are not stamped
+        if (!stamps[i]) {
+            continue;
+        }
+        const struct Process* process = &job->processes[i];
+        const uint64_t exec = stamps[amount + i];
+        trace_span("fork-exec", "child", stamps[i], exec, process->pid,
+                   job->command);
+        if (process->state == DONE) {
+            trace_span("exec-exit", "child", exec,
+                       trace_time(&process->finished), process->pid,
+                       job->command);
+        }
+    }
+}
+
+/**
+ * @brief Execute sequence of commands piped to each other.
+ *
+ * @details Algorithm:
+ * 1. Expand variables in words of commands, the tree itself is not changed
+ * 2. Create pipes just in time, so shell holds at most the read end of the
+ * previous pipe and both ends of the next one, and children inherit only
+ * their own pipes. Capacity of pipes is set by "pipesize" keyword or
+ * KARA_PIPE_SIZE
+ * 3. Open start gate for synchronization parent and forked child processes
+ * 4. Add job to the table, children are reaped only inside wait_events(), so
+ * no child is reaped before it is added to the job
+ * 5. Resolve command paths via hash table and launch child processes with
+ * posix_spawn() when spawn backend is selected, otherwise fork them and setup
+ * redirections and pipes in child. Built-in commands are always forked and
+ * not executed, except the last one of foreground pipeline without
+ * assignments in front of it. Processes of background job are placed into
+ * their own process group
+ * 6. Release start gate, so all forked children exec at once
+ * 7. Close pipe ends of every command in shell process right after it is
+ * launched
+ * 8. Execute the last command inside shell process if it is built-in or
+ * assignment, so it is able to change shell state
+ * 9. Wait until foreground job is done or stopped by handling events of the
+ * loop, background job is reaped whenever the loop runs
+ * 10. Report resource usage of every stage if pipeline is timed
+ * 11. Record spawn, wait and per-process spans if tracing is enabled
+ *
+ * @param[in] node PIPELINE_NODE to execute.
+ * @param[in] is_background True to run pipeline as background job.
+ *
+ * @return Exit status of the last command, zero for background job.
+ */
+static int execute_pipeline(const struct Node* node, bool is_background) {
+    struct Pipeline expanded;
+    const struct Pipeline* pipeline = expand_pipeline(&node->pipeline,
+                                                      &expanded);
+    if (!pipeline) {
+        return EXIT_FAILURE;
+    }
+    const size_t last = pipeline->amount - 1;
+    const struct Command* last_command = &pipeline->nodes[last];
+    // Built-in command with assignments in front of it runs in a child, which
+    // environment gets them
+    const bool is_last_builtin = (last_command->type == ASSIGNMENT ||
+                                  (last_command->type == BUILT_IN &&
+                                   !last_command->assignments)) &&
+                                 !is_background &&
+                                 !has_multios(last_command, STDOUT_FILENO,
+                                              false) &&
+                                 !has_multios(last_command, STDERR_FILENO,
+                                              false);
+    const size_t launch_amount = is_last_builtin ? last : pipeline->amount;
+
+    // Open start gate for synchronization parent and forked child processes
+    if (needs_fork(pipeline, launch_amount) && !open_start_gate()) {
+        return EXIT_FAILURE;
+    }
+
+    // Timed pipeline measures every stage
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    struct StageTiming* stages = NULL;
+    if (pipeline->time_format != NO_TIME) {
+        stages = create_stages(pipeline);
+    }
+
+    // Add job to the table, children are reaped only by the event loop, so
+    // no one is reaped until it is added to the job
+    struct Job* job = create_job(describe(node), is_background);
+    if (!job) {
+        release_start_gate();
+        return EXIT_FAILURE;
+    }
+
+    // Launch and exec stamps are indexed by process, not by stage
+    const size_t process_capacity = count_processes(pipeline);
+    uint64_t* stamps = NULL;
+    uint64_t spawn_start = 0;
+    if (is_tracing) {
+        stamps = create_trace_stamps(process_capacity);
+        spawn_start = trace_now();
+    }
+
+    // Keep shell messages in order with output of child processes
+    fflush(stdout);
+
+    // Launch child processes, pipe to the next command is created just before
+    // launch and shell keeps only its read end afterwards
+    const size_t pipe_size = last ? get_pipe_size(pipeline->pipe_size) : 0;
+    pid_t last_pid = -1;
+    int read_pipe = -1;
+    size_t i = 0;
+    for (; i < launch_amount; ++i) {
+        struct Command stage = pipeline->nodes[i];
+        int fds[TOTAL_STREAMS] = {
+                (read_pipe == -1) ? STDIN_FILENO : read_pipe,
+                STDOUT_FILENO, STDERR_FILENO
+        };
+        read_pipe = -1;
+
+        // Subshells of substitutions are forked before the next pipe exists,
+        // so they do not hold it
+        const size_t substitutions = count_substitutions(&stage);
+        int* ends = NULL;
+        if (substitutions &&
+            !(ends = launch_substitutions(&stage, fds, -1, job))) {
+            close_redirections(fds);
+            break;
+        }
+
+        int next_pipe[2] = {-1, -1};
+        if (i != last && pipe2(next_pipe, O_CLOEXEC)) {
             print_errno();
-            return;
+            close_substitutions(ends, substitutions);
+            close_redirections(fds);
+            break;
+        }
+        if (i != last) {
+            resize_pipe(next_pipe[1], pipe_size);
+            // Output substituted by redirection is not piped, like in bash
+            if (fds[STDOUT_FILENO] == STDOUT_FILENO) {
+                fds[STDOUT_FILENO] = next_pipe[1];
+            } else {
+                close(next_pipe[1]);
+            }
+        }
+        read_pipe = next_pipe[0];
+
+        // Streams with several outputs are written to pumps
+        if (!launch_pumps(&stage, fds, next_pipe[0], job)) {
+            close_substitutions(ends, substitutions);
+            close_redirections(fds);
+            break;
+        }
+
+        const pid_t pgid = is_background ? job->pgid : -1;
+        if (stamps) {
+            stamps[job->amount] = trace_now();
+            exec_stamp = &stamps[process_capacity + job->amount];
+        }
+        const pid_t pid = launch_stage(&stage, fds, next_pipe[0], pgid);
+
+        close_substitutions(ends, substitutions);
+        close_redirections(fds);
+
+        if (pid < 0) {
+            break;
+        } else if (!pid) {
+            continue;
+        }
+        if (!add_process(job, pid)) {
+            kill(pid, SIGKILL);
+            continue;
+        }
+        if (stages) {
+            stages[i].pid = pid;
+        }
+        if (i == last) {
+            last_pid = pid;
+        }
+    }
+    const bool is_launched = (i == launch_amount);
+
+    // The last pipe is input of the last built-in command, which substitutions
+    // are part of the job too
+    struct Command builtin = *last_command;
+    int builtin_fds[TOTAL_STREAMS] = {
+            (read_pipe == -1) ? STDIN_FILENO : read_pipe,
+            STDOUT_FILENO, STDERR_FILENO
+    };
+    const size_t builtin_substitutions = is_last_builtin ?
+                                         count_substitutions(&builtin) : 0;
+    int* builtin_ends = NULL;
+    bool is_builtin_ready = is_last_builtin && is_launched;
+    if (is_builtin_ready && builtin_substitutions) {
+        builtin_ends = launch_substitutions(&builtin, builtin_fds, -1, job);
+        is_builtin_ready = builtin_ends != NULL;
+    }
+    if (!is_builtin_ready) {
+        close_redirections(builtin_fds);
+    }
+
+    exec_stamp = NULL;
+
+    // Release start gate, so all forked children exec at once
+    release_start_gate();
+    if (is_tracing) {
+        trace_span("spawn", "shell", spawn_start, trace_now(), 0, job->command);
+    }
+
+    // Job without processes is not shown to job control built-in commands
+    if (!job->amount) {
+        remove_job(job);
+        job = NULL;
+    }
+
+    // Execute the last built-in command inside shell process
+    int builtin_status = EXIT_FAILURE;
+    if (is_builtin_ready) {
+        const uint64_t start = is_tracing ? trace_now() : 0;
+        builtin_status = execute_timed_builtin(&builtin, builtin_fds,
+                                               stages ? &stages[last] : NULL);
+        close_substitutions(builtin_ends, builtin_substitutions);
+        if (is_tracing) {
+            trace_span("builtin", "shell", start, trace_now(), 0,
+                       pipeline->nodes[last].name);
         }
-        child_pid[i] = 0;
+    }
+
+    if (job && is_background) {
+        if (is_interactive()) {
+            printf("[%zu] %d\n", job->id,
+                   (int) job->processes[job->amount - 1].pid);
+        }
+        free_trace_stamps(stamps, process_capacity);
+        return EXIT_SUCCESS;
+    }
+
+    // Wait until foreground job is done or stopped
+    const uint64_t wait_start = is_tracing ? trace_now() : 0;
+    const int status = job ? wait_foreground_job(job) : 0;
+    const bool is_stopped = job && job->is_background;
+    if (is_tracing && job) {
+        trace_span("wait", "shell", wait_start, trace_now(), 0, job->command);
+        if (stamps) {
+            trace_processes(job, stamps, process_capacity);
+        }
+    }
+    free_trace_stamps(stamps, process_capacity);
+    if (stages && !is_stopped) {
+        report_timing(pipeline, stages, job, &started);
+    }
+    if (job && !is_stopped) {
+        remove_job(job);
+    }
+
+    if (is_last_builtin) {
+        return builtin_status;
+    } else if (last_pid == -1) {
+        return COMMAND_NOT_FOUND;
+    } else if (is_stopped) {
+        return get_exit_code(status);
     }
     if (!WIFEXITED(status)) {
         printf(BOLD_RED "kara: failed to run %s" RESET "\n",
-               ast.nodes[ast.amount - 1].name);
+               pipeline->nodes[last].name);
 
     } else if (status) {
         printf(BOLD_RED "%s exit status %d" RESET "\n",
-               ast.nodes[ast.amount - 1].name, status);
+               pipeline->nodes[last].name, WEXITSTATUS(status));
     }
+    return get_exit_code(status);
 }
 
-void execute(struct AbstractSyntaxTree ast) {
-    if (!ast.nodes) {
-        return;
+/**
+ * @brief Runs and-or chain as background job in forked subshell.
+ *
+ * @details Single pipeline needs no subshell and is launched directly,
+ * unless it is timed and subshell has to wait for it.
+ *
+ * @param[in] node The node to run.
+ *
+ * @return Zero on success, otherwise exit status of failure.
+ */
+static int execute_background(const struct Node* node) {
+    if (node->type == PIPELINE_NODE && node->pipeline.time_format == NO_TIME) {
+        return execute_pipeline(node, true);
     }
-    struct Command* command = &ast.nodes[0];
-    switch (command->type) {
-        case UNKNOWN:
-            break;
 
-        case BUILT_IN:
-            execute_builtin_command(command);
-            break;
+    struct Job* job = create_job(describe(node), true);
+    if (!job) {
+        return EXIT_FAILURE;
+    }
+    // Keep shell messages in order with output of the subshell
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        print_errno();
+        remove_job(job);
+        return EXIT_FAILURE;
+    } else if (!pid) { // Subshell
+        detach_jobs();
+        detach_trace();
+        setpgid(0, 0);
+        const int status = execute_node(node);
+        fflush(stdout);
+        flush_trace();
+        _exit(status);
+    }
+    setpgid(pid, pid);
+    if (!add_process(job, pid)) {
+        kill(pid, SIGKILL);
+    }
 
-        case EXTERNAL:
-            execute_external_command(ast);
-            clear_child();
+    if (job->amount && is_interactive()) {
+        printf("[%zu] %d\n", job->id, (int) pid);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Determine if list must stop after the status.
+ *
+ * @param[in] status Exit status of the last pipeline.
+ *
+ * @return True if the pipeline was interrupted with ^C.
+ */
+static bool is_interrupted_status(int status) {
+    return status == 128 + SIGINT;
+}
+
+int execute_node(const struct Node* node) {
+    int status = EXIT_SUCCESS;
+    switch (node->type) {
+        case PIPELINE_NODE:
+            status = execute_pipeline(node, false);
+            break;
+        case SEQUENCE_NODE:
+            status = execute_node(node->left);
+            if (!is_interrupted_status(status)) {
+                status = execute_node(node->right);
+            }
+            break;
+        case AND_NODE:
+            status = execute_node(node->left);
+            if (!status) {
+                status = execute_node(node->right);
+            }
+            break;
+        case OR_NODE:
+            status = execute_node(node->left);
+            if (status && !is_interrupted_status(status)) {
+                status = execute_node(node->right);
+            }
+            break;
+        case BACKGROUND_NODE:
+            status = execute_background(node->left);
             break;
     }
+    last_status = status;
+    return status;
+}
+
+pid_t launch_command(const struct Command* command, const int fds[],
+                     pid_t pgid) {
+    const pid_t pid = launch_stage(command, fds, -1, pgid);
+    return pid ? pid : -1;
+}
+
+void execute(struct AbstractSyntaxTree ast) {
+    if (!ast.root) {
+        return;
+    }
+    execute_node(ast.root);
+    release_start_gate();
     free_ast(ast);
 }
@@ -25,8 +25,44 @@
 #ifndef KARASHI_EXECUTOR_H
 #define KARASHI_EXECUTOR_H
 
+#include <sys/types.h>
+
 #include "parser.h"
 
+extern int last_status; ///< Exit status of the last executed pipeline.
+
+/**
+ * @brief Executes node of AbstractSyntaxTree.
+ *
+ * @details Walks the tree: lists run left to right, and-or chains skip
+ * pipelines according to exit status, background node runs without waiting.
+ * The list stops if a pipeline is interrupted with ^C.
+ *
+ * @param[in] node The node to execute.
+ *
+ * @return Exit status of the last executed pipeline.
+ */
+int execute_node(const struct Node* node);
+
+/**
+ * @brief Launches single command without waiting for it.
+ *
+ * @details Command is launched the same way as a pipeline stage: path is
+ * resolved via hash table, the command is spawned when possible and forked
+ * otherwise, built-in command runs in forked child. Caller is responsible
+ * for adding the process to a job.
+ *
+ * @param[in] command The command to launch.
+ * @param[in] fds File descriptors to use as stdin, stdout and stderr, equal
+ * to stream number if stream is inherited. Errors are printed to fds[2].
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
+ *
+ * @return Process id of the new child process, or -1 on failure.
+ */
+pid_t launch_command(const struct Command* command, const int fds[],
+                     pid_t pgid);
+
 /**
  * @brief Executes AbstractSyntaxTree.
  *
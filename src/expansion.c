@@ -0,0 +1,656 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file expansion.c
+ *
+ * @brief Two-pass expansion of variables in raw words of the line.
+ */
+
+#include "expansion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "arena.h"
+#include "built-in.h"
+#include "executor.h"
+#include "glob.h"
+#include "utility.h"
+#include "variables.h"
+
+/**
+ * @brief Destination of expanded word.
+ */
+struct Output {
+    char* data;       ///< Where to write, NULL to only measure length.
+    size_t length;    ///< Current length of the output.
+    bool is_pattern;  ///< True to escape quoted special characters of glob.
+    bool is_glob;     ///< True if unquoted "*", "?" or "[...]" was written.
+    bool is_bracket;  ///< True if unquoted "[" was written.
+};
+
+/**
+ * @brief Appends text to the output.
+ *
+ * @param[in,out] output The output.
+ * @param[in] text The text to append, not necessarily terminated.
+ * @param[in] length Length of the text.
+ */
+static void put(struct Output* output, const char text[], size_t length) {
+    if (output->data) {
+        memcpy(output->data + output->length, text, length);
+    }
+    output->length += length;
+}
+
+/**
+ * @brief Appends text, which is not special for glob, to the output.
+ *
+ * @details Special characters are escaped with backslash in glob pattern.
+ *
+ * @param[in,out] output The output.
+ * @param[in] text The text to append, not necessarily terminated.
+ * @param[in] length Length of the text.
+ */
+static void put_literal(struct Output* output, const char text[],
+                        size_t length) {
+    if (!output->is_pattern) {
+        put(output, text, length);
+        return;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (strchr("*?[]\\", text[i])) {
+            put(output, "\\", 1);
+        }
+        put(output, &text[i], 1);
+    }
+}
+
+/**
+ * @brief Appends unquoted character of the word to the output.
+ *
+ * @param[in,out] output The output.
+ * @param[in] c The character.
+ */
+static void put_unquoted(struct Output* output, char c) {
+    if (c == '*' || c == '?' || (c == ']' && output->is_bracket)) {
+        output->is_glob = true;
+    } else if (c == '[') {
+        output->is_bracket = true;
+    }
+    put(output, &c, 1);
+}
+
+/**
+ * @brief Determine if character starts parameter after "$".
+ *
+ * @param[in] c The character after "$".
+ *
+ * @return True for first character of name, "{", "?" and "$".
+ */
+static bool is_parameter_start(char c) {
+    return c == '{' || c == '?' || c == '$' || c == '_' ||
+           isalpha((unsigned char) c);
+}
+
+/**
+ * @brief Measures variable name at the beginning of the text.
+ *
+ * @param[in] text The text, not necessarily terminated.
+ * @param[in] length Length of the text.
+ *
+ * @return Length of the name, zero if text does not start with a name.
+ */
+static size_t scan_name(const char text[], size_t length) {
+    if (!length || isdigit((unsigned char) text[0])) {
+        return 0;
+    }
+    size_t i = 0;
+    while (i < length && (text[i] == '_' || isalnum((unsigned char) text[i]))) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * @brief Determine if "~" at the beginning of the word is expanded.
+ *
+ * @param[in] word The raw word, not necessarily terminated.
+ * @param[in] length Length of the word.
+ *
+ * @return True for "~" alone and "~/...".
+ */
+static bool is_tilde(const char word[], size_t length) {
+    return length && word[0] == '~' && (length == 1 || word[1] == '/');
+}
+
+bool needs_expansion(const char word[], size_t length) {
+    char quote = '\0';
+    bool is_bracket = false;
+    for (size_t i = 0; i < length; ++i) {
+        const char c = word[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = '\0';
+            }
+        } else if (c == '\\') {
+            ++i;
+        } else if (c == '"') {
+            quote = quote ? '\0' : '"';
+        } else if (c == '\'' && !quote) {
+            quote = c;
+        } else if (c == '$' && i + 1 < length &&
+                   is_parameter_start(word[i + 1])) {
+            return true;
+        } else if (!quote && (c == '*' || c == '?' ||
+                              (c == ']' && is_bracket))) {
+            return true;
+        }
+        is_bracket |= !quote && c == '[';
+    }
+    return is_tilde(word, length);
+}
+
+bool is_assignment(const char word[], size_t length) {
+    const size_t name_length = scan_name(word, length);
+    return name_length && name_length < length && word[name_length] == '=';
+}
+
+size_t find_brace(const char raw[], size_t length, size_t start) {
+    size_t depth = 1;
+    for (size_t i = start; i < length; ++i) {
+        if (raw[i] == '\\') {
+            ++i;
+        } else if (raw[i] == '$' && i + 1 < length && raw[i + 1] == '{') {
+            ++depth;
+            ++i;
+        } else if (raw[i] == '}' && !--depth) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static bool expand(const char raw[], size_t length, char quote,
+                   struct Output* output);
+
+/**
+ * @brief Appends value of variable to the output.
+ *
+ * @param[in,out] output The output.
+ * @param[in] value Value of the variable, NULL if it is not set.
+ */
+static void put_value(struct Output* output, const char value[]) {
+    if (value) {
+        put_literal(output, value, strlen(value));
+    }
+}
+
+/**
+ * @brief Expands parameter starting with "$".
+ *
+ * @param[in] raw The raw text.
+ * @param[in] length Length of the text.
+ * @param[in,out] index Index of "$", set to the last character of parameter.
+ * @param[in] quote Quote the parameter is inside of, '\0' for none.
+ * @param[in,out] output The output.
+ *
+ * @return False for malformed "${...}", otherwise true.
+ */
+static bool expand_parameter(const char raw[], size_t length, size_t* index,
+                             char quote, struct Output* output) {
+    const char next = raw[*index + 1];
+    if (next == '?' || next == '$') {
+        char number[24];
+        const int number_length = snprintf(
+                number, sizeof(number), "%d",
+                (next == '?') ? last_status : (int) shell_pid);
+        put_literal(output, number, (size_t) number_length);
+        *index += 1;
+        return true;
+    }
+
+    if (next != '{') {
+        const size_t name_length = scan_name(raw + *index + 1,
+                                             length - *index - 1);
+        put_value(output, get_variable(raw + *index + 1, name_length));
+        *index += name_length;
+        return true;
+    }
+
+    const size_t start = *index + 2;
+    const size_t close = find_brace(raw, length, start);
+    const size_t name_length = scan_name(raw + start, close - start);
+    if (close == length || !name_length) {
+        return false;
+    }
+    const size_t rest = start + name_length;
+    const char* value = get_variable(raw + start, name_length);
+    if (rest == close) {
+        put_value(output, value);
+    } else if (close - rest >= 2 && raw[rest] == ':' && raw[rest + 1] == '-') {
+        // Default word is expanded only when it is used
+        if (value && *value) {
+            put_value(output, value);
+        } else if (!expand(raw + rest + 2, close - rest - 2, quote, output)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    *index = close;
+    return true;
+}
+
+/**
+ * @brief Expands parameters and removes quotes of the raw text.
+ *
+ * @param[in] raw The raw text.
+ * @param[in] length Length of the text.
+ * @param[in] quote Quote the text starts inside of, '\0' for none.
+ * @param[in,out] output The output.
+ *
+ * @return False for malformed "${...}", otherwise true.
+ */
+static bool expand(const char raw[], size_t length, char quote,
+                   struct Output* output) {
+    size_t i = 0;
+    if (!quote && is_tilde(raw, length)) {
+        const char* home = get_variable("HOME", strlen("HOME"));
+        if (home) {
+            put_value(output, home);
+            i = 1;
+        }
+    }
+
+    for (; i < length; ++i) {
+        const char c = raw[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = '\0';
+            } else {
+                put_literal(output, &c, 1);
+            }
+        } else if (c == '\\' && i + 1 < length &&
+                   (!quote || strchr("\"\\$`", raw[i + 1]))) {
+            put_literal(output, &raw[++i], 1);
+        } else if (c == '"') {
+            quote = quote ? '\0' : '"';
+        } else if (c == '\'' && !quote) {
+            quote = c;
+        } else if (c == '$' && i + 1 < length &&
+                   is_parameter_start(raw[i + 1])) {
+            if (!expand_parameter(raw, length, &i, quote, output)) {
+                return false;
+            }
+        } else if (quote) {
+            put_literal(output, &c, 1);
+        } else {
+            put_unquoted(output, c);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Writes measured expansion into line arena.
+ *
+ * @param[in] raw The raw word.
+ * @param[in] length Length of the raw word.
+ * @param[in,out] output The output of the measuring pass.
+ *
+ * @return Expanded word, or NULL if allocation failed.
+ */
+static char* write_word(const char raw[], size_t length,
+                        struct Output* output) {
+    output->data = arena_alloc(&line_arena, output->length + 1);
+    if (!output->data) {
+        return NULL;
+    }
+    output->length = 0;
+    expand(raw, length, '\0', output);
+    output->data[output->length] = '\0';
+    return output->data;
+}
+
+/**
+ * @brief Measures expansion of the raw word, prints error if it is invalid.
+ *
+ * @param[in] raw The raw word.
+ * @param[in] length Length of the raw word.
+ * @param[out] output The output to measure.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool measure_word(const char raw[], size_t length,
+                         struct Output* output) {
+    if (!expand(raw, length, '\0', output)) {
+        printf(BOLD_RED "kara: bad substitution: %s" RESET "\n", raw);
+        return false;
+    }
+    return true;
+}
+
+char* expand_word(const char raw[]) {
+    const size_t length = strlen(raw);
+    struct Output output = {NULL, 0, false, false, false};
+    if (!measure_word(raw, length, &output)) {
+        return NULL;
+    }
+    return write_word(raw, length, &output);
+}
+
+/**
+ * @brief Result of expansion of single word.
+ */
+struct Field {
+    char* word;    ///< The word, if it is not replaced by paths.
+    char** words;  ///< Words of the field.
+    size_t amount; ///< Amount of words.
+};
+
+/**
+ * @brief Expands raw word, replacing glob pattern by matching paths.
+ *
+ * @details Pattern, which matches nothing, is left as is.
+ *
+ * @param[in] raw The raw word.
+ * @param[out] field The result.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool expand_field(const char raw[], struct Field* field) {
+    const size_t length = strlen(raw);
+    struct Output output = {NULL, 0, false, false, false};
+    if (!measure_word(raw, length, &output)) {
+        return false;
+    }
+
+    if (output.is_glob) {
+        struct Output pattern = {NULL, 0, true, false, false};
+        expand(raw, length, '\0', &pattern);
+        const char* text = write_word(raw, length, &pattern);
+        if (!text || !glob_pattern(text, &field->words, &field->amount)) {
+            return false;
+        }
+        if (field->amount) {
+            return true;
+        }
+    }
+
+    field->word = write_word(raw, length, &output);
+    field->words = &field->word;
+    field->amount = 1;
+    return field->word != NULL;
+}
+
+/**
+ * @brief Determine if command has anything to expand before launch.
+ *
+ * @details Assignments of ASSIGNMENT command are expanded one by one when
+ * they are assigned.
+ *
+ * @param[in] command The command to check.
+ *
+ * @return True if command has expansions or expandable assignments.
+ */
+static bool has_expansions(const struct Command* command) {
+    if (command->expansions) {
+        return true;
+    }
+    if (command->type == ASSIGNMENT) {
+        return false;
+    }
+    for (const struct Assignment* assignment = command->assignments;
+         assignment; assignment = assignment->next) {
+        if (assignment->is_expandable) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Replaces list of additional outputs with its copy.
+ *
+ * @param[in,out] multios The list to copy.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool copy_multios(struct Multio** multios) {
+    for (; *multios; multios = &(*multios)->next) {
+        struct Multio* copy = arena_alloc(&line_arena, sizeof(struct Multio));
+        if (!copy) {
+            return false;
+        }
+        *copy = **multios;
+        *multios = copy;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds redirection of the command to expand.
+ *
+ * @param[in,out] command The command.
+ * @param[in] expansion The expansion of the path.
+ *
+ * @return Pointer to the path.
+ */
+static char** find_path(struct Command* command,
+                        const struct Expansion* expansion) {
+    if (!expansion->index) {
+        return &command->redirect[expansion->std_stream];
+    }
+    struct Multio* multio = command->multios[expansion->std_stream];
+    for (size_t i = 1; i < expansion->index; ++i) {
+        multio = multio->next;
+    }
+    return &multio->path;
+}
+
+/**
+ * @brief Expands arguments of copied command.
+ *
+ * @details Arguments are copied into a new array, since glob pattern may
+ * become several arguments. Substituted arguments are moved together with
+ * the words in front of them.
+ *
+ * @param[in,out] command The copy of the command.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool expand_args(struct Command* command) {
+    const size_t amount = command->args_amount;
+    struct Field* fields = arena_alloc(&line_arena, amount * sizeof(*fields));
+    if (!fields) {
+        return false;
+    }
+    for (size_t i = 0; i < amount; ++i) {
+        fields[i] = (struct Field) {command->args[i], &fields[i].word, 1};
+    }
+
+    size_t total = amount;
+    for (const struct Expansion* expansion = command->expansions; expansion;
+         expansion = expansion->next) {
+        if (expansion->std_stream != -1) {
+            continue;
+        }
+        struct Field* field = &fields[expansion->index];
+        if (!expand_field(field->word, field)) {
+            return false;
+        }
+        total += field->amount - 1;
+    }
+
+    char** args = arena_alloc(&line_arena, total * sizeof(char*));
+    size_t* positions = arena_alloc(&line_arena, amount * sizeof(size_t));
+    if (!args || !positions) {
+        return false;
+    }
+    size_t position = 0;
+    for (size_t i = 0; i < amount; ++i) {
+        positions[i] = position;
+        memcpy(args + position, fields[i].words,
+               fields[i].amount * sizeof(char*));
+        position += fields[i].amount;
+    }
+    command->args = args;
+    command->args_amount = total;
+    if (total == amount) {
+        return true;
+    }
+
+    for (struct Substitution** link = &command->substitutions; *link;
+         link = &(*link)->next) {
+        struct Substitution* copy = arena_alloc(&line_arena,
+                                                sizeof(struct Substitution));
+        if (!copy) {
+            return false;
+        }
+        *copy = **link;
+        if (copy->std_stream == -1) {
+            copy->arg = positions[copy->arg];
+        }
+        *link = copy;
+    }
+    return true;
+}
+
+/**
+ * @brief Expands redirections of copied command.
+ *
+ * @details Pattern must match a single path.
+ *
+ * @param[in,out] command The copy of the command.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool expand_redirections(struct Command* command) {
+    for (int i = 0; i < TOTAL_STREAMS; ++i) {
+        if (!copy_multios(&command->multios[i])) {
+            return false;
+        }
+    }
+    for (const struct Expansion* expansion = command->expansions; expansion;
+         expansion = expansion->next) {
+        if (expansion->std_stream == -1) {
+            continue;
+        }
+        char** path = find_path(command, expansion);
+        struct Field field;
+        if (!expand_field(*path, &field)) {
+            return false;
+        } else if (field.amount != 1) {
+            printf(BOLD_RED "kara: ambiguous redirect: %s" RESET "\n", *path);
+            return false;
+        }
+        *path = field.words[0];
+    }
+    return true;
+}
+
+/**
+ * @brief Expands words and assignments of copied command.
+ *
+ * @details Arrays and lists shared with the tree are copied before they are
+ * changed.
+ *
+ * @param[in,out] command The copy of the command.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool expand_command(struct Command* command) {
+    if (command->expansions &&
+        (!expand_args(command) || !expand_redirections(command))) {
+        return false;
+    }
+    if (command->expansions && command->type != ASSIGNMENT) {
+        command->name = command->args[0];
+        command->type = find_builtin(command->name) ? BUILT_IN : EXTERNAL;
+    }
+    if (command->type == ASSIGNMENT) {
+        return true;
+    }
+
+    for (struct Assignment** link = &command->assignments; *link;
+         link = &(*link)->next) {
+        struct Assignment* copy = arena_alloc(&line_arena,
+                                              sizeof(struct Assignment));
+        if (!copy) {
+            return false;
+        }
+        *copy = **link;
+        if (copy->is_expandable && !(copy->value = expand_word(copy->value))) {
+            return false;
+        }
+        copy->is_expandable = false;
+        *link = copy;
+    }
+    return true;
+}
+
+const struct Pipeline* expand_pipeline(const struct Pipeline* pipeline,
+                                       struct Pipeline* expanded) {
+    size_t i = 0;
+    while (i < pipeline->amount && !has_expansions(&pipeline->nodes[i])) {
+        ++i;
+    }
+    if (i == pipeline->amount) {
+        return pipeline;
+    }
+
+    *expanded = *pipeline;
+    expanded->nodes = arena_alloc(&line_arena,
+                                  pipeline->amount * sizeof(struct Command));
+    if (!expanded->nodes) {
+        return NULL;
+    }
+    memcpy(expanded->nodes, pipeline->nodes,
+           pipeline->amount * sizeof(struct Command));
+    // Every directory is read once for all patterns of the pipeline
+    set_glob_cache(true);
+    for (; i < pipeline->amount; ++i) {
+        if (has_expansions(&expanded->nodes[i]) &&
+            !expand_command(&expanded->nodes[i])) {
+            break;
+        }
+    }
+    set_glob_cache(false);
+    return (i == pipeline->amount) ? expanded : NULL;
+}
+
+bool assign_variables(const struct Assignment* assignments) {
+    for (; assignments; assignments = assignments->next) {
+        const char* value = assignments->value;
+        if (assignments->is_expandable && !(value = expand_word(value))) {
+            return false;
+        }
+        if (!set_variable(assignments->name, value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void export_assignments(const struct Assignment* assignments) {
+    for (; assignments; assignments = assignments->next) {
+        setenv(assignments->name, assignments->value, 1);
+    }
+}
@@ -0,0 +1,126 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file expansion.h
+ *
+ * @brief Expansion of "$NAME", "${NAME}", "${NAME:-default}", "$?", "$$"
+ * and leading "~" anywhere in a word, and of glob patterns.
+ *
+ * @see expansion.c
+ */
+
+#ifndef KARASHI_EXPANSION_H
+#define KARASHI_EXPANSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parser.h"
+
+/**
+ * @brief Determine if raw word has anything to expand.
+ *
+ * @details Called by scanner before quotes are removed, "$" in single quotes
+ * or escaped with backslash is not expanded, as well as "$" which is not
+ * followed by a name, "{", "?" or "$". Unquoted "*", "?" and "[...]" are
+ * glob patterns.
+ *
+ * @param[in] word The raw word, not necessarily terminated.
+ * @param[in] length Length of the word.
+ *
+ * @return True if the word must keep its quotes until expansion.
+ */
+bool needs_expansion(const char word[], size_t length);
+
+/**
+ * @brief Determine if raw word is variable assignment.
+ *
+ * @param[in] word The raw word, not necessarily terminated.
+ * @param[in] length Length of the word.
+ *
+ * @return True if word starts with unquoted "NAME=".
+ */
+bool is_assignment(const char word[], size_t length);
+
+/**
+ * @brief Finds "}" closing "${".
+ *
+ * @details Nested "${" are skipped, so scanner keeps the whole parameter in
+ * one word, spaces of its default value included.
+ *
+ * @param[in] raw The raw text.
+ * @param[in] length Length of the text.
+ * @param[in] start Index just after "${".
+ *
+ * @return Index of the closing brace, or length if it is missing.
+ */
+size_t find_brace(const char raw[], size_t length, size_t start);
+
+/**
+ * @brief Expands variables and removes quotes of the raw word.
+ *
+ * @details Expanded length is measured in the first pass, then the word is
+ * written into line_arena in the second one. Words are not split, result of
+ * expansion is always a single argument. Error is printed for malformed
+ * "${...}".
+ *
+ * @param[in] raw The raw word.
+ *
+ * @return Expanded word, or NULL on failure.
+ */
+char* expand_word(const char raw[]);
+
+/**
+ * @brief Expands all words of the pipeline.
+ *
+ * @details Pipeline without expansions is returned as is, otherwise its
+ * commands are copied into line_arena and expanded there, so the tree stays
+ * untouched. Type of command is resolved again after its name is expanded.
+ * Glob pattern is replaced by sorted matching paths, or left as is if
+ * nothing matches, quoted characters and variable values are not patterns.
+ * Directory listings are cached while the pipeline is expanded.
+ *
+ * @param[in] pipeline The pipeline to expand.
+ * @param[out] expanded Storage of the expanded copy.
+ *
+ * @return Pipeline to execute, or NULL on failure.
+ */
+const struct Pipeline* expand_pipeline(const struct Pipeline* pipeline,
+                                       struct Pipeline* expanded);
+
+/**
+ * @brief Assigns shell variables of ASSIGNMENT command.
+ *
+ * @details Values are expanded one by one, so later assignments see earlier
+ * ones.
+ *
+ * @param[in] assignments Assignments of the command.
+ *
+ * @return True on success, otherwise false.
+ */
+bool assign_variables(const struct Assignment* assignments);
+
+/**
+ * @brief Exports assignments in front of the command to its environment.
+ *
+ * @details Called in child process just before exec.
+ *
+ * @param[in] assignments Expanded assignments of the command.
+ */
+void export_assignments(const struct Assignment* assignments);
+
+#endif //KARASHI_EXPANSION_H
@@ -0,0 +1,737 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file glob.c
+ *
+ * @brief Pathname expansion over directory listings read with getdents64().
+ */
+
+#define _GNU_SOURCE
+
+#include "glob.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <pthread.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "arena.h"
+#include "utility.h"
+
+#define READ_SIZE (64 * 1024)  ///< Size of single getdents64() batch.
+#define CACHE_BUCKETS 64       ///< Amount of cache buckets, power of two.
+#define WORKERS 4              ///< Threads walking large tree with shell.
+#define PARALLEL_THRESHOLD 16  ///< Pending directories to start workers.
+
+/**
+ * @brief Record returned by getdents64() system call.
+ */
+struct LinuxDirent64 {
+    uint64_t d_ino;         ///< Inode number.
+    int64_t d_off;          ///< Offset of the next record.
+    unsigned short d_reclen;///< Size of this record.
+    unsigned char d_type;   ///< File type, DT_UNKNOWN if not known.
+    char d_name[];          ///< Terminated file name.
+};
+
+/**
+ * @brief Single entry of directory listing.
+ */
+struct Entry {
+    size_t name;  ///< Offset of the name in names of the listing.
+    bool is_dir;  ///< True for directory or link to directory.
+    bool is_link; ///< True for symbolic link.
+};
+
+/**
+ * @brief Entries of single directory.
+ */
+struct Listing {
+    char* path;            ///< Path of the directory, "" for current one.
+    struct Entry* entries; ///< Entries except "." and "..".
+    size_t amount;         ///< Amount of entries.
+    char* names;           ///< Terminated names of entries.
+    struct Listing* next;  ///< Next listing in the same cache bucket.
+};
+
+/**
+ * @brief Growing array of allocated paths.
+ */
+struct PathList {
+    char** data;     ///< Array of paths.
+    size_t amount;   ///< Amount of paths.
+    size_t capacity; ///< Amount of allocated paths.
+};
+
+/**
+ * @brief Kind of pattern segment between slashes.
+ */
+enum SegmentKind {
+    LITERAL,   ///< Name without special characters, not matched.
+    PATTERN,   ///< Name with "*", "?" or "[...]", matched with fnmatch().
+    RECURSIVE, ///< "**", any amount of directories.
+};
+
+/**
+ * @brief Compiled segment of pattern.
+ */
+struct Segment {
+    enum SegmentKind kind; ///< Represent kind of Segment structure.
+    char* text;            ///< Pattern, or name without backslashes.
+};
+
+/**
+ * @brief State of "**" walk shared by threads.
+ */
+struct Walk {
+    pthread_mutex_t lock;            ///< Guards the rest of the fields.
+    pthread_cond_t changed;          ///< Signalled when queue or busy change.
+    struct PathList queue;           ///< Directories to read, borrowed.
+    size_t busy;                     ///< Amount of directories being read.
+    struct PathList found;           ///< Found paths.
+    bool is_file_matched;            ///< True to find files too.
+    bool is_failed;                  ///< True if allocation failed.
+    pthread_t workers[WORKERS - 1];  ///< Started worker threads.
+    size_t started;                  ///< Amount of started workers.
+};
+
+/**
+ * @brief Whether listings are kept in CACHE, set while a pipeline expands.
+ */
+static bool IS_CACHED = false;
+
+/**
+ * @brief Hash table of cached listings chained by path.
+ */
+static struct Listing* CACHE[CACHE_BUCKETS];
+
+/**
+ * @brief Guards CACHE against walk threads.
+ */
+static pthread_mutex_t CACHE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief FNV-1a hash of C-style string.
+ *
+ * @param[in] string The string to hash.
+ *
+ * @return Bucket index.
+ */
+static size_t hash_string(const char string[]) {
+    size_t hash = 14695981039346656037ULL;
+    for (; *string; ++string) {
+        hash ^= (unsigned char) *string;
+        hash *= 1099511628211ULL;
+    }
+    return hash & (CACHE_BUCKETS - 1);
+}
+
+/**
+ * @brief Appends path to the list.
+ *
+ * @param[in,out] list The list.
+ * @param[in] path The path.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool push_path(struct PathList* list, char* path) {
+    if (list->amount == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        char** data = realloc(list->data, capacity * sizeof(char*));
+        if (!check_alloc(data, "glob paths")) {
+            return false;
+        }
+        list->data = data;
+        list->capacity = capacity;
+    }
+    list->data[list->amount++] = path;
+    return true;
+}
+
+/**
+ * @brief Appends allocated path to the list, which owns it afterwards.
+ *
+ * @param[in,out] list The list.
+ * @param[in] path Allocated path, may be NULL. It is freed on failure.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool add_path(struct PathList* list, char* path) {
+    if (!path || !push_path(list, path)) {
+        free(path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Frees paths of the list and the list itself.
+ *
+ * @param[in,out] list The list to free.
+ */
+static void free_paths(struct PathList* list) {
+    for (size_t i = 0; i < list->amount; ++i) {
+        free(list->data[i]);
+    }
+    free(list->data);
+    *list = (struct PathList) {NULL, 0, 0};
+}
+
+/**
+ * @brief Joins directory path and name.
+ *
+ * @param[in] dir The directory path, "" for current directory.
+ * @param[in] name The name.
+ *
+ * @return Allocated path, or NULL if allocation failed.
+ */
+static char* join_path(const char dir[], const char name[]) {
+    const size_t dir_length = strlen(dir);
+    const bool has_slash = !dir_length || dir[dir_length - 1] == '/';
+    char* path = malloc(dir_length + !has_slash + strlen(name) + 1);
+    if (!path) {
+        check_alloc(path, "glob path");
+        return NULL;
+    }
+    memcpy(path, dir, dir_length);
+    if (!has_slash) {
+        path[dir_length] = '/';
+    }
+    strcpy(path + dir_length + !has_slash, name);
+    return path;
+}
+
+/**
+ * @brief Frees directory listing.
+ *
+ * @param[in] listing The listing to free, may be NULL.
+ */
+static void free_listing(struct Listing* listing) {
+    if (listing) {
+        free(listing->path);
+        free(listing->entries);
+        free(listing->names);
+        free(listing);
+    }
+}
+
+/**
+ * @brief Resolves type of entry, which is not known from getdents64().
+ *
+ * @param[in] fd The directory file descriptor.
+ * @param[in] name Name of the entry.
+ * @param[in] type Type reported by getdents64().
+ * @param[out] entry The entry to fill.
+ */
+static void resolve_type(int fd, const char name[], unsigned char type,
+                         struct Entry* entry) {
+    struct stat st;
+    if (type == DT_UNKNOWN) {
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+            return;
+        }
+        type = S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        entry->is_dir = S_ISDIR(st.st_mode);
+    }
+    if (type == DT_LNK) {
+        entry->is_link = true;
+        entry->is_dir = !fstatat(fd, name, &st, 0) && S_ISDIR(st.st_mode);
+    } else if (type == DT_DIR) {
+        entry->is_dir = true;
+    }
+}
+
+/**
+ * @brief Reads all entries of the directory.
+ *
+ * @param[in] path Path of the directory, "" for current one.
+ *
+ * @return Allocated listing, or NULL if directory cannot be read.
+ */
+static struct Listing* read_listing(const char path[]) {
+    const int fd = open(*path ? path : ".",
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct Listing* listing = calloc(1, sizeof(struct Listing));
+    char* buffer = malloc(READ_SIZE);
+    if (!check_alloc(listing, "directory listing") ||
+        !check_alloc(buffer, "directory buffer") ||
+        !check_alloc(listing->path = strdup(path), "directory path")) {
+        free(buffer);
+        free_listing(listing);
+        close(fd);
+        return NULL;
+    }
+
+    size_t capacity = 0;
+    size_t names_length = 0;
+    size_t names_capacity = 0;
+    bool is_ready = true;
+    long size;
+    while (is_ready && (size = syscall(SYS_getdents64, fd, buffer,
+                                       READ_SIZE)) > 0) {
+        for (long offset = 0; offset < size;) {
+            const struct LinuxDirent64* record =
+                    (const struct LinuxDirent64*) (buffer + offset);
+            offset += record->d_reclen;
+            const char* name = record->d_name;
+            if (!strcmp(name, ".") || !strcmp(name, "..")) {
+                continue;
+            }
+
+            const size_t length = strlen(name) + 1;
+            if (listing->amount == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                struct Entry* entries = realloc(listing->entries,
+                                                capacity * sizeof(*entries));
+                if (!(is_ready = check_alloc(entries, "directory entries"))) {
+                    break;
+                }
+                listing->entries = entries;
+            }
+            if (names_length + length > names_capacity) {
+                names_capacity = names_capacity ? names_capacity * 2 : 1024;
+                names_capacity += length;
+                char* names = realloc(listing->names, names_capacity);
+                if (!(is_ready = check_alloc(names, "directory names"))) {
+                    break;
+                }
+                listing->names = names;
+            }
+
+            struct Entry* entry = &listing->entries[listing->amount++];
+            *entry = (struct Entry) {names_length, false, false};
+            memcpy(listing->names + names_length, name, length);
+            names_length += length;
+            resolve_type(fd, name, record->d_type, entry);
+        }
+    }
+    free(buffer);
+    close(fd);
+    if (!is_ready) {
+        free_listing(listing);
+        return NULL;
+    }
+    return listing;
+}
+
+/**
+ * @brief Gets listing of the directory, from the cache if it is enabled.
+ *
+ * @param[in] path Path of the directory, "" for current one.
+ *
+ * @return The listing, or NULL if directory cannot be read.
+ */
+static struct Listing* get_listing(const char path[]) {
+    if (!IS_CACHED) {
+        return read_listing(path);
+    }
+
+    const size_t index = hash_string(path);
+    pthread_mutex_lock(&CACHE_LOCK);
+    struct Listing* listing = CACHE[index];
+    while (listing && strcmp(listing->path, path)) {
+        listing = listing->next;
+    }
+    pthread_mutex_unlock(&CACHE_LOCK);
+    if (listing || !(listing = read_listing(path))) {
+        return listing;
+    }
+
+    pthread_mutex_lock(&CACHE_LOCK);
+    listing->next = CACHE[index];
+    CACHE[index] = listing;
+    pthread_mutex_unlock(&CACHE_LOCK);
+    return listing;
+}
+
+/**
+ * @brief Releases listing returned by get_listing().
+ *
+ * @param[in] listing The listing, cached one stays alive.
+ */
+static void release_listing(struct Listing* listing) {
+    if (!IS_CACHED) {
+        free_listing(listing);
+    }
+}
+
+void set_glob_cache(bool is_enabled) {
+    if (!is_enabled) {
+        for (size_t i = 0; i < CACHE_BUCKETS; ++i) {
+            while (CACHE[i]) {
+                struct Listing* next = CACHE[i]->next;
+                free_listing(CACHE[i]);
+                CACHE[i] = next;
+            }
+        }
+    }
+    IS_CACHED = is_enabled;
+}
+
+/**
+ * @brief Reads directory and adds its entries to the walk.
+ *
+ * @details Entries are collected locally, so the lock is taken once per
+ * directory. Hidden directories are not walked and links are not followed.
+ *
+ * @param[in,out] walk The walk.
+ * @param[in] dir Path of the directory.
+ */
+static void walk_directory(struct Walk* walk, const char dir[]) {
+    struct Listing* listing = get_listing(dir);
+    if (!listing) {
+        return;
+    }
+
+    struct PathList dirs = {NULL, 0, 0};
+    struct PathList files = {NULL, 0, 0};
+    bool is_failed = false;
+    for (size_t i = 0; i < listing->amount; ++i) {
+        const struct Entry* entry = &listing->entries[i];
+        const char* name = listing->names + entry->name;
+        if (name[0] == '.') {
+            continue;
+        } else if (entry->is_dir && !entry->is_link) {
+            is_failed |= !add_path(&dirs, join_path(dir, name));
+        } else if (walk->is_file_matched) {
+            is_failed |= !add_path(&files, join_path(dir, name));
+        }
+    }
+    release_listing(listing);
+
+    pthread_mutex_lock(&walk->lock);
+    for (size_t i = 0; i < dirs.amount; ++i) {
+        // Found list owns the path, queue borrows it
+        if (!add_path(&walk->found, dirs.data[i]) ||
+            !push_path(&walk->queue, dirs.data[i])) {
+            is_failed = true;
+        }
+    }
+    for (size_t i = 0; i < files.amount; ++i) {
+        is_failed |= !add_path(&walk->found, files.data[i]);
+    }
+    walk->is_failed |= is_failed;
+    pthread_cond_broadcast(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+
+    free(dirs.data);
+    free(files.data);
+}
+
+static void* walk_worker(void* arg);
+
+/**
+ * @brief Reads queued directories until the whole tree is walked.
+ *
+ * @details Called with the lock held. The shell thread starts workers when
+ * the queue grows long enough.
+ *
+ * @param[in,out] walk The walk.
+ * @param[in] is_shell True for the shell thread.
+ */
+static void drain_queue(struct Walk* walk, bool is_shell) {
+    while (true) {
+        while (!walk->queue.amount && walk->busy) {
+            pthread_cond_wait(&walk->changed, &walk->lock);
+        }
+        if (!walk->queue.amount) {
+            return;
+        }
+
+        if (is_shell && !walk->started &&
+            walk->queue.amount >= PARALLEL_THRESHOLD) {
+            for (; walk->started < WORKERS - 1; ++walk->started) {
+                if (pthread_create(&walk->workers[walk->started], NULL,
+                                   walk_worker, walk)) {
+                    break;
+                }
+            }
+        }
+
+        const char* dir = walk->queue.data[--walk->queue.amount];
+        walk->busy++;
+        pthread_mutex_unlock(&walk->lock);
+        walk_directory(walk, dir);
+        pthread_mutex_lock(&walk->lock);
+        walk->busy--;
+        pthread_cond_broadcast(&walk->changed);
+    }
+}
+
+/**
+ * @brief Thread routine of walk worker.
+ *
+ * @param[in,out] arg The walk.
+ *
+ * @return NULL.
+ */
+static void* walk_worker(void* arg) {
+    struct Walk* walk = arg;
+    pthread_mutex_lock(&walk->lock);
+    drain_queue(walk, false);
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+/**
+ * @brief Finds directories, and files if requested, below base directories.
+ *
+ * @details Base directories are found too, unless files are requested, so
+ * "**" matches zero directories in the middle of pattern.
+ *
+ * @param[in] bases Directories to walk.
+ * @param[in] is_file_matched True to find files too.
+ * @param[out] found Found paths.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool walk_tree(const struct PathList* bases, bool is_file_matched,
+                      struct PathList* found) {
+    struct Walk walk = {0};
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.changed, NULL);
+    walk.is_file_matched = is_file_matched;
+
+    for (size_t i = 0; i < bases->amount; ++i) {
+        if (!push_path(&walk.queue, bases->data[i]) ||
+            (!is_file_matched &&
+             !add_path(&walk.found, strdup(bases->data[i])))) {
+            walk.is_failed = true;
+        }
+    }
+
+    pthread_mutex_lock(&walk.lock);
+    drain_queue(&walk, true);
+    pthread_mutex_unlock(&walk.lock);
+    for (size_t i = 0; i < walk.started; ++i) {
+        pthread_join(walk.workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&walk.changed);
+    pthread_mutex_destroy(&walk.lock);
+    free(walk.queue.data);
+    *found = walk.found;
+    return !walk.is_failed;
+}
+
+/**
+ * @brief Matches single segment in every directory.
+ *
+ * @param[in] segment The segment, not RECURSIVE.
+ * @param[in] is_last True for the last segment, others match directories.
+ * @param[in] dirs Paths matched by previous segments.
+ * @param[out] next Paths matched by the segment.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool match_segment(const struct Segment* segment, bool is_last,
+                          const struct PathList* dirs,
+                          struct PathList* next) {
+    for (size_t i = 0; i < dirs->amount; ++i) {
+        if (segment->kind == LITERAL) {
+            char* path = join_path(dirs->data[i], segment->text);
+            struct stat st;
+            // Path of literal in the middle is checked by the next segment
+            if (path && is_last && lstat(path, &st)) {
+                free(path);
+            } else if (!add_path(next, path)) {
+                return false;
+            }
+            continue;
+        }
+
+        struct Listing* listing = get_listing(dirs->data[i]);
+        if (!listing) {
+            continue;
+        }
+        bool is_failed = false;
+        for (size_t j = 0; j < listing->amount && !is_failed; ++j) {
+            const struct Entry* entry = &listing->entries[j];
+            const char* name = listing->names + entry->name;
+            if ((is_last || entry->is_dir) &&
+                !fnmatch(segment->text, name, FNM_PERIOD)) {
+                is_failed = !add_path(next, join_path(dirs->data[i], name));
+            }
+        }
+        release_listing(listing);
+        if (is_failed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Determine if part of pattern has unescaped special characters.
+ *
+ * @param[in] text The part of pattern.
+ * @param[in] length Length of the part.
+ *
+ * @return True if there is "*", "?" or "[".
+ */
+static bool has_special(const char text[], size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] == '\\') {
+            ++i;
+        } else if (text[i] == '*' || text[i] == '?' || text[i] == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Copies part of pattern into line arena removing backslashes.
+ *
+ * @param[in] text The part of pattern.
+ * @param[in] length Length of the part.
+ *
+ * @return The copy, or NULL if allocation failed.
+ */
+static char* unescape(const char text[], size_t length) {
+    char* copy = arena_alloc(&line_arena, length + 1);
+    if (!copy) {
+        return NULL;
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] == '\\' && i + 1 < length) {
+            ++i;
+        }
+        copy[out++] = text[i];
+    }
+    copy[out] = '\0';
+    return copy;
+}
+
+/**
+ * @brief Splits pattern into segments between slashes.
+ *
+ * @details Empty segments are dropped except the trailing one, which matches
+ * directories only. Consecutive "**" segments are merged.
+ *
+ * @param[in] pattern The pattern.
+ * @param[out] amount Amount of segments.
+ *
+ * @return Segments allocated in line arena, or NULL if allocation failed.
+ */
+static struct Segment* compile(const char pattern[], size_t* amount) {
+    size_t capacity = 1;
+    for (const char* c = pattern; *c; ++c) {
+        capacity += *c == '/';
+    }
+    struct Segment* segments = arena_alloc(&line_arena,
+                                           capacity * sizeof(*segments));
+    if (!segments) {
+        return NULL;
+    }
+
+    *amount = 0;
+    const char* start = pattern + (*pattern == '/');
+    while (true) {
+        const char* end = strchrnul(start, '/');
+        const size_t length = (size_t) (end - start);
+        struct Segment* segment = &segments[*amount];
+        if (length == 2 && !memcmp(start, "**", 2)) {
+            segment->kind = RECURSIVE;
+            segment->text = NULL;
+            if (!*amount || segments[*amount - 1].kind != RECURSIVE) {
+                ++*amount;
+            }
+        } else if (length || !*end) {
+            const bool is_pattern = has_special(start, length);
+            segment->kind = is_pattern ? PATTERN : LITERAL;
+            segment->text = is_pattern ? arena_strndup(&line_arena, start,
+                                                       length)
+                                       : unescape(start, length);
+            if (!segment->text) {
+                return NULL;
+            }
+            ++*amount;
+        }
+        if (!*end) {
+            return segments;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Compares paths for qsort().
+ *
+ * @param[in] a Pointer to the first path.
+ * @param[in] b Pointer to the second path.
+ *
+ * @return Result of strcmp().
+ */
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+bool glob_pattern(const char pattern[], char*** matches, size_t* amount) {
+    *matches = NULL;
+    *amount = 0;
+
+    size_t segments_amount;
+    const struct Segment* segments = compile(pattern, &segments_amount);
+    if (!segments) {
+        return false;
+    }
+
+    struct PathList paths = {NULL, 0, 0};
+    if (!add_path(&paths, strdup((*pattern == '/') ? "/" : ""))) {
+        return false;
+    }
+    bool is_done = true;
+    for (size_t i = 0; i < segments_amount && paths.amount && is_done; ++i) {
+        struct PathList next = {NULL, 0, 0};
+        const bool is_last = (i + 1 == segments_amount);
+        if (segments[i].kind == RECURSIVE) {
+            is_done = walk_tree(&paths, is_last, &next);
+        } else {
+            is_done = match_segment(&segments[i], is_last, &paths, &next);
+        }
+        free_paths(&paths);
+        paths = next;
+    }
+
+    if (is_done && paths.amount) {
+        qsort(paths.data, paths.amount, sizeof(char*), compare_paths);
+        *matches = arena_alloc(&line_arena, paths.amount * sizeof(char*));
+        is_done = *matches != NULL;
+        for (size_t i = 0; is_done && i < paths.amount; ++i) {
+            (*matches)[i] = arena_strndup(&line_arena, paths.data[i],
+                                          strlen(paths.data[i]));
+            is_done = (*matches)[i] != NULL;
+        }
+        *amount = is_done ? paths.amount : 0;
+    }
+    free_paths(&paths);
+    return is_done;
+}
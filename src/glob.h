@@ -0,0 +1,61 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file glob.h
+ *
+ * @brief Pathname expansion of "*", "?", "[...]" and recursive "**".
+ *
+ * @see glob.c
+ */
+
+#ifndef KARASHI_GLOB_H
+#define KARASHI_GLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Starts or drops cache of directory listings.
+ *
+ * @details While the cache is enabled every directory is read once, so
+ * several patterns over the same directory do not rescan it. The cache must
+ * be dropped before the listed directories may change.
+ *
+ * @param[in] is_enabled True to start the cache, false to drop it.
+ */
+void set_glob_cache(bool is_enabled);
+
+/**
+ * @brief Finds paths matching the pattern.
+ *
+ * @details Pattern is compiled once into path segments. Literal segments
+ * are not matched against directories, "**" segment matches any amount of
+ * directories and is walked by a pool of threads when tree is large.
+ * Directories are read with getdents64() in large batches. Names starting
+ * with "." match only explicit ".", hidden directories are not walked.
+ * Backslash escapes the next character.
+ *
+ * @param[in] pattern The pattern.
+ * @param[out] matches Matching paths sorted by strcmp(), allocated in
+ * line_arena.
+ * @param[out] amount Amount of matching paths, zero if nothing matched.
+ *
+ * @return True on success, otherwise false.
+ */
+bool glob_pattern(const char pattern[], char*** matches, size_t* amount);
+
+#endif //KARASHI_GLOB_H
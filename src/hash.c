@@ -0,0 +1,298 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file hash.c
+ *
+ * @brief Hash table of command locations with negative entries.
+ */
+
+#define _GNU_SOURCE
+
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "built-in.h"
+#include "utility.h"
+#include "variables.h"
+
+#define BUCKETS 256     ///< Amount of hash table buckets, power of two.
+#define NEGATIVE_TTL 5  ///< Seconds while missing command stays missing.
+
+/**
+ * @brief Single remembered command location.
+ */
+struct HashEntry {
+    char* name;              ///< Name of the command.
+    char* path;              ///< Executable path, NULL for missing command.
+    size_t hits;             ///< Amount of lookups served by this entry.
+    time_t cached_at;        ///< Monotonic time when entry was cached.
+    struct HashEntry* next;  ///< Next entry in the same bucket.
+};
+
+/**
+ * @brief Hash table with separate chaining.
+ */
+static struct HashEntry* TABLE[BUCKETS];
+
+/**
+ * @brief Copy of PATH value used to fill the table.
+ */
+static char* CACHED_PATH = NULL;
+
+/**
+ * @brief FNV-1a hash of C-style string.
+ *
+ * @param[in] string The string to hash.
+ *
+ * @return Bucket index.
+ */
+static size_t hash_string(const char string[]) {
+    size_t hash = 14695981039346656037ULL;
+    for (; *string; ++string) {
+        hash ^= (unsigned char) *string;
+        hash *= 1099511628211ULL;
+    }
+    return hash & (BUCKETS - 1);
+}
+
+/**
+ * @brief Gets current time of monotonic clock in seconds.
+ *
+ * @return Seconds since some unspecified point in the past.
+ */
+static time_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * @brief Determine if path is executable regular file.
+ *
+ * @param[in] path The path to check.
+ *
+ * @return True if execve() is able to run the file.
+ */
+static bool is_executable(const char path[]) {
+    struct stat st;
+    return !stat(path, &st) && S_ISREG(st.st_mode) && !access(path, X_OK);
+}
+
+/**
+ * @brief Walks PATH directories in search of command.
+ *
+ * @param[in] name The command name.
+ * @param[in] path_env Value of PATH environment variable.
+ *
+ * @return Allocated path to the executable, or NULL if it is not found.
+ */
+static char* search_path(const char name[], const char path_env[]) {
+    const size_t name_length = strlen(name);
+
+    while (true) {
+        const char* end = strchrnul(path_env, ':');
+        const size_t dir_length = (size_t) (end - path_env);
+
+        char* candidate = malloc(dir_length + name_length + 3);
+        if (!check_alloc(candidate, "command path")) {
+            return NULL;
+        }
+        if (dir_length) {
+            memcpy(candidate, path_env, dir_length);
+            candidate[dir_length] = '/';
+            strcpy(candidate + dir_length + 1, name);
+        } else { // Empty PATH entry means current directory
+            sprintf(candidate, "./%s", name);
+        }
+
+        if (is_executable(candidate)) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (!*end) {
+            return NULL;
+        }
+        path_env = end + 1;
+    }
+}
+
+void hash_reset(void) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        struct HashEntry* entry = TABLE[i];
+        while (entry) {
+            struct HashEntry* next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        TABLE[i] = NULL;
+    }
+    free(CACHED_PATH);
+    CACHED_PATH = NULL;
+}
+
+/**
+ * @brief Gets value of PATH variable.
+ *
+ * @return Value of PATH, or empty string if it is not set.
+ */
+static const char* get_path_env(void) {
+    const char* path_env = get_variable("PATH", strlen("PATH"));
+    return path_env ? path_env : "";
+}
+
+/**
+ * @brief Drops the table if PATH was changed since it was filled.
+ *
+ * @param[in] path_env Current value of PATH environment variable.
+ */
+static void validate_path(const char path_env[]) {
+    if (CACHED_PATH && !strcmp(CACHED_PATH, path_env)) {
+        return;
+    }
+    hash_reset();
+    CACHED_PATH = malloc(strlen(path_env) + 1);
+    if (check_alloc(CACHED_PATH, "cached PATH")) {
+        strcpy(CACHED_PATH, path_env);
+    }
+}
+
+/**
+ * @brief Walks PATH and stores result in the entry.
+ *
+ * @param[in,out] entry The entry to fill.
+ * @param[in] path_env Value of PATH environment variable.
+ */
+static void fill_entry(struct HashEntry* entry, const char path_env[]) {
+    free(entry->path);
+    entry->path = search_path(entry->name, path_env);
+    entry->cached_at = now();
+}
+
+/**
+ * @brief Finds entry for command name or creates and fills new one.
+ *
+ * @param[in] name The command name.
+ * @param[in] path_env Value of PATH environment variable.
+ * @param[in] refresh Walk PATH again even if entry is already cached.
+ *
+ * @return Entry from the table, or NULL on allocation failure.
+ */
+static struct HashEntry* get_entry(const char name[], const char path_env[],
+                                   bool refresh) {
+    const size_t index = hash_string(name);
+    for (struct HashEntry* entry = TABLE[index]; entry; entry = entry->next) {
+        if (!strcmp(entry->name, name)) {
+            if (refresh) {
+                fill_entry(entry, path_env);
+            }
+            return entry;
+        }
+    }
+
+    struct HashEntry* entry = calloc(1, sizeof(struct HashEntry));
+    if (!check_alloc(entry, "hash entry")) {
+        return NULL;
+    }
+    entry->name = malloc(strlen(name) + 1);
+    if (!check_alloc(entry->name, "hash entry name")) {
+        free(entry);
+        return NULL;
+    }
+    strcpy(entry->name, name);
+    fill_entry(entry, path_env);
+
+    entry->next = TABLE[index];
+    TABLE[index] = entry;
+    return entry;
+}
+
+const char* hash_lookup(const char name[]) {
+    if (strchr(name, '/')) {
+        return name;
+    }
+
+    const char* path_env = get_path_env();
+    validate_path(path_env);
+
+    struct HashEntry* entry = get_entry(name, path_env, false);
+    if (!entry) {
+        return NULL;
+    }
+
+    if (entry->path ? !is_executable(entry->path)
+                    : now() - entry->cached_at > NEGATIVE_TTL) {
+        fill_entry(entry, path_env);
+    }
+    entry->hits++;
+    return entry->path;
+}
+
+/**
+ * @brief Prints all entries of the table.
+ *
+ * @param[in] fd The file descriptor to print to.
+ */
+static void print_table(int fd) {
+    dprintf(fd, "hits\tcommand\n");
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        for (struct HashEntry* entry = TABLE[i]; entry; entry = entry->next) {
+            if (entry->path) {
+                dprintf(fd, "%4zu\t%s\n", entry->hits, entry->path);
+            } else {
+                dprintf(fd, "%4zu\t%s (not found)\n",
+                        entry->hits, entry->name);
+            }
+        }
+    }
+}
+
+int hash_builtin(int argc, char* argv[], const int fds[]) {
+    if (argc < 2) {
+        print_table(fds[STDOUT_FILENO]);
+        return EXIT_SUCCESS;
+    }
+
+    bool found = true;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r")) {
+            hash_reset();
+            continue;
+        }
+
+        const char* path_env = get_path_env();
+        validate_path(path_env);
+        struct HashEntry* entry = get_entry(argv[i], path_env, true);
+        if (!entry) {
+            return EXIT_FAILURE;
+        }
+        if (!entry->path) {
+            print_builtin_error(fds, "hash: %s not found", argv[i]);
+            found = false;
+        }
+    }
+    return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
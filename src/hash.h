@@ -0,0 +1,65 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file hash.h
+ *
+ * @brief Cache of command locations found in PATH directories.
+ *
+ * @see hash.c
+ */
+
+#ifndef KARASHI_HASH_H
+#define KARASHI_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Resolves command name into executable path.
+ *
+ * @details Consults the cache first and walks PATH directories only on a
+ * miss. Commands which are not found are cached too, for a short period of
+ * time. The cache is dropped when PATH changes and an entry is dropped when
+ * its cached binary disappears. Names containing "/" are not looked up.
+ *
+ * @param[in] name The command name.
+ *
+ * @return Path to the executable, or NULL if command is not found. The path
+ * is valid until the next call of any function from this file.
+ */
+const char* hash_lookup(const char name[]);
+
+/**
+ * @brief Implementation of hash built-in command.
+ *
+ * @details Without arguments lists cached entries, "-r" resets the cache and
+ * any other argument is looked up in PATH and remembered.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero if all of the arguments were found, otherwise one.
+ */
+int hash_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Forgets all remembered command locations.
+ */
+void hash_reset(void);
+
+#endif //KARASHI_HASH_H
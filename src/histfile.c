@@ -0,0 +1,659 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file histfile.c
+ *
+ * @brief Append-only history file, its compaction and index for search.
+ *
+ * @details The file is a sequence of lines, every entry is one line ended by
+ * newline. Sessions open the file for every append and write the whole line
+ * under exclusive flock(), so lines of concurrent sessions never interleave.
+ * Compaction writes kept entries into a temporary file and renames it over
+ * the history file while holding the lock of the old one, so every opener
+ * checks that its descriptor still refers to the file at the path.
+ */
+
+#define _GNU_SOURCE
+
+#include "histfile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Including GNU readline library.
+#include <history.h>
+
+#include "built-in.h"
+#include "utility.h"
+#include "variables.h"
+
+#define HISTORY_NAME "/.kara_history" ///< History file name in home directory.
+#define LOADED_ENTRIES 10000          ///< Max entries of readline history.
+#define FILE_LIMIT (64 << 20)         ///< File size which triggers compaction.
+#define COMPACTED_SIZE (FILE_LIMIT / 2) ///< Max file size after compaction.
+#define SEEN_CAPACITY 1024            ///< Initial capacity of seen lines set.
+
+/**
+ * @brief Line of mapped history file.
+ */
+struct Line {
+    const char* data; ///< Start of the line.
+    size_t length;    ///< Length of the line without newline.
+};
+
+/**
+ * @brief Open addressing set of lines for deduplication.
+ */
+struct LineSet {
+    struct Line* slots; ///< Slots, data is NULL in empty slot.
+    size_t capacity;    ///< Amount of slots, power of two.
+    size_t amount;      ///< Amount of used slots.
+};
+
+/**
+ * @brief Index of line starts of mapped history file.
+ */
+struct Index {
+    const char* data; ///< Mapped file, NULL if nothing is mapped.
+    size_t size;      ///< Size of mapping.
+    dev_t device;     ///< Device of mapped file.
+    ino_t inode;      ///< Inode of mapped file.
+    size_t indexed;   ///< Amount of bytes covered by complete lines.
+    size_t* starts;   ///< Offsets of line starts.
+    size_t amount;    ///< Amount of lines.
+    size_t capacity;  ///< Capacity of starts.
+};
+
+/**
+ * @brief Path to history file, NULL if history is not saved.
+ */
+static char* HISTORY_PATH = NULL;
+
+/**
+ * @brief Whether HISTORY_PATH was already looked up.
+ */
+static bool IS_PATH_SET = false;
+
+/**
+ * @brief Index of the mapped history file used by search.
+ */
+static struct Index INDEX = {0};
+
+/**
+ * @brief Finds path to history file on the first call.
+ *
+ * @return Path to history file, or NULL if there is no one.
+ */
+static const char* get_history_path(void) {
+    if (IS_PATH_SET) {
+        return HISTORY_PATH;
+    }
+    IS_PATH_SET = true;
+
+    const char* file = get_variable("KARA_HISTFILE", strlen("KARA_HISTFILE"));
+    if (file && *file) {
+        HISTORY_PATH = strdup(file);
+        check_alloc(HISTORY_PATH, "history path");
+        return HISTORY_PATH;
+    }
+
+    const char* home = get_variable("HOME", strlen("HOME"));
+    if (!home || !*home) {
+        return NULL;
+    }
+    const size_t home_length = strlen(home);
+    char* path = malloc(home_length + sizeof(HISTORY_NAME));
+    if (!path) {
+        check_alloc(path, "history path");
+        return NULL;
+    }
+    memcpy(path, home, home_length);
+    memcpy(path + home_length, HISTORY_NAME, sizeof(HISTORY_NAME));
+    HISTORY_PATH = path;
+    return HISTORY_PATH;
+}
+
+/**
+ * @brief Opens history file and locks it.
+ *
+ * @details Opens the file again if it was replaced by compaction while
+ * waiting for the lock.
+ *
+ * @param[in] path The path to history file.
+ * @param[in] flags Flags of open().
+ * @param[in] operation LOCK_SH or LOCK_EX.
+ *
+ * @return Locked file descriptor, or -1 with errno set.
+ */
+static int open_locked(const char path[], int flags, int operation) {
+    while (true) {
+        const int fd = open(path, flags | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return -1;
+        }
+        int result;
+        do {
+            result = flock(fd, operation);
+        } while (result < 0 && errno == EINTR);
+
+        struct stat opened;
+        struct stat current;
+        if (result < 0 || fstat(fd, &opened) < 0) {
+            const int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        if (!stat(path, &current) && opened.st_dev == current.st_dev
+            && opened.st_ino == current.st_ino) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+/**
+ * @brief Finds end of the last complete line.
+ *
+ * @param[in] data The file data.
+ * @param[in] size The file size.
+ *
+ * @return Amount of bytes covered by complete lines.
+ */
+static size_t complete_size(const char data[], size_t size) {
+    const char* newline = memrchr(data, '\n', size);
+    return newline ? (size_t) (newline - data) + 1 : 0;
+}
+
+/**
+ * @brief Finds start of the line ending right before end.
+ *
+ * @param[in] data The file data.
+ * @param[in] end Offset of the newline of the line.
+ *
+ * @return Offset of the line start.
+ */
+static size_t line_start(const char data[], size_t end) {
+    const char* newline = memrchr(data, '\n', end);
+    return newline ? (size_t) (newline - data) + 1 : 0;
+}
+
+/**
+ * @brief Computes FNV-1a hash of the line.
+ *
+ * @param[in] line The line.
+ *
+ * @return The hash.
+ */
+static uint64_t hash_line(struct Line line) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < line.length; ++i) {
+        hash ^= (unsigned char) line.data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds slot of the line.
+ *
+ * @param[in] slots The slots.
+ * @param[in] capacity Amount of slots.
+ * @param[in] line The line.
+ *
+ * @return Slot with equal line or empty slot.
+ */
+static struct Line* find_slot(struct Line slots[], size_t capacity,
+                              struct Line line) {
+    size_t i = hash_line(line) & (capacity - 1);
+    while (slots[i].data && (slots[i].length != line.length
+                             || memcmp(slots[i].data, line.data, line.length))) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+/**
+ * @brief Adds line to the set.
+ *
+ * @param[in,out] set The set.
+ * @param[in] line The line.
+ * @param[out] is_added True if line was not in the set.
+ *
+ * @return False if allocation failed.
+ */
+static bool add_line(struct LineSet* set, struct Line line, bool* is_added) {
+    if ((set->amount + 1) * 2 > set->capacity) {
+        const size_t capacity = set->capacity ? set->capacity * 2
+                                              : SEEN_CAPACITY;
+        struct Line* slots = calloc(capacity, sizeof(*slots));
+        if (!slots) {
+            check_alloc(slots, "history set");
+            return false;
+        }
+        for (size_t i = 0; i < set->capacity; ++i) {
+            if (set->slots[i].data) {
+                *find_slot(slots, capacity, set->slots[i]) = set->slots[i];
+            }
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    struct Line* slot = find_slot(set->slots, set->capacity, line);
+    *is_added = !slot->data;
+    if (*is_added) {
+        *slot = line;
+        ++set->amount;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the newest unique lines of mapped file into new file.
+ *
+ * @param[in] data The mapped file.
+ * @param[in] size Amount of bytes covered by complete lines.
+ * @param[in] fd File descriptor of new file.
+ *
+ * @return False on failure.
+ */
+static bool write_compacted(const char data[], size_t size, int fd) {
+    struct LineSet seen = {0};
+    struct Line* kept = NULL;
+    size_t kept_amount = 0;
+    size_t kept_capacity = 0;
+    size_t kept_size = 0;
+    bool is_failed = false;
+
+    // Walk from the newest line, so the newest copy of duplicate is kept
+    size_t end = size;
+    while (end && !is_failed) {
+        const size_t start = line_start(data, end - 1);
+        const struct Line line = {data + start, end - 1 - start};
+        end = start;
+
+        if (kept_size + line.length + 1 > COMPACTED_SIZE) {
+            break;
+        }
+        bool is_added = false;
+        if (!add_line(&seen, line, &is_added)) {
+            is_failed = true;
+            break;
+        }
+        if (!is_added) {
+            continue;
+        }
+        if (kept_amount == kept_capacity) {
+            kept_capacity = kept_capacity ? kept_capacity * 2 : SEEN_CAPACITY;
+            struct Line* grown = realloc(kept, kept_capacity * sizeof(*kept));
+            if (!grown) {
+                check_alloc(grown, "history lines");
+                is_failed = true;
+                break;
+            }
+            kept = grown;
+        }
+        kept[kept_amount++] = line;
+        kept_size += line.length + 1;
+    }
+    free(seen.slots);
+
+    FILE* file = is_failed ? NULL : fdopen(fd, "w");
+    if (file) {
+        for (size_t i = kept_amount; i-- > 0;) {
+            fwrite(kept[i].data, 1, kept[i].length, file);
+            fputc('\n', file);
+        }
+        is_failed = ferror(file);
+        is_failed |= fclose(file) != 0;
+    } else {
+        is_failed = true;
+        close(fd);
+    }
+    free(kept);
+    return !is_failed;
+}
+
+/**
+ * @brief Compacts history file if it outgrew its limit.
+ *
+ * @param[in] path The path to history file.
+ */
+static void compact_history(const char path[]) {
+    const int fd = open_locked(path, O_RDONLY, LOCK_EX);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) < 0 || status.st_size <= FILE_LIMIT) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    const size_t size = (size_t) status.st_size;
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        print_errno();
+        close(fd);
+        return;
+    }
+
+    const size_t temporary_length = strlen(path) + sizeof(".tmp");
+    char* temporary = malloc(temporary_length);
+    if (temporary) {
+        snprintf(temporary, temporary_length, "%s.tmp", path);
+        const int new_fd = open(temporary,
+                                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                0600);
+        if (new_fd < 0) {
+            print_errno();
+        } else if (!write_compacted(data, complete_size(data, size), new_fd)
+                   || rename(temporary, path) < 0) {
+            print_errno();
+            unlink(temporary);
+        }
+    } else {
+        check_alloc(temporary, "history path");
+    }
+    free(temporary);
+    munmap((void*) data, size);
+    close(fd);
+}
+
+void load_history(void) {
+    stifle_history(LOADED_ENTRIES);
+
+    const char* path = get_history_path();
+    if (!path) {
+        return;
+    }
+    compact_history(path);
+
+    const int fd = open_locked(path, O_RDONLY, LOCK_SH);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) < 0 || !status.st_size) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    const size_t size = (size_t) status.st_size;
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        print_errno();
+        return;
+    }
+
+    // Only the tail is read, the rest of the file is never touched
+    const size_t end = complete_size(data, size);
+    size_t begin = end;
+    for (size_t i = 0; begin && i < LOADED_ENTRIES; ++i) {
+        begin = line_start(data, begin - 1);
+    }
+
+    struct Line previous = {NULL, 0};
+    while (begin < end) {
+        const char* newline = memchr(data + begin, '\n', end - begin);
+        const struct Line line = {data + begin, (size_t) (newline - data) - begin};
+        begin += line.length + 1;
+
+        if (previous.data && previous.length == line.length
+            && !memcmp(previous.data, line.data, line.length)) {
+            continue;
+        }
+        previous = line;
+
+        char* entry = strndup(line.data, line.length);
+        if (!entry) {
+            check_alloc(entry, "history entry");
+            break;
+        }
+        add_history(entry);
+        free(entry);
+    }
+    munmap((void*) data, size);
+}
+
+void remember_line(const char line[]) {
+    const HIST_ENTRY* last = history_length
+                             ? history_get(history_base + history_length - 1)
+                             : NULL;
+    if (last && !strcmp(last->line, line)) {
+        return;
+    }
+    add_history(line);
+
+    // Line with newline would break the file into several entries
+    const char* path = get_history_path();
+    if (!path || !*line || strchr(line, '\n')) {
+        return;
+    }
+    const int fd = open_locked(path, O_WRONLY | O_APPEND | O_CREAT, LOCK_EX);
+    if (fd < 0) {
+        print_errno();
+        return;
+    }
+    struct iovec parts[] = {
+            {(void*) line, strlen(line)},
+            {"\n",         1},
+    };
+    if (writev(fd, parts, 2) < 0) {
+        print_errno();
+    }
+    close(fd);
+}
+
+/**
+ * @brief Drops index and mapping.
+ */
+static void reset_index(void) {
+    if (INDEX.data) {
+        munmap((void*) INDEX.data, INDEX.size);
+    }
+    INDEX.data = NULL;
+    INDEX.size = 0;
+    INDEX.indexed = 0;
+    INDEX.amount = 0;
+}
+
+/**
+ * @brief Maps history file again and indexes lines appended since the last
+ * call.
+ *
+ * @param[in] path The path to history file.
+ *
+ * @return False on failure.
+ */
+static bool update_index(const char path[]) {
+    const int fd = open_locked(path, O_RDONLY, LOCK_SH);
+    if (fd < 0) {
+        reset_index();
+        return errno == ENOENT;
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0) {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = (size_t) status.st_size;
+    if (status.st_dev != INDEX.device || status.st_ino != INDEX.inode
+        || size < INDEX.size) {
+        reset_index();
+        INDEX.device = status.st_dev;
+        INDEX.inode = status.st_ino;
+    }
+    if (size != INDEX.size) {
+        if (INDEX.data) {
+            munmap((void*) INDEX.data, INDEX.size);
+        }
+        INDEX.data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        INDEX.size = size;
+        if (INDEX.data == MAP_FAILED) {
+            INDEX.data = NULL;
+            reset_index();
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+
+    // The file is append-only, so lines indexed before stay valid
+    const size_t end = INDEX.data ? complete_size(INDEX.data, INDEX.size) : 0;
+    while (INDEX.indexed < end) {
+        if (INDEX.amount == INDEX.capacity) {
+            const size_t capacity = INDEX.capacity ? INDEX.capacity * 2
+                                                   : SEEN_CAPACITY;
+            size_t* starts = realloc(INDEX.starts, capacity * sizeof(*starts));
+            if (!starts) {
+                check_alloc(starts, "history index");
+                return false;
+            }
+            INDEX.starts = starts;
+            INDEX.capacity = capacity;
+        }
+        INDEX.starts[INDEX.amount++] = INDEX.indexed;
+        const char* newline = memchr(INDEX.data + INDEX.indexed, '\n',
+                                     end - INDEX.indexed);
+        INDEX.indexed = (size_t) (newline - INDEX.data) + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds line containing offset.
+ *
+ * @param[in] offset The offset in mapped file.
+ *
+ * @return Index of the line.
+ */
+static size_t find_line(size_t offset) {
+    size_t low = 0;
+    size_t high = INDEX.amount;
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+        if (INDEX.starts[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Finds offset of the line end.
+ *
+ * @param[in] line Index of the line.
+ *
+ * @return Offset of newline of the line.
+ */
+static size_t line_end(size_t line) {
+    return (line + 1 < INDEX.amount ? INDEX.starts[line + 1]
+                                    : INDEX.indexed) - 1;
+}
+
+/**
+ * @brief Prints numbered line.
+ *
+ * @param[in,out] out The output stream.
+ * @param[in] line Index of the line.
+ */
+static void print_line(FILE* out, size_t line) {
+    const size_t start = INDEX.starts[line];
+    fprintf(out, "%5zu  %.*s\n", line + 1,
+            (int) (line_end(line) - start), INDEX.data + start);
+}
+
+int history_builtin(int argc, char* argv[], const int fds[]) {
+    const char* text = NULL;
+    size_t shown = SIZE_MAX;
+    if (argc == 3 && !strcmp(argv[1], "-s")) {
+        text = argv[2];
+    } else if (argc == 2) {
+        char* end = NULL;
+        errno = 0;
+        shown = strtoul(argv[1], &end, 10);
+        if (errno || end == argv[1] || *end || argv[1][0] == '-') {
+            print_builtin_error(fds, "history: %s: numeric argument required",
+                                argv[1]);
+            return EXIT_FAILURE;
+        }
+    } else if (argc != 1) {
+        print_builtin_error(fds, "history: usage: history [N | -s TEXT]");
+        return EXIT_FAILURE;
+    }
+
+    const char* path = get_history_path();
+    if (!path) {
+        print_builtin_error(fds, "history: history file is not set");
+        return EXIT_FAILURE;
+    }
+    if (!update_index(path)) {
+        print_builtin_error(fds, "history: %s: %s", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const int out_fd = dup(fds[STDOUT_FILENO]);
+    FILE* out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    if (!out) {
+        if (out_fd >= 0) {
+            close(out_fd);
+        }
+        print_builtin_error(fds, "history: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (text) {
+        // Search the whole mapping at once and jump to the next line on hit
+        const size_t text_length = strlen(text);
+        size_t offset = 0;
+        while (offset < INDEX.indexed) {
+            const char* found = memmem(INDEX.data + offset,
+                                       INDEX.indexed - offset,
+                                       text, text_length);
+            if (!found) {
+                break;
+            }
+            const size_t line = find_line((size_t) (found - INDEX.data));
+            const size_t end = line_end(line);
+            if ((size_t) (found - INDEX.data) + text_length <= end) {
+                print_line(out, line);
+            }
+            offset = end + 1;
+        }
+    } else {
+        const size_t first = shown < INDEX.amount ? INDEX.amount - shown : 0;
+        for (size_t line = first; line < INDEX.amount; ++line) {
+            print_line(out, line);
+        }
+    }
+    return fclose(out) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file histfile.h
+ *
+ * @brief Persistent commands history shared by concurrent shell sessions.
+ *
+ * @see histfile.c
+ */
+
+#ifndef KARASHI_HISTFILE_H
+#define KARASHI_HISTFILE_H
+
+/**
+ * @brief Loads the newest entries of history file into readline history.
+ *
+ * @details History file is KARA_HISTFILE or ~/.kara_history. It is an
+ * append-only file of lines, so it is memory-mapped and only its tail is
+ * read. File which outgrew its size limit is compacted first: duplicates are
+ * dropped and only the newest entries are kept.
+ */
+void load_history(void);
+
+/**
+ * @brief Adds line to readline history and appends it to history file.
+ *
+ * @details Line equal to the previous one is not saved again. Appends are
+ * serialized with other sessions by flock().
+ *
+ * @param[in] line The line entered by user.
+ */
+void remember_line(const char line[]);
+
+/**
+ * @brief Implementation of history built-in command.
+ *
+ * @details Without arguments prints all entries of history file, "N" prints
+ * N newest entries and "-s TEXT" prints entries containing TEXT. Entries are
+ * found through index of line offsets over mapped file, which is only
+ * extended when the file grows.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero on success, otherwise one.
+ */
+int history_builtin(int argc, char* argv[], const int fds[]);
+
+#endif //KARASHI_HISTFILE_H
@@ -22,47 +22,70 @@
 
 #include "init.h"
 
+#include <stdio.h>
 #include <stdlib.h>
-#include <signal.h>
+#include <string.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 
+#include "arena.h"
 #include "child.h"
+#include "completion.h"
+#include "events.h"
+#include "histfile.h"
+#include "scanner.h"
+#include "spawn.h"
+#include "trace.h"
+#include "utility.h"
+#include "variables.h"
 
 /**
- * @brief A global variable that is used to store the pid of the process.
+ * @brief Selects input source according to command line arguments.
  *
- * @details Helps to prevent recursive calls in signal_handler().
- */
-static pid_t KARA_PID;
-
-/**
- * @brief Redirect signal from shell to current running child processes.
+ * @details Quits the shell on invalid arguments.
  *
- * @details If the signal is sent to the parent process, send it to the child
- * process. If the signal is sent to the child process, discard handler and
- * raise sig.
- *
- * @param[in] sig The signal number.
+ * @param[in] argc Amount of command line arguments.
+ * @param[in] argv Command line arguments.
  */
-static void signal_handler(int sig) {
-    if (getpid() == KARA_PID) {
-        send_signal_to_child(sig);
-    } else {
-        signal(sig, SIG_DFL);
-        raise(sig);
+static void setup_input(int argc, char* argv[]) {
+    bool is_ready = true;
+
+    if (argc > 1 && !strcmp(argv[1], "-c")) {
+        if (argc < 3) {
+            printf(BOLD_RED "kara: -c requires an argument" RESET "\n");
+            exit(EXIT_FAILURE);
+        }
+        is_ready = read_script_string(argv[2]);
+
+    } else if (argc > 1) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            print_errno();
+            exit(EXIT_FAILURE);
+        }
+        is_ready = read_script_fd(fd);
+
+    } else if (!isatty(STDIN_FILENO)) {
+        is_ready = read_script_fd(STDIN_FILENO);
     }
-}
 
-void init(void) {
-    KARA_PID = getpid();
-    set_sem_name();
+    if (!is_ready) {
+        exit(EXIT_FAILURE);
+    }
+}
 
-    signal(SIGINT, signal_handler);
-    signal(SIGQUIT, signal_handler);
-    signal(SIGTSTP, signal_handler);
-    signal(SIGSTOP, signal_handler);
-    signal(SIGCONT, signal_handler);
+void init(int argc, char* argv[]) {
+    init_events();
+    init_variables();
+    set_launch_backend();
+    set_arena_stats();
+    set_tracing();
+    setup_input(argc, argv);
+    setup_completion();
+    if (is_interactive()) {
+        load_history();
+    }
 
     atexit(clear_child);
 }
@@ -28,8 +28,14 @@
 /**
  * @brief Initialize shell.
  *
- * @details Sets up the signal handlers and the atexit function.
+ * @details Sets up the event loop signals, the atexit function and the input
+ * source. Shell reads commands from script when its path is passed as
+ * argument, from string passed after "-c" option or from stdin when it is
+ * not a terminal, otherwise shell is interactive.
+ *
+ * @param[in] argc Amount of command line arguments.
+ * @param[in] argv Command line arguments.
  */
-void init(void);
+void init(int argc, char* argv[]);
 
 #endif //KARASHI_INIT_H
@@ -23,8 +23,8 @@
 #include "init.h"
 #include "executor.h"
 
-int main(void) {
-    init();
+int main(int argc, char* argv[]) {
+    init(argc, argv);
     while (1) {
         execute(parse(input()));
     }
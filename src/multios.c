@@ -0,0 +1,273 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file multios.c
+ *
+ * @brief Copying output stream of a command to several files and pipe.
+ *
+ * @details Every round pump duplicates data available in the input pipe
+ * into a copy pipe with tee() and splices the copy to the output, once for
+ * every output, then discards the data from the input. Copy pipe has the
+ * same capacity as the input, so tee() always duplicates the whole round.
+ */
+
+#define _GNU_SOURCE
+
+#include "multios.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "child.h"
+#include "spawn.h"
+#include "utility.h"
+
+#define ROUND_SIZE (1024 * 1024) ///< The most bytes copied in one round.
+#define FALLBACK_SIZE 65536      ///< Buffer of read() and write() fallback.
+
+bool has_multios(const struct Command* command, int std_stream,
+                 bool is_piped) {
+    if (std_stream == STDIN_FILENO || !command->redirect[std_stream]) {
+        return false;
+    }
+    return command->multios[std_stream] ||
+           (std_stream == STDOUT_FILENO && is_piped);
+}
+
+/**
+ * @brief Writes the whole buffer.
+ *
+ * @param[in] fd The file descriptor to write to.
+ * @param[in] buffer The data to write.
+ * @param[in] length Length of the data.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool write_all(int fd, const char buffer[], size_t length) {
+    while (length) {
+        const ssize_t written = write(fd, buffer, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0) {
+            return false;
+        }
+        buffer += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+/**
+ * @brief Moves data from pipe, falls back to read() and write() if output
+ * does not support splice().
+ *
+ * @param[in] from The pipe to read from.
+ * @param[in] to The output to write to.
+ * @param[in] length Amount of bytes to move.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool move_data(int from, int to, size_t length) {
+    static char buffer[FALLBACK_SIZE];
+
+    while (length) {
+        ssize_t moved = splice(from, NULL, to, NULL, length, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINVAL) {
+            moved = read(from, buffer, length < FALLBACK_SIZE ? length
+                                                               : FALLBACK_SIZE);
+            if (moved > 0 && !write_all(to, buffer, (size_t) moved)) {
+                return false;
+            }
+        }
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        } else if (moved <= 0) {
+            return false;
+        }
+        length -= (size_t) moved;
+    }
+    return true;
+}
+
+/**
+ * @brief Copies input to all outputs until input is over.
+ *
+ * @param[in] input The pipe command writes to.
+ * @param[in,out] outputs Outputs, failed ones are closed and set to -1.
+ * @param[in] amount Amount of outputs.
+ *
+ * @return True if all outputs got whole input, otherwise false.
+ */
+static bool pump(int input, int outputs[], size_t amount) {
+    int copy[2];
+    const int discard = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (discard < 0 || pipe2(copy, O_CLOEXEC)) {
+        print_errno();
+        return false;
+    }
+    const int capacity = fcntl(input, F_GETPIPE_SZ);
+    if (capacity > 0) {
+        fcntl(copy[1], F_SETPIPE_SZ, capacity);
+    }
+
+    bool is_copied = true;
+    while (true) {
+        // Blocks until data is available, zero when command is done
+        ssize_t length = tee(input, copy[1], ROUND_SIZE, 0);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        } else if (length <= 0) {
+            is_copied = !length;
+            break;
+        }
+
+        for (size_t i = 0; i < amount; ++i) {
+            if (i && tee(input, copy[1], (size_t) length, 0) != length) {
+                print_errno();
+                return false;
+            }
+            if (outputs[i] == -1) {
+                move_data(copy[0], discard, (size_t) length);
+            } else if (!move_data(copy[0], outputs[i], (size_t) length)) {
+                // Keep writing to the rest, as tee(1) does
+                print_errno();
+                move_data(copy[0], discard, (size_t) length);
+                close(outputs[i]);
+                outputs[i] = -1;
+                is_copied = false;
+            }
+        }
+        if (!move_data(input, discard, (size_t) length)) {
+            print_errno();
+            return false;
+        }
+    }
+    return is_copied;
+}
+
+/**
+ * @brief Counts outputs of the stream.
+ *
+ * @param[in] command The command which stream is copied.
+ * @param[in] std_stream The stream to count outputs of.
+ * @param[in] target_pipe Write end of the pipe to the next command, -1 for
+ * none.
+ *
+ * @return Amount of outputs.
+ */
+static size_t count_outputs(const struct Command* command, int std_stream,
+                            int target_pipe) {
+    size_t amount = (target_pipe != -1) ? 2 : 1;
+    for (const struct Multio* multio = command->multios[std_stream]; multio;
+         multio = multio->next) {
+        ++amount;
+    }
+    return amount;
+}
+
+/**
+ * @brief Opens output file of the stream.
+ *
+ * @param[in] path The file path to open.
+ *
+ * @return File descriptor, or -1 on failure.
+ */
+static int open_output(const char path[]) {
+    const int fd = open(path, REDIRECT_FLAGS | O_CLOEXEC, REDIRECT_MODE);
+    if (fd < 0) {
+        print_errno();
+    }
+    return fd;
+}
+
+/**
+ * @brief Called after fork in pump process.
+ *
+ * @param[in] command The command which stream is copied.
+ * @param[in] std_stream The stream to copy.
+ * @param[in] input The pipe command writes to.
+ * @param[in] target_pipe Write end of the pipe to the next command, -1 for
+ * none.
+ */
+static void pump_process_handler(const struct Command* command,
+                                 int std_stream, int input,
+                                 int target_pipe) {
+    const size_t amount = count_outputs(command, std_stream, target_pipe);
+    int outputs[amount];
+
+    // Outputs are written in order they are given in the command line
+    size_t i = 0;
+    outputs[i++] = open_output(command->redirect[std_stream]);
+    for (const struct Multio* multio = command->multios[std_stream]; multio;
+         multio = multio->next) {
+        outputs[i++] = open_output(multio->path);
+    }
+    if (target_pipe != -1) {
+        outputs[i] = target_pipe;
+    }
+    fflush(stdout);
+
+    _exit(pump(input, outputs, amount) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+pid_t launch_pump(const struct Command* command, int std_stream,
+                  int target_pipe, const int inherited[],
+                  size_t inherited_amount, pid_t pgid, int* write_end) {
+    int stream[2];
+    if (pipe2(stream, O_CLOEXEC)) {
+        print_errno();
+        return -1;
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        print_errno();
+        close(stream[0]);
+        close(stream[1]);
+        return -1;
+    } else if (!pid) { // Pump process
+        detach_jobs();
+        release_start_gate();
+        if (pgid != -1) {
+            setpgid(0, pgid);
+        }
+        // Failed output is dropped instead of killing the pump
+        signal(SIGPIPE, SIG_IGN);
+
+        // Pump must not keep pipes of the pipeline open
+        close(stream[1]);
+        for (size_t i = 0; i < inherited_amount; ++i) {
+            if (inherited[i] != -1) {
+                close(inherited[i]);
+            }
+        }
+        pump_process_handler(command, std_stream, stream[0], target_pipe);
+    }
+    if (pgid != -1) {
+        setpgid(pid, pgid ? pgid : pid);
+    }
+
+    close(stream[0]);
+    *write_end = stream[1];
+    return pid;
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file multios.h
+ *
+ * @brief Copying output stream of a command to several files and pipe.
+ *
+ * @see multios.c
+ */
+
+#ifndef KARASHI_MULTIOS_H
+#define KARASHI_MULTIOS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+#include "parser.h"
+
+/**
+ * @brief Determine if stream of the command has several outputs.
+ *
+ * @details Stream redirected to a file and piped to the next command is
+ * written to both like several redirections.
+ *
+ * @param[in] command The command to check.
+ * @param[in] std_stream The stream to check.
+ * @param[in] is_piped True if command is piped to the next one.
+ *
+ * @return True if stream has to be copied by pump, otherwise false.
+ */
+bool has_multios(const struct Command* command, int std_stream,
+                 bool is_piped);
+
+/**
+ * @brief Launches pump process copying the stream to all its outputs.
+ *
+ * @details Pump reads from a pipe the command writes to, duplicates data
+ * with tee() and moves it to every output with splice(), so data is never
+ * copied to user space. Output which refuses splice() falls back to read()
+ * and write(). Output which fails is dropped, the rest are still written.
+ *
+ * @param[in] command The command which stream is copied.
+ * @param[in] std_stream The stream to copy.
+ * @param[in] target_pipe Write end of the pipe to the next command, which
+ * is one more output, -1 for none.
+ * @param[in] inherited File descriptors of the shell to close in pump.
+ * @param[in] inherited_amount Amount of inherited file descriptors.
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
+ * @param[out] write_end Write end of the pipe to use as the stream.
+ *
+ * @return Pid of the pump, or -1 on failure.
+ */
+pid_t launch_pump(const struct Command* command, int std_stream,
+                  int target_pipe, const int inherited[],
+                  size_t inherited_amount, pid_t pgid, int* write_end);
+
+#endif //KARASHI_MULTIOS_H
@@ -0,0 +1,619 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file parallel.c
+ *
+ * @brief Launch command over many inputs with limited amount of job slots,
+ * collect output of each command and report it whole.
+ */
+
+#define _GNU_SOURCE
+
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "built-in.h"
+#include "child.h"
+#include "events.h"
+#include "executor.h"
+#include "utility.h"
+
+#define SEPARATOR ":::"   ///< Separates command template from inputs.
+#define PLACEHOLDER "{}"  ///< Replaced by input in command template.
+#define READ_CHUNK 4096   ///< Minimal size of single read of output.
+#define MAX_FAILED 253    ///< Max exit status of parallel.
+#define USAGE_ERROR 255   ///< Exit status on invalid arguments.
+#define NO_PROCESS SIZE_MAX ///< Process index of slot without process entry.
+
+/**
+ * @brief Growing byte buffer.
+ */
+struct Buffer {
+    char* data;      ///< Buffered bytes.
+    size_t used;     ///< Amount of buffered bytes.
+    size_t capacity; ///< Capacity of data.
+};
+
+/**
+ * @brief Output streams collected from command, indexes of Slot arrays.
+ */
+enum CollectedStream {
+    COLLECTED_OUT,     ///< Standard output of the command.
+    COLLECTED_ERR,     ///< Standard error of the command.
+    COLLECTED_STREAMS, ///< Amount of collected streams.
+};
+
+/**
+ * @brief Job slot, holds single running command.
+ */
+struct Slot {
+    bool is_busy;                            ///< True if command is running.
+    bool is_launched;                        ///< True if process was started.
+    size_t process;                          ///< Index of process in job.
+    struct Command command;                  ///< Command built from input.
+    int pipes[COLLECTED_STREAMS];            ///< Read ends, -1 when closed.
+    struct Buffer output[COLLECTED_STREAMS]; ///< Collected output.
+    struct timespec started;                 ///< Launch time.
+};
+
+/**
+ * @brief State of single parallel run.
+ */
+struct Scheduler {
+    const int* fds;           ///< Standard streams of parallel.
+    int input_fd;             ///< Stdin of launched commands.
+    struct Job* job;          ///< Job all commands are added to.
+    char** template;          ///< Command and arguments with placeholders.
+    size_t template_amount;   ///< Amount of template arguments.
+    char** inputs;            ///< Inputs to substitute.
+    size_t inputs_amount;     ///< Amount of inputs.
+    size_t next;              ///< Index of next input to launch.
+    struct Slot* slots;       ///< Job slots.
+    size_t slots_amount;      ///< Amount of job slots.
+    size_t running;           ///< Amount of busy slots.
+    size_t failed;            ///< Amount of failed commands.
+    bool is_halted;           ///< True if no more commands are launched.
+};
+
+/**
+ * @brief Writes data to file descriptor, retrying on partial writes.
+ *
+ * @param[in] fd The file descriptor to write to.
+ * @param[in] data The data to write.
+ * @param[in] length Amount of bytes to write.
+ */
+static void write_buffer(int fd, const char data[], size_t length) {
+    while (length) {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+}
+
+/**
+ * @brief Makes sure buffer has space for READ_CHUNK more bytes.
+ *
+ * @param[in,out] buffer The buffer to grow.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool reserve_chunk(struct Buffer* buffer) {
+    if (buffer->capacity - buffer->used >= READ_CHUNK) {
+        return true;
+    }
+    const size_t capacity = buffer->capacity ? buffer->capacity * 2
+                                             : READ_CHUNK;
+    char* data = realloc(buffer->data, capacity);
+    if (!check_alloc(data, "parallel output")) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Joins NULL terminated array of strings with spaces.
+ *
+ * @param[in] args The strings to join.
+ *
+ * @return Allocated string, or NULL if allocation failed.
+ */
+static char* join_args(char* const args[]) {
+    size_t length = 1;
+    for (size_t i = 0; args[i]; ++i) {
+        length += strlen(args[i]) + 1;
+    }
+    char* line = malloc(length);
+    if (!line) {
+        check_alloc(line, "parallel command line");
+        return NULL;
+    }
+    char* end = line;
+    for (size_t i = 0; args[i]; ++i) {
+        if (i) {
+            *end++ = ' ';
+        }
+        end = stpcpy(end, args[i]);
+    }
+    *end = '\0';
+    return line;
+}
+
+/**
+ * @brief Reads all lines of file descriptor as inputs.
+ *
+ * @param[in] fd The file descriptor to read.
+ * @param[out] buffer Buffer with lines, inputs point into it.
+ * @param[out] inputs Allocated array of lines.
+ * @param[out] amount Amount of lines.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool read_inputs(int fd, struct Buffer* buffer, char*** inputs,
+                        size_t* amount) {
+    while (true) {
+        if (!reserve_chunk(buffer)) {
+            return false;
+        }
+        // Keep one byte for terminator of the last line
+        const ssize_t length = read(fd, buffer->data + buffer->used,
+                                    buffer->capacity - buffer->used - 1);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        } else if (length < 0) {
+            print_errno();
+            return false;
+        } else if (!length) {
+            break;
+        }
+        buffer->used += (size_t) length;
+    }
+    if (buffer->used && buffer->data[buffer->used - 1] != '\n') {
+        buffer->data[buffer->used++] = '\n';
+    }
+
+    size_t lines = 0;
+    for (size_t i = 0; i < buffer->used; ++i) {
+        lines += buffer->data[i] == '\n';
+    }
+    *inputs = malloc((lines ? lines : 1) * sizeof(char*));
+    if (!check_alloc(*inputs, "parallel inputs")) {
+        return false;
+    }
+
+    *amount = 0;
+    char* line = buffer->data;
+    char* end = buffer->data + buffer->used;
+    while (line < end) {
+        char* new_line = memchr(line, '\n', (size_t) (end - line));
+        *new_line = '\0';
+        (*inputs)[(*amount)++] = line;
+        line = new_line + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Counts placeholders in the string.
+ *
+ * @param[in] string The string to check.
+ *
+ * @return Amount of PLACEHOLDER occurrences.
+ */
+static size_t count_placeholders(const char string[]) {
+    size_t count = 0;
+    for (const char* p = strstr(string, PLACEHOLDER); p;
+         p = strstr(p + strlen(PLACEHOLDER), PLACEHOLDER)) {
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief Copies string replacing placeholders with input.
+ *
+ * @param[out] destination Where to write the result, terminator included.
+ * @param[in] string The string with placeholders.
+ * @param[in] input The input to substitute.
+ *
+ * @return Pointer past terminator of the result.
+ */
+static char* substitute(char destination[], const char string[],
+                        const char input[]) {
+    const char* placeholder;
+    while ((placeholder = strstr(string, PLACEHOLDER))) {
+        const size_t length = (size_t) (placeholder - string);
+        memcpy(destination, string, length);
+        destination = stpcpy(destination + length, input);
+        string = placeholder + strlen(PLACEHOLDER);
+    }
+    return stpcpy(destination, string) + 1;
+}
+
+/**
+ * @brief Builds command from template and input.
+ *
+ * @details Arguments array and strings share single allocation, so command
+ * is freed with free(command->args). Input is appended as the last argument
+ * if template has no placeholders.
+ *
+ * @param[in] scheduler The scheduler with template.
+ * @param[in] input The input to substitute.
+ * @param[out] command The command to build.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool build_command(const struct Scheduler* scheduler,
+                          const char input[], struct Command* command) {
+    const size_t input_length = strlen(input);
+    size_t placeholders = 0;
+    size_t size = 0;
+    for (size_t i = 0; i < scheduler->template_amount; ++i) {
+        const size_t count = count_placeholders(scheduler->template[i]);
+        placeholders += count;
+        size += strlen(scheduler->template[i]) + 1 +
+                count * input_length - count * strlen(PLACEHOLDER);
+    }
+    const bool is_appended = !placeholders;
+    if (is_appended) {
+        size += input_length + 1;
+    }
+
+    const size_t args_amount = scheduler->template_amount + is_appended + 1;
+    char** args = malloc(args_amount * sizeof(char*) + size);
+    if (!args) {
+        check_alloc(args, "parallel command");
+        return false;
+    }
+    char* end = (char*) (args + args_amount);
+    for (size_t i = 0; i < scheduler->template_amount; ++i) {
+        args[i] = end;
+        end = substitute(end, scheduler->template[i], input);
+    }
+    if (is_appended) {
+        args[scheduler->template_amount] = end;
+        memcpy(end, input, input_length + 1);
+    }
+    args[args_amount - 1] = NULL;
+
+    command->type = find_builtin(args[0]) ? BUILT_IN : EXTERNAL;
+    command->name = args[0];
+    for (size_t i = 0; i < TOTAL_STREAMS; ++i) {
+        command->redirect[i] = NULL;
+        command->multios[i] = NULL;
+    }
+    command->substitutions = NULL;
+    command->expansions = NULL;
+    command->assignments = NULL;
+    command->args = args;
+    command->args_amount = args_amount;
+    return true;
+}
+
+/**
+ * @brief Launches command for the next input in free slot.
+ *
+ * @details The process is added to the job before the event loop runs
+ * again, so it cannot be reaped unnoticed. Every slot reuses its own entry
+ * of job processes, so the job never holds more processes than slots.
+ *
+ * @param[in,out] scheduler The scheduler.
+ * @param[out] slot Free slot.
+ *
+ * @return False on fatal error, otherwise true.
+ */
+static bool launch_slot(struct Scheduler* scheduler, struct Slot* slot) {
+    const char* input = scheduler->inputs[scheduler->next++];
+    if (!build_command(scheduler, input, &slot->command)) {
+        return false;
+    }
+
+    int pipes[COLLECTED_STREAMS][2];
+    if (pipe2(pipes[COLLECTED_OUT], O_CLOEXEC)) {
+        print_errno();
+        free(slot->command.args);
+        return false;
+    }
+    if (pipe2(pipes[COLLECTED_ERR], O_CLOEXEC)) {
+        print_errno();
+        close(pipes[COLLECTED_OUT][0]);
+        close(pipes[COLLECTED_OUT][1]);
+        free(slot->command.args);
+        return false;
+    }
+
+    const int fds[TOTAL_STREAMS] = {
+            scheduler->input_fd, pipes[COLLECTED_OUT][1],
+            pipes[COLLECTED_ERR][1]
+    };
+    clock_gettime(CLOCK_MONOTONIC, &slot->started);
+    const pid_t pid = launch_command(&slot->command, fds, -1);
+
+    for (size_t i = 0; i < COLLECTED_STREAMS; ++i) {
+        close(pipes[i][1]);
+        slot->pipes[i] = pipes[i][0];
+        slot->output[i].used = 0;
+    }
+
+    slot->is_launched = pid >= 0;
+    if (pid >= 0 && slot->process != NO_PROCESS) {
+        start_process(&scheduler->job->processes[slot->process], pid);
+    } else if (pid >= 0 && add_process(scheduler->job, pid)) {
+        slot->process = scheduler->job->amount - 1;
+    } else if (pid >= 0) {
+        kill(pid, SIGKILL);
+        slot->is_launched = false;
+    }
+    slot->is_busy = true;
+    scheduler->running++;
+    return true;
+}
+
+/**
+ * @brief Reads available output of the command into slot buffer.
+ *
+ * @param[in,out] slot The slot to read output of.
+ * @param[in] stream The stream to read.
+ */
+static void read_output(struct Slot* slot, enum CollectedStream stream) {
+    struct Buffer* buffer = &slot->output[stream];
+    if (!reserve_chunk(buffer)) {
+        close(slot->pipes[stream]);
+        slot->pipes[stream] = -1;
+        return;
+    }
+    const ssize_t length = read(slot->pipes[stream],
+                                buffer->data + buffer->used,
+                                buffer->capacity - buffer->used);
+    if (length > 0) {
+        buffer->used += (size_t) length;
+    } else if (!length || errno != EINTR) {
+        close(slot->pipes[stream]);
+        slot->pipes[stream] = -1;
+    }
+}
+
+/**
+ * @brief Determine if command of the slot is done and its output is read.
+ *
+ * @param[in] scheduler The scheduler.
+ * @param[in] slot The slot to check.
+ *
+ * @return True if the slot can be finished.
+ */
+static bool is_slot_done(const struct Scheduler* scheduler,
+                         const struct Slot* slot) {
+    for (size_t i = 0; i < COLLECTED_STREAMS; ++i) {
+        if (slot->pipes[i] != -1) {
+            return false;
+        }
+    }
+    return !slot->is_launched ||
+           scheduler->job->processes[slot->process].state == DONE;
+}
+
+/**
+ * @brief Prints output of the slot command, its status and wall time.
+ *
+ * @param[in,out] scheduler The scheduler.
+ * @param[in,out] slot The slot to finish.
+ */
+static void finish_slot(struct Scheduler* scheduler, struct Slot* slot) {
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    const double wall = (double) (finished.tv_sec - slot->started.tv_sec) +
+                        (double) (finished.tv_nsec - slot->started.tv_nsec) /
+                        1e9;
+
+    int code = 127;
+    if (slot->is_launched) {
+        const int status = scheduler->job->processes[slot->process].status;
+        code = get_exit_code(status);
+        if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            scheduler->is_halted = true;
+        }
+    }
+    if (code) {
+        scheduler->failed++;
+    }
+
+    const int* fds = scheduler->fds;
+    write_buffer(fds[STDOUT_FILENO], slot->output[COLLECTED_OUT].data,
+                 slot->output[COLLECTED_OUT].used);
+    write_buffer(fds[STDERR_FILENO], slot->output[COLLECTED_ERR].data,
+                 slot->output[COLLECTED_ERR].used);
+
+    char* line = join_args(slot->command.args);
+    dprintf(fds[STDERR_FILENO], "%sparallel: %s: exit status %d, %.3f s%s\n",
+            code ? BOLD_RED : "", line ? line : slot->command.name, code,
+            wall, code ? RESET : "");
+    free(line);
+
+    free(slot->command.args);
+    slot->is_busy = false;
+    scheduler->running--;
+}
+
+/**
+ * @brief Runs commands until all inputs are done.
+ *
+ * @details Output pipes are polled by the event loop together with pidfds of
+ * the commands, so completion of a command always wakes scheduler up and is
+ * never missed.
+ *
+ * @param[in,out] scheduler The scheduler.
+ */
+static void run(struct Scheduler* scheduler) {
+    struct pollfd* polled = malloc(scheduler->slots_amount *
+                                   COLLECTED_STREAMS * sizeof(struct pollfd));
+    struct Slot** owners = malloc(scheduler->slots_amount *
+                                  COLLECTED_STREAMS * sizeof(struct Slot*));
+    if (!polled || !owners) {
+        check_alloc(NULL, "parallel poll set");
+        free(polled);
+        free(owners);
+        return;
+    }
+
+    while (true) {
+        for (size_t i = 0; i < scheduler->slots_amount &&
+                           !scheduler->is_halted &&
+                           scheduler->next < scheduler->inputs_amount; ++i) {
+            if (!scheduler->slots[i].is_busy &&
+                !launch_slot(scheduler, &scheduler->slots[i])) {
+                scheduler->is_halted = true;
+            }
+        }
+        if (!scheduler->running) {
+            break;
+        }
+
+        nfds_t amount = 0;
+        for (size_t i = 0; i < scheduler->slots_amount; ++i) {
+            struct Slot* slot = &scheduler->slots[i];
+            for (size_t j = 0; slot->is_busy && j < COLLECTED_STREAMS; ++j) {
+                if (slot->pipes[j] != -1) {
+                    polled[amount] = (struct pollfd) {
+                            slot->pipes[j], POLLIN, 0
+                    };
+                    owners[amount++] = slot;
+                }
+            }
+        }
+
+        if (wait_events(polled, amount) < 0) {
+            break;
+        }
+        for (nfds_t i = 0; i < amount; ++i) {
+            if (polled[i].revents) {
+                struct Slot* slot = owners[i];
+                read_output(slot, slot->pipes[COLLECTED_OUT] == polled[i].fd
+                                  ? COLLECTED_OUT : COLLECTED_ERR);
+            }
+        }
+        for (size_t i = 0; i < scheduler->slots_amount; ++i) {
+            struct Slot* slot = &scheduler->slots[i];
+            if (slot->is_busy && is_slot_done(scheduler, slot)) {
+                finish_slot(scheduler, slot);
+            }
+        }
+    }
+
+    free(polled);
+    free(owners);
+}
+
+int parallel_builtin(int argc, char* argv[], const int fds[]) {
+    long slots_amount = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    if (i < argc && !strncmp(argv[i], "-j", 2)) {
+        const char* value = argv[i][2] ? argv[i] + 2
+                                       : (i + 1 < argc) ? argv[++i] : NULL;
+        char* end = NULL;
+        slots_amount = value ? strtol(value, &end, 10) : 0;
+        if (!value || *end || slots_amount <= 0) {
+            print_builtin_error(fds, "parallel: -j requires positive number");
+            return USAGE_ERROR;
+        }
+        ++i;
+    }
+
+    struct Scheduler scheduler = {0};
+    scheduler.fds = fds;
+    scheduler.template = argv + i;
+    while (i < argc && strcmp(argv[i], SEPARATOR)) {
+        ++i;
+        scheduler.template_amount++;
+    }
+    if (!scheduler.template_amount) {
+        print_builtin_error(fds, "parallel: command is missing");
+        return USAGE_ERROR;
+    }
+
+    // Inputs come from arguments after separator, otherwise from stdin
+    struct Buffer lines = {0};
+    const bool is_stdin = i == argc;
+    if (!is_stdin) {
+        scheduler.inputs = argv + i + 1;
+        scheduler.inputs_amount = (size_t) (argc - i - 1);
+        scheduler.input_fd = fds[STDIN_FILENO];
+    } else {
+        if (!read_inputs(fds[STDIN_FILENO], &lines, &scheduler.inputs,
+                         &scheduler.inputs_amount)) {
+            free(lines.data);
+            return USAGE_ERROR;
+        }
+        scheduler.input_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    if (scheduler.inputs_amount && scheduler.input_fd >= 0) {
+        if ((size_t) slots_amount > scheduler.inputs_amount) {
+            slots_amount = (long) scheduler.inputs_amount;
+        }
+        scheduler.slots_amount = (size_t) slots_amount;
+        scheduler.slots = calloc(scheduler.slots_amount, sizeof(struct Slot));
+        for (size_t j = 0; scheduler.slots && j < scheduler.slots_amount; ++j) {
+            scheduler.slots[j].process = NO_PROCESS;
+        }
+        scheduler.job = create_job(join_args(argv), false);
+    }
+    if (scheduler.slots && scheduler.job) {
+        set_foreground_job(scheduler.job);
+        run(&scheduler);
+        set_foreground_job(NULL);
+    }
+
+    if (scheduler.job) {
+        remove_job(scheduler.job);
+    }
+    if (scheduler.slots) {
+        for (size_t j = 0; j < scheduler.slots_amount; ++j) {
+            for (size_t k = 0; k < COLLECTED_STREAMS; ++k) {
+                free(scheduler.slots[j].output[k].data);
+            }
+        }
+        free(scheduler.slots);
+    }
+    if (is_stdin) {
+        free(scheduler.inputs);
+        free(lines.data);
+        if (scheduler.input_fd >= 0) {
+            close(scheduler.input_fd);
+        }
+    }
+    return (int) (scheduler.failed < MAX_FAILED ? scheduler.failed
+                                                : MAX_FAILED);
+}
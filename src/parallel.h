@@ -0,0 +1,46 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file parallel.h
+ *
+ * @brief Job-slot scheduler running one command over many inputs.
+ *
+ * @see parallel.c
+ */
+
+#ifndef KARASHI_PARALLEL_H
+#define KARASHI_PARALLEL_H
+
+/**
+ * @brief Implementation of parallel built-in command.
+ *
+ * @details Usage: parallel [-j N] command [args] [::: inputs]. Each input
+ * replaces every "{}" in command and arguments, or is appended if there is
+ * no "{}". Without ":::" inputs are lines of stdin. At most N commands run at
+ * once, N is amount of online processors by default. Output of each command
+ * is collected and printed whole when the command is done, followed by its
+ * exit status and wall time on stderr.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Amount of failed commands, at most 253.
+ */
+int parallel_builtin(int argc, char* argv[], const int fds[]);
+
+#endif //KARASHI_PARALLEL_H
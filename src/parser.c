@@ -17,7 +17,8 @@
 /**
  * @file parser.c
  *
- * @brief Process tokens and allocate array of commands to execute.
+ * @brief Process tokens and allocate tree of commands to execute in line
+ * arena.
  */
 
 #include "parser.h"
@@ -28,256 +29,677 @@
 
 #include <unistd.h>
 
+#include "arena.h"
 #include "built-in.h"
+#include "pipesize.h"
+#include "trace.h"
 #include "utility.h"
 
 /**
  * @brief Used to return on fail in parse().
  */
-static const struct AbstractSyntaxTree EMPTY_AST = {NULL, 0};
+static const struct AbstractSyntaxTree EMPTY_AST = {NULL};
 
 /**
- * @brief Allocates memory for a new empty node for the AST.
+ * @brief Position of the parser in tokens.
+ */
+struct Parser {
+    struct Tokens tokens; ///< The tokens being parsed.
+    size_t index;         ///< Index of the current token.
+};
+
+/**
+ * @brief Determine if token separates pipelines.
  *
- * @param[in,out] ast The Abstract Syntax Tree.
+ * @param[in] kind Kind of the token.
  *
- * @return True if allocation succeeded, otherwise false.
+ * @return True for ";", "&", "&&" and "||".
  */
-static bool extend_ast(struct AbstractSyntaxTree* ast) {
-    if (!ast) {
-        return false;
+static bool is_list_operator(enum TokenKind kind) {
+    return kind == SEMICOLON || kind == BACKGROUND || kind == AND ||
+           kind == OR;
+}
+
+/**
+ * @brief Finds ")" closing process substitution.
+ *
+ * @details Scanner guarantees that every substitution is closed.
+ *
+ * @param[in] tokens The tokens to search.
+ * @param[in] index Index of "<(" or ">(" token.
+ *
+ * @return Index of the closing token.
+ */
+static size_t find_close(struct Tokens tokens, size_t index) {
+    size_t depth = 0;
+    for (; index < tokens.amount; ++index) {
+        const enum TokenKind kind = tokens.data[index].kind;
+        if (kind == PROCESS_IN || kind == PROCESS_OUT) {
+            ++depth;
+        } else if (kind == CLOSE && !--depth) {
+            break;
+        }
     }
+    return index;
+}
 
-    ast->nodes = realloc(ast->nodes,
-                         (ast->amount + 1) * sizeof(struct Command));
-    if (!check_alloc(ast->nodes, "node")) {
-        return false;
+/**
+ * @brief Counts commands of the pipeline starting at index.
+ *
+ * @param[in] tokens The tokens to count.
+ * @param[in] index Index of the first token of the pipeline.
+ *
+ * @return Amount of commands.
+ */
+static size_t count_commands(struct Tokens tokens, size_t index) {
+    size_t amount = 1;
+    for (; index < tokens.amount; ++index) {
+        const enum TokenKind kind = tokens.data[index].kind;
+        if (is_list_operator(kind)) {
+            break;
+        } else if (kind == PROCESS_IN || kind == PROCESS_OUT) {
+            index = find_close(tokens, index);
+        }
+        amount += kind == PIPE;
+    }
+    return amount;
+}
+
+/**
+ * @brief Counts arguments of the command starting at index.
+ *
+ * @param[in] tokens The tokens to count.
+ * @param[in] index Index of the first token of the command.
+ *
+ * @return Upper bound of arguments including terminating NULL.
+ */
+static size_t count_args(struct Tokens tokens, size_t index) {
+    size_t amount = 1;
+    for (; index < tokens.amount; ++index) {
+        const enum TokenKind kind = tokens.data[index].kind;
+        if (kind == PIPE || is_list_operator(kind)) {
+            break;
+        } else if (kind == PROCESS_IN || kind == PROCESS_OUT) {
+            index = find_close(tokens, index);
+        }
+        ++amount;
     }
+    return amount;
+}
 
-    struct Command* node = &ast->nodes[ast->amount];
+/**
+ * @brief Initializes a new empty command of the pipeline.
+ *
+ * @details Command array and arguments array are preallocated, so nothing
+ * is reallocated during parsing.
+ *
+ * @param[in,out] pipeline The pipeline.
+ * @param[in] args_capacity Amount of arguments to allocate.
+ *
+ * @return Pointer to the new command, or NULL if allocation failed.
+ */
+static struct Command* extend_pipeline(struct Pipeline* pipeline,
+                                       size_t args_capacity) {
+    struct Command* node = &pipeline->nodes[pipeline->amount];
 
     node->type = UNKNOWN;
     node->name = NULL;
     for (size_t i = 0; i < TOTAL_STREAMS; ++i) {
         node->redirect[i] = NULL;
+        node->multios[i] = NULL;
     }
-    node->args = NULL;
+    node->substitutions = NULL;
+    node->expansions = NULL;
+    node->assignments = NULL;
+    node->args = arena_alloc(&line_arena, args_capacity * sizeof(char*));
     node->args_amount = 0;
-    ast->amount++;
+    if (!node->args) {
+        return NULL;
+    }
+    pipeline->amount++;
 
-    return true;
+    return node;
+}
+
+/**
+ * @brief Appends argument to command.
+ *
+ * @param[in,out] node The command node to add the argument to.
+ * @param[in] arg The argument to add to the command, NULL for terminator.
+ */
+static void add_arg(struct Command* node, char* arg) {
+    node->args[node->args_amount++] = arg;
 }
 
 /**
- * @brief Allocates memory for name for Command node and assigns value to it.
+ * @brief Remembers word of the command to expand when it is launched.
  *
- * @param[in,out] node The node to add the name to.
- * @param[in] name The name of the command.
+ * @param[in,out] node The command the word belongs to.
+ * @param[in] std_stream Redirected stream, -1 for argument.
+ * @param[in] index Index of the argument or of the stream output.
  *
- * @return True if allocation succeeded, otherwise false.
+ * @return True on success, otherwise false.
  */
-static bool add_name(struct Command* node, const char* name) {
-    if (!node) {
+static bool add_expansion(struct Command* node, int std_stream, size_t index) {
+    struct Expansion* expansion = arena_alloc(&line_arena,
+                                              sizeof(struct Expansion));
+    if (!expansion) {
         return false;
     }
+    expansion->std_stream = std_stream;
+    expansion->index = index;
+    expansion->next = node->expansions;
+    node->expansions = expansion;
+    return true;
+}
 
-    node->name = malloc(strlen(name) + 1);
-    if (!check_alloc(node->name, "node name")) {
-        return false;
+/**
+ * @brief Splits assignment word into name and value.
+ *
+ * @param[in] token The word token starting with "NAME=".
+ *
+ * @return The assignment, or NULL if allocation failed.
+ */
+static struct Assignment* new_assignment(const struct Token* token) {
+    struct Assignment* assignment = arena_alloc(&line_arena,
+                                                sizeof(struct Assignment));
+    if (!assignment) {
+        return NULL;
     }
-    strcpy(node->name, name);
-    return true;
+    // Name has no quotes, so "=" is in place even in unquoted word
+    char* equals = strchr(token->text, '=');
+    *equals = '\0';
+    assignment->name = token->text;
+    assignment->value = equals + 1;
+    assignment->is_expandable = token->is_expandable;
+    assignment->next = NULL;
+    return assignment;
 }
 
 /**
- * @brief Allocates memory for new argument and assigns value to it.
+ * @brief Placeholder name of command without name.
+ */
+static char NO_NAME[] = "";
+
+/**
+ * @brief Adds a new command to the pipeline from its leading assignments and
+ * name.
  *
- * @param[in,out] node The command node to add the argument to.
- * @param[in] arg The argument to add to the command.
+ * @details Command with only assignments is ASSIGNMENT command. Expandable
+ * name is resolved when command is launched.
  *
- * @return True if allocation succeeded, otherwise false.
+ * @param[in,out] pipeline The pipeline to add the command to.
+ * @param[in] tokens The tokens being parsed.
+ * @param[in,out] index Index of the first word of the command, moved past
+ * the name.
+ *
+ * @return A pointer to the new command in pipeline, or NULL on failure.
  */
-static bool add_arg(struct Command* node, const char* arg) {
-    node->args = realloc(node->args, (node->args_amount + 1) * sizeof(char*));
-    if (!check_alloc(node->args, "node args")) {
-        return false;
+static struct Command* add_node(struct Pipeline* pipeline,
+                                struct Tokens tokens, size_t* index) {
+    size_t i = *index;
+    struct Command* node = extend_pipeline(pipeline, count_args(tokens, i));
+    if (!node) {
+        return NULL;
     }
 
-    if (strlen(arg)) {
-        node->args[node->args_amount] = malloc(strlen(arg) + 1);
-        if (!check_alloc(node->args[node->args_amount], "node arg")) {
-            return false;
+    struct Assignment** last = &node->assignments;
+    for (; i < tokens.amount && tokens.data[i].kind == WORD &&
+           tokens.data[i].is_assignment; ++i) {
+        if (!(*last = new_assignment(&tokens.data[i]))) {
+            return NULL;
         }
-        strcpy(node->args[node->args_amount], arg);
+        last = &(*last)->next;
+    }
 
+    if (i == tokens.amount || tokens.data[i].kind != WORD) {
+        node->type = ASSIGNMENT;
+        node->name = NO_NAME;
     } else {
-        node->args[node->args_amount] = NULL;
+        const struct Token* name = &tokens.data[i++];
+        if (name->is_expandable && !add_expansion(node, -1, 0)) {
+            return NULL;
+        }
+        node->name = name->text;
+        add_arg(node, node->name);
+        node->type = (!name->is_expandable && find_builtin(node->name))
+                     ? BUILT_IN : EXTERNAL;
     }
-
-    node->args_amount++;
-
-    return true;
+    *index = i;
+    return node;
 }
 
 /**
- * @brief Adds a new node to the AST, and initializes it.
+ * @brief Allocates tree node in line arena.
  *
- * @param[in,out] ast The Abstract Syntax Tree to add the node to.
- * @param[in] node_name The name of the command to be added.
+ * @param[in] type Type of the node.
+ * @param[in] left Left operand.
+ * @param[in] right Right operand.
  *
- * @return A pointer to the new node in AST.
+ * @return The new node, or NULL if allocation failed.
  */
-static struct Command* add_node(struct AbstractSyntaxTree* ast,
-                                const char* node_name) {
-    if (!extend_ast(ast)) {
+static struct Node* new_node(enum NodeType type, struct Node* left,
+                             struct Node* right) {
+    struct Node* node = arena_alloc(&line_arena, sizeof(struct Node));
+    if (!node) {
         return NULL;
     }
+    node->type = type;
+    node->pipeline.nodes = NULL;
+    node->pipeline.amount = 0;
+    node->pipeline.time_format = NO_TIME;
+    node->pipeline.pipe_size = 0;
+    node->left = left;
+    node->right = right;
+    return node;
+}
 
-    struct Command* node = &ast->nodes[ast->amount - 1];
-    if (!add_name(node, node_name) ||
-        !add_arg(node, node_name)) {
-        return NULL;
-    }
+/**
+ * @brief Releases line arena and returns empty AST.
+ *
+ * @details Used in exceptional cases in the parse() function.
+ *
+ * @return EMPTY_AST.
+ */
+static struct AbstractSyntaxTree fail(void) {
+    arena_reset(&line_arena);
+    return EMPTY_AST;
+}
 
-    node->type = is_in_table(node->name) ? BUILT_IN : EXTERNAL;
+/**
+ * @brief Prints syntax error message.
+ *
+ * @param[in] tokens The tokens being parsed.
+ * @param[in] index Index of unexpected token, tokens.amount for end of line.
+ *
+ * @return NULL, so callers can return the result.
+ */
+static struct Node* syntax_error(struct Tokens tokens, size_t index) {
+    printf(BOLD_RED);
+    if (index == tokens.amount) {
+        printf("kara: syntax error near end of line\n");
+    } else {
+        const struct Token* token = &tokens.data[index];
+        printf("kara: syntax error near %.*s\n",
+               (int) token->length, tokens.line + token->offset);
+    }
+    printf(RESET);
+    return NULL;
+}
 
-    return node;
+/**
+ * @brief Determine if token is unquoted word without expansions.
+ *
+ * @param[in] tokens The tokens being parsed.
+ * @param[in] index Index of the token, may be out of range.
+ * @param[in] word The word to compare with.
+ *
+ * @return True if token is the word.
+ */
+static bool is_keyword(struct Tokens tokens, size_t index, const char word[]) {
+    const struct Token* token = &tokens.data[index];
+    return index < tokens.amount && token->kind == WORD &&
+           !token->is_quoted && !token->is_expandable &&
+           !strcmp(token->text, word);
 }
 
 /**
- * @brief Allocates and sets file path to redirect to for specific stream.
+ * @brief Adds output redirection of the command.
  *
- * @param[in,out] node The command node to add the redirection to.
- * @param[in] file_path The path to the file to redirect to.
- * @param[in] stream_index 0 for stdin, 1 for stdout, 2 for stderr.
+ * @details The first path of stream is stored in redirect, the next ones are
+ * appended to multios and the stream is copied to all of them. Input
+ * redirection is replaced by the last one.
  *
- * @return True if allocation succeeded, otherwise false.
+ * @param[in,out] node The command to redirect.
+ * @param[in] std_stream The stream to redirect.
+ * @param[in] path The word token of file path to redirect to.
+ *
+ * @return True on success, otherwise false.
  */
-static bool add_redirection(struct Command* node,
-                            const char* file_path,
-                            int stream_index) {
-    node->redirect[stream_index] = malloc(strlen(file_path) + 1);
-    if (!check_alloc(node->redirect[stream_index], "std stream redirect")) {
+static bool add_redirect(struct Command* node, int std_stream,
+                         const struct Token* path) {
+    if (std_stream == STDIN_FILENO) {
+        // Replaced input must not be expanded again
+        struct Expansion** link = &node->expansions;
+        while (*link && (*link)->std_stream != STDIN_FILENO) {
+            link = &(*link)->next;
+        }
+        if (*link) {
+            *link = (*link)->next;
+        }
+    }
+
+    size_t index = 0;
+    if (std_stream != STDIN_FILENO && node->redirect[std_stream]) {
+        for (const struct Multio* multio = node->multios[std_stream]; multio;
+             multio = multio->next) {
+            ++index;
+        }
+        ++index;
+    }
+    if (path->is_expandable && !add_expansion(node, std_stream, index)) {
+        return false;
+    }
+    if (!index) {
+        node->redirect[std_stream] = path->text;
+        return true;
+    }
+
+    struct Multio* multio = arena_alloc(&line_arena, sizeof(struct Multio));
+    if (!multio) {
         return false;
     }
-    strcpy(node->redirect[stream_index], file_path);
+    multio->path = path->text;
+    multio->next = NULL;
+
+    struct Multio** last = &node->multios[std_stream];
+    while (*last) {
+        last = &(*last)->next;
+    }
+    *last = multio;
     return true;
 }
 
+static struct Node* parse_list(struct Parser* parser);
+
+/**
+ * @brief Placeholders of substituted arguments, shown in job descriptions.
+ */
+static char PROCESS_IN_TEXT[] = "<(...)";
+static char PROCESS_OUT_TEXT[] = ">(...)";
+
 /**
- * @brief Checks if the sequence of nodes is allowed.
+ * @brief Parses process substitution of the command.
  *
- * @details Verify that built-in commands is not used in pipe sequence.
+ * @details List inside of parentheses is parsed by the same rules as the
+ * whole line. Argument or redirection gets placeholder, which is replaced by
+ * the pipe when command is launched.
  *
- * @param[in] ast The Abstract Syntax Tree to check.
+ * @param[in,out] node The command to add substitution to.
+ * @param[in] tokens The tokens being parsed.
+ * @param[in,out] index Index of "<(" or ">(" token, set to index of ")".
+ * @param[in] std_stream Redirected stream, -1 for argument.
  *
- * @return True if no built-in commands occurred in pipeline, otherwise false.
+ * @return True on success, otherwise false.
  */
-static bool is_allowed_sequence(struct AbstractSyntaxTree ast) {
-    if (ast.amount > 1 && ast.nodes[0].type == BUILT_IN) {
+static bool add_substitution(struct Command* node, struct Tokens tokens,
+                             size_t* index, int std_stream) {
+    const size_t close = find_close(tokens, *index);
+    const struct Tokens inner = {
+            tokens.state, tokens.line, tokens.data + *index + 1,
+            close - *index - 1
+    };
+    if (!inner.amount) {
+        syntax_error(tokens, close);
         return false;
     }
-    for (size_t i = 1; i < ast.amount; ++i) {
-        if (ast.nodes[i].type == BUILT_IN) {
-            return false;
-        }
+    struct Parser parser = {inner, 0};
+    struct Node* list = parse_list(&parser);
+    if (!list) {
+        return false;
+    }
+
+    struct Substitution* substitution = arena_alloc(
+            &line_arena, sizeof(struct Substitution));
+    if (!substitution) {
+        return false;
+    }
+    substitution->list = list;
+    substitution->is_output = tokens.data[*index].kind == PROCESS_OUT;
+    substitution->std_stream = std_stream;
+    substitution->arg = node->args_amount;
+    substitution->next = node->substitutions;
+    node->substitutions = substitution;
+
+    char* placeholder = substitution->is_output ? PROCESS_OUT_TEXT
+                                                : PROCESS_IN_TEXT;
+    if (std_stream == -1) {
+        add_arg(node, placeholder);
+    } else {
+        node->redirect[std_stream] = placeholder;
     }
+    *index = close;
     return true;
 }
 
 /**
- * @brief Frees the memory allocated for the Tokens and AbstractSyntaxTree
- * structures.
+ * @brief Determine if token starts process substitution.
  *
- * @details Used in exceptional cases in the parse() function.
+ * @param[in] tokens The tokens being parsed.
+ * @param[in] index Index of the token, may be out of range.
  *
- * @param[in] tokens The Tokens to free.
- * @param[in] ast The AbstractSyntaxTree to free.
+ * @return True for "<(" and ">(".
  */
-static void free_resources(struct Tokens tokens,
-                           struct AbstractSyntaxTree ast) {
-    free_tokens(tokens);
-    free_ast(ast);
+static bool is_substitution(struct Tokens tokens, size_t index) {
+    return index < tokens.amount && (tokens.data[index].kind == PROCESS_IN ||
+                                     tokens.data[index].kind == PROCESS_OUT);
 }
 
-struct AbstractSyntaxTree parse(struct Tokens tokens) {
-    if (tokens.state != VALID) {
-        return EMPTY_AST;
+/**
+ * @brief Skips "time" keyword in front of pipeline.
+ *
+ * @details "time" is a keyword only when a command follows it, otherwise it
+ * is an ordinary command name.
+ *
+ * @param[in] tokens The tokens being parsed.
+ * @param[in,out] index Index of the first token of pipeline, moved past the
+ * keyword and its option.
+ *
+ * @return Report format of the pipeline.
+ */
+static enum TimeFormat parse_time(struct Tokens tokens, size_t* index) {
+    if (!is_keyword(tokens, *index, "time")) {
+        return NO_TIME;
+    }
+    size_t i = *index + 1;
+    enum TimeFormat format = HUMAN_TIME;
+    if (is_keyword(tokens, i, "-p")) {
+        format = PORTABLE_TIME;
+        ++i;
+    }
+    if (i == tokens.amount || tokens.data[i].kind != WORD) {
+        return NO_TIME;
+    }
+    *index = i;
+    return format;
+}
+
+/**
+ * @brief Skips "pipesize SIZE" keyword in front of pipeline.
+ *
+ * @details "pipesize" is a keyword only when valid size and a command follow
+ * it, otherwise it is an ordinary command name.
+ *
+ * @param[in] tokens The tokens being parsed.
+ * @param[in,out] index Index of the first token of pipeline, moved past the
+ * keyword and its size.
+ *
+ * @return Capacity of pipes, 0 if there is no keyword.
+ */
+static size_t parse_pipe_size(struct Tokens tokens, size_t* index) {
+    size_t size;
+    if (!is_keyword(tokens, *index, "pipesize") ||
+        *index + 2 >= tokens.amount ||
+        tokens.data[*index + 1].kind != WORD ||
+        !read_pipe_size(tokens.data[*index + 1].text, &size) ||
+        tokens.data[*index + 2].kind != WORD) {
+        return 0;
     }
+    *index += 2;
+    return size;
+}
 
-    struct AbstractSyntaxTree ast = {NULL, 0};
+/**
+ * @brief Parses commands piped to each other.
+ *
+ * @param[in,out] parser The parser, stops at list operator or end of line.
+ *
+ * @return PIPELINE_NODE, or NULL on error.
+ */
+static struct Node* parse_pipeline(struct Parser* parser) {
+    const struct Tokens tokens = parser->tokens;
+    size_t i = parser->index;
+    const enum TimeFormat time_format = parse_time(tokens, &i);
+    const size_t pipe_size = parse_pipe_size(tokens, &i);
+    if (i == tokens.amount || tokens.data[i].kind != WORD) {
+        return syntax_error(tokens, i);
+    }
 
-    struct Command* node = add_node(&ast, tokens.data[0]);
+    struct Node* pipeline = new_node(PIPELINE_NODE, NULL, NULL);
+    if (!pipeline) {
+        return NULL;
+    }
+    pipeline->pipeline.time_format = time_format;
+    pipeline->pipeline.pipe_size = pipe_size;
+    pipeline->pipeline.nodes = arena_alloc(&line_arena,
+                                           count_commands(tokens, i) *
+                                           sizeof(struct Command));
+    if (!pipeline->pipeline.nodes) {
+        return NULL;
+    }
+
+    struct Command* node = add_node(&pipeline->pipeline, tokens, &i);
     if (!node) {
-        free_resources(tokens, ast);
-        return EMPTY_AST;
+        return NULL;
     }
 
-    size_t i = 1;
-    while (i < tokens.amount) {
+    while (i < tokens.amount && !is_list_operator(tokens.data[i].kind)) {
+        const enum TokenKind kind = tokens.data[i].kind;
         int std_stream = -1;
-        if (!strcmp(tokens.data[i], "<")) {
+        if (kind == REDIRECT_IN) {
             std_stream = STDIN_FILENO;
-        } else if (!strcmp(tokens.data[i], ">")) {
+        } else if (kind == REDIRECT_OUT) {
             std_stream = STDOUT_FILENO;
-        } else if (!strcmp(tokens.data[i], "2>")) {
+        } else if (kind == REDIRECT_ERR) {
             std_stream = STDERR_FILENO;
         }
         if (std_stream != -1) {
-            if (++i == tokens.amount ||
-                !add_redirection(node, tokens.data[i], std_stream)) {
-                free_resources(tokens, ast);
-                return EMPTY_AST;
+            if (++i == tokens.amount || (tokens.data[i].kind != WORD &&
+                                         !is_substitution(tokens, i))) {
+                return syntax_error(tokens, i);
+            }
+            if (is_substitution(tokens, i)) {
+                if (!add_substitution(node, tokens, &i, std_stream)) {
+                    return NULL;
+                }
+            } else if (!add_redirect(node, std_stream, &tokens.data[i])) {
+                return NULL;
+            }
+
+        } else if (is_substitution(tokens, i)) {
+            if (!add_substitution(node, tokens, &i, -1)) {
+                return NULL;
             }
 
-        } else if (!strcmp(tokens.data[i], "|")) {
+        } else if (kind == PIPE) {
             // Add NULL as last argument in previous node
-            add_arg(node, "");
+            add_arg(node, NULL);
 
-            if (++i == tokens.amount ||
-                !(node = add_node(&ast, tokens.data[i]))) {
-                free_resources(tokens, ast);
-                return EMPTY_AST;
+            if (++i == tokens.amount || tokens.data[i].kind != WORD) {
+                return syntax_error(tokens, i);
+            }
+            if (!(node = add_node(&pipeline->pipeline, tokens, &i))) {
+                return NULL;
             }
+            continue;
 
-        } else if (!add_arg(node, tokens.data[i])) {
-            free_resources(tokens, ast);
-            return EMPTY_AST;
+        } else {
+            if (tokens.data[i].is_expandable &&
+                !add_expansion(node, -1, node->args_amount)) {
+                return NULL;
+            }
+            add_arg(node, tokens.data[i].text);
         }
         ++i;
     }
     // Add NULL as last argument in last node
-    add_arg(node, "");
-
-    if (!is_allowed_sequence(ast)) {
-        printf(BOLD_RED);
-        printf("kara: built-in commands are not allowed to use with pipes\n");
-        printf(RESET);
-        free_resources(tokens, ast);
-        return EMPTY_AST;
-    }
+    add_arg(node, NULL);
 
-    free_tokens(tokens);
-    return ast;
+    parser->index = i;
+    return pipeline;
 }
 
-void free_ast(struct AbstractSyntaxTree ast) {
-    if (!ast.nodes) {
-        return;
-    }
+/**
+ * @brief Parses pipelines joined with "&&" and "||".
+ *
+ * @param[in,out] parser The parser, stops at ";", "&" or end of line.
+ *
+ * @return The chain, or NULL on error.
+ */
+static struct Node* parse_and_or(struct Parser* parser) {
+    struct Node* left = parse_pipeline(parser);
 
-    for (size_t i = 0; i < ast.amount; ++i) {
-        free(ast.nodes[i].name);
+    while (left && parser->index < parser->tokens.amount) {
+        const enum TokenKind kind = parser->tokens.data[parser->index].kind;
+        if (kind != AND && kind != OR) {
+            break;
+        }
+        parser->index++;
 
-        for (size_t j = 0; j < ast.nodes[i].args_amount; ++j) {
-            free(ast.nodes[i].args[j]);
+        struct Node* right = parse_pipeline(parser);
+        if (!right) {
+            return NULL;
         }
-        free(ast.nodes[i].args);
+        left = new_node((kind == AND) ? AND_NODE : OR_NODE, left, right);
+    }
+    return left;
+}
 
-        for (size_t j = 0; j < TOTAL_STREAMS; ++j) {
-            free(ast.nodes[i].redirect[j]);
+/**
+ * @brief Parses and-or chains separated by ";" and "&".
+ *
+ * @details Trailing separator is allowed.
+ *
+ * @param[in,out] parser The parser.
+ *
+ * @return Root of the list, or NULL on error.
+ */
+static struct Node* parse_list(struct Parser* parser) {
+    struct Node* root = NULL;
+
+    while (parser->index < parser->tokens.amount) {
+        struct Node* node = parse_and_or(parser);
+        if (!node) {
+            return NULL;
+        }
+        if (parser->index < parser->tokens.amount &&
+            parser->tokens.data[parser->index++].kind == BACKGROUND &&
+            !(node = new_node(BACKGROUND_NODE, node, NULL))) {
+            return NULL;
+        }
+        if (root && !(root = new_node(SEQUENCE_NODE, root, node))) {
+            return NULL;
+        }
+        if (!root) {
+            root = node;
         }
     }
+    return root;
+}
 
-    free(ast.nodes);
+struct AbstractSyntaxTree parse(struct Tokens tokens) {
+    if (tokens.state != VALID) {
+        return EMPTY_AST;
+    }
+    if (!tokens.amount) {
+        return fail();
+    }
+
+    const uint64_t start = is_tracing ? trace_now() : 0;
+    struct Parser parser = {tokens, 0};
+    struct AbstractSyntaxTree ast = {parse_list(&parser)};
+    if (is_tracing) {
+        trace_span("parse", "shell", start, trace_now(), 0, NULL);
+    }
+    if (!ast.root) {
+        return fail();
+    }
+    return ast;
+}
+
+void free_ast(struct AbstractSyntaxTree ast) {
+    if (!ast.root) {
+        return;
+    }
+    arena_reset(&line_arena);
 }
@@ -17,8 +17,8 @@
 /**
  * @file parser.h
  *
- * @brief Tokens parsing and definition of Command and AbstractSyntaxTree
- * structures.
+ * @brief Tokens parsing and definition of Command, Pipeline and
+ * AbstractSyntaxTree structures.
  *
  * @see parser.c
  */
@@ -36,31 +36,131 @@
 enum CommandType {
     BUILT_IN, ///< Functionality that is not stored as separate executable.
     EXTERNAL, ///< Executable program that is stored somewhere on drive.
+    ASSIGNMENT, ///< Only variable assignments, executed inside shell.
     UNKNOWN, ///<  Represent command with not specified yet type.
 };
 
+/**
+ * @brief Additional output redirection of the same stream, "> a > b".
+ */
+struct Multio {
+    char* path;          ///< File path to redirect to.
+    struct Multio* next; ///< Next redirection, NULL for the last one.
+};
+
+struct Node;
+
+/**
+ * @brief Process substitution "<(list)" or ">(list)".
+ *
+ * @details Command gets /dev/fd/N path of a pipe to the list instead of the
+ * argument, or the pipe itself as redirected stream.
+ */
+struct Substitution {
+    struct Node* list;         ///< Commands to run in subshell.
+    bool is_output;            ///< True for ">(list)", command writes to it.
+    int std_stream;            ///< Redirected stream, -1 for argument.
+    size_t arg;                ///< Index of the argument.
+    struct Substitution* next; ///< Next substitution of the command.
+};
+
+/**
+ * @brief Word of the command, which is expanded when command is launched.
+ *
+ * @details The word keeps quotes and "$" of the line until expansion.
+ */
+struct Expansion {
+    int std_stream;         ///< Redirected stream, -1 for argument.
+    size_t index;           ///< Index of the argument, or of stream output,
+                            ///< 0 for redirect and N for N-th multio.
+    struct Expansion* next; ///< Next expansion of the command.
+};
+
+/**
+ * @brief Variable assignment "NAME=value" in front of the command.
+ */
+struct Assignment {
+    char* name;              ///< Name of the variable.
+    char* value;             ///< Value, raw if it is expandable.
+    bool is_expandable;      ///< True if value must be expanded.
+    struct Assignment* next; ///< Next assignment in order of the line.
+};
+
 /**
  * @brief Single command to execute.
+ *
+ * @details Assignments of ASSIGNMENT command change shell variables, others
+ * are exported to the command only.
  */
 struct Command {
     enum CommandType type;         ///< Represent type of Command structure.
     char* name;                    ///< Name of the command.
     char* redirect[TOTAL_STREAMS]; ///< File paths to redirect to.
+    struct Multio* multios[TOTAL_STREAMS]; ///< Outputs after the first one.
+    struct Substitution* substitutions;    ///< Process substitutions.
+    struct Expansion* expansions;          ///< Words to expand.
+    struct Assignment* assignments;        ///< Leading assignments.
     char** args;                   ///< Array of command arguments.
     size_t args_amount;            ///< Amount of arguments.
 };
 
+/**
+ * @brief Report format of "time" keyword.
+ */
+enum TimeFormat {
+    NO_TIME,       ///< Pipeline is not timed.
+    HUMAN_TIME,    ///< Table for humans, "time".
+    PORTABLE_TIME, ///< Key-value lines for scripts, "time -p".
+};
+
 /**
  * @brief Array of Command structures, each command is piped to next one.
  */
+struct Pipeline {
+    struct Command* nodes;        ///< Array of Commands.
+    size_t amount;                ///< Amount of nodes in array.
+    enum TimeFormat time_format;  ///< Report format if pipeline is timed.
+    size_t pipe_size;             ///< Capacity of pipes, 0 for default.
+};
+
+/**
+ * @brief Type of Node structure.
+ */
+enum NodeType {
+    PIPELINE_NODE,   ///< Single pipeline, leaf of the tree.
+    SEQUENCE_NODE,   ///< Left then right, operator ";".
+    AND_NODE,        ///< Right only if left succeeded, operator "&&".
+    OR_NODE,         ///< Right only if left failed, operator "||".
+    BACKGROUND_NODE, ///< Left without waiting for it, operator "&".
+};
+
+/**
+ * @brief Node of AbstractSyntaxTree.
+ */
+struct Node {
+    enum NodeType type;       ///< Represent type of Node structure.
+    struct Pipeline pipeline; ///< Pipeline of PIPELINE_NODE.
+    struct Node* left;        ///< Left operand, NULL for PIPELINE_NODE.
+    struct Node* right;       ///< Right operand, NULL for leaves and "&".
+};
+
+/**
+ * @brief Tree of the whole input line.
+ *
+ * @details Lists are built of SEQUENCE_NODE and BACKGROUND_NODE, their
+ * operands are and-or chains of AND_NODE and OR_NODE, and leaves are
+ * pipelines. Binary operators are left associative.
+ */
 struct AbstractSyntaxTree {
-    struct Command* nodes; ///< Array of Commands.
-    size_t amount;         ///< Amount of nodes in array.
+    struct Node* root; ///< Root of the tree, NULL for empty line.
 };
 
 /**
  * @brief Parses the Tokens and build AbstractSyntaxTree.
  *
+ * @details Commands refer to token strings instead of copying them, nodes
+ * are allocated in line_arena.
+ *
  * @param[in] tokens The tokens to parse.
  *
  * @return A struct AbstractSyntaxTree.
@@ -70,6 +170,9 @@ struct AbstractSyntaxTree parse(struct Tokens tokens);
 /**
  * @brief Frees the memory allocated for the AST.
  *
+ * @details AbstractSyntaxTree and Tokens it was parsed from share line_arena,
+ * so both are released with a single reset.
+ *
  * @param[in] ast The AbstractSyntaxTree to free.
  */
 void free_ast(struct AbstractSyntaxTree ast);
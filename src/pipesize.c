@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file pipesize.c
+ *
+ * @brief Capacity of pipes created between pipeline stages.
+ *
+ * @details Large pipes let producer and consumer run longer without context
+ * switches, which matters for pipelines moving gigabytes of data.
+ */
+
+#define _GNU_SOURCE
+
+#include "pipesize.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <fcntl.h>
+
+#include "utility.h"
+#include "variables.h"
+
+#define PIPE_MAX_SIZE_PATH "/proc/sys/fs/pipe-max-size" ///< Limit of size.
+#define FALLBACK_MAX_SIZE (1024 * 1024) ///< Kernel default of the limit.
+
+bool read_pipe_size(const char text[], size_t* size) {
+    if (!isdigit((unsigned char) text[0])) {
+        return false;
+    }
+    char* end;
+    const unsigned long long value = strtoull(text, &end, 10);
+
+    unsigned long long unit = 1;
+    if (*end == 'K' || *end == 'k') {
+        unit = 1024;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        unit = 1024 * 1024;
+        ++end;
+    }
+    if (*end || !value || value > SIZE_MAX / unit) {
+        return false;
+    }
+    *size = (size_t) (value * unit);
+    return true;
+}
+
+size_t get_pipe_size(size_t requested) {
+    if (requested) {
+        return requested;
+    }
+    const char* value = get_variable(PIPE_SIZE_ENV, strlen(PIPE_SIZE_ENV));
+    size_t size;
+    if (!value || !*value) {
+        return 0;
+    } else if (!read_pipe_size(value, &size)) {
+        printf(BOLD_RED "kara: invalid %s value %s" RESET "\n",
+               PIPE_SIZE_ENV, value);
+        return 0;
+    }
+    return size;
+}
+
+/**
+ * @brief Reads limit of pipe size for unprivileged processes once.
+ *
+ * @return Maximal size of pipe.
+ */
+static size_t get_max_size(void) {
+    static size_t max_size = 0;
+    if (max_size) {
+        return max_size;
+    }
+
+    max_size = FALLBACK_MAX_SIZE;
+    FILE* file = fopen(PIPE_MAX_SIZE_PATH, "re");
+    if (file) {
+        size_t value;
+        if (fscanf(file, "%zu", &value) == 1 && value) {
+            max_size = value;
+        }
+        fclose(file);
+    }
+    return max_size;
+}
+
+void resize_pipe(int fd, size_t size) {
+    if (!size) {
+        return;
+    }
+    const size_t max_size = get_max_size();
+    if (size > max_size) {
+        size = max_size;
+    }
+    // Kernel rounds size up to power of two pages, failure keeps default
+    fcntl(fd, F_SETPIPE_SZ, (int) size);
+}
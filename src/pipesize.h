@@ -0,0 +1,65 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file pipesize.h
+ *
+ * @brief Capacity of pipes created between pipeline stages.
+ *
+ * @see pipesize.c
+ */
+
+#ifndef KARASHI_PIPESIZE_H
+#define KARASHI_PIPESIZE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PIPE_SIZE_ENV "KARA_PIPE_SIZE" ///< Shell variable for default.
+
+/**
+ * @brief Converts size like "65536", "256K" or "1M" to bytes.
+ *
+ * @param[in] text The size to convert.
+ * @param[out] size Converted size.
+ *
+ * @return True if text is valid non-zero size, otherwise false.
+ */
+bool read_pipe_size(const char text[], size_t* size);
+
+/**
+ * @brief Chooses capacity of pipes of pipeline.
+ *
+ * @param[in] requested Size requested by "pipesize" keyword, 0 for none.
+ *
+ * @return Requested size, otherwise value of KARA_PIPE_SIZE, 0 to leave
+ * default capacity.
+ */
+size_t get_pipe_size(size_t requested);
+
+/**
+ * @brief Sets capacity of the pipe.
+ *
+ * @details Size is clamped to /proc/sys/fs/pipe-max-size, which is the limit
+ * for unprivileged processes. Failure leaves default capacity.
+ *
+ * @param[in] fd Either end of the pipe.
+ * @param[in] size Capacity in bytes, 0 to leave default one.
+ */
+void resize_pipe(int fd, size_t size);
+
+#endif //KARASHI_PIPESIZE_H
@@ -18,28 +18,160 @@
  * @file prompt.c
  *
  * @brief Handle internal logic of what prompt should content.
+ *
+ * @details Prompt is cached as segments. Directory segment depends on PWD and
+ * HOME only, so it is checked against version of variables. Git segment
+ * needs to walk parent directories and read files, which is slow on network
+ * file systems, so it is computed by a worker thread and the shell only
+ * takes the finished result.
  */
 
 #include "prompt.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+// Including GNU readline library.
+#include <readline.h>
 
 #include "utility.h"
+#include "variables.h"
+
+/**
+ * @brief Marks of invisible prompt characters, so readline computes width of
+ * the prompt correctly.
+ */
+#define IGNORE_START "\001"
+#define IGNORE_END   "\002"
+
+#define BRANCH_COLOR "\033[0;36m" ///< Color of git branch.
+#define HEAD_SIZE 256             ///< Max size of git HEAD file read.
+#define HASH_LENGTH 7             ///< Length of detached HEAD hash shown.
 
 /**
  * @brief Kara hieroglyph, which is printed instead of default boring Bash "$".
  */
-static char KARA[] = BOLD_RED " 殻 " RESET;
+static char KARA[64] = IGNORE_START BOLD_RED IGNORE_END " 殻 "
+                       IGNORE_START RESET IGNORE_END;
 
 /**
  * @brief Used to replace HOME environment variable with "~" in get_prompt().
  */
 static const char TILDE[] = "~";
 
+/**
+ * @brief Cached text of prompt part.
+ */
+struct Segment {
+    char* text;    ///< Text of the segment, NULL if it is empty.
+    size_t length; ///< Length of the text.
+};
+
+/**
+ * @brief Current directory segment, home replaced with tilde.
+ */
+static struct Segment DIRECTORY = {NULL, 0};
+
+/**
+ * @brief Git branch segment, empty outside of repository.
+ */
+static struct Segment GIT = {NULL, 0};
+
+/**
+ * @brief Composed prompt returned by get_prompt().
+ */
+static char* PROMPT = NULL;
+
+/**
+ * @brief Capacity of PROMPT.
+ */
+static size_t PROMPT_CAPACITY = 0;
+
+/**
+ * @brief Variables version DIRECTORY was built for.
+ */
+static unsigned long SEEN_VERSION = 0;
+
+/**
+ * @brief Whether DIRECTORY was built at least once.
+ */
+static bool IS_DIRECTORY_SET = false;
+
+/**
+ * @brief Working directory shown by DIRECTORY.
+ */
+static char* SHOWN_PWD = NULL;
+
+/**
+ * @brief Guards requests and results of git worker.
+ */
+static pthread_mutex_t GIT_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Signalled when git worker gets a new request.
+ */
+static pthread_cond_t GIT_CONDITION = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Directory to describe, guarded by GIT_MUTEX.
+ */
+static char* REQUESTED_DIRECTORY = NULL;
+
+/**
+ * @brief Number of the last request, guarded by GIT_MUTEX.
+ */
+static unsigned long REQUESTED = 0;
+
+/**
+ * @brief Number of the last result, guarded by GIT_MUTEX.
+ */
+static unsigned long FINISHED = 0;
+
+/**
+ * @brief Work tree of the last result, guarded by GIT_MUTEX.
+ */
+static char* FOUND_ROOT = NULL;
+
+/**
+ * @brief Git segment of the last result, guarded by GIT_MUTEX.
+ */
+static char* FOUND_TEXT = NULL;
+
+/**
+ * @brief Whether git worker thread was started.
+ */
+static bool IS_WORKER_STARTED = false;
+
+/**
+ * @brief Whether git worker could not be started.
+ */
+static bool IS_WORKER_FAILED = false;
+
+/**
+ * @brief Eventfd written by git worker on result.
+ */
+static int WORKER_FD = -1;
+
+/**
+ * @brief Number of git result shown in the prompt.
+ */
+static unsigned long SHOWN = 0;
+
+/**
+ * @brief Work tree of shown git segment.
+ */
+static char* GIT_ROOT = NULL;
+
 /**
  * @brief Sets the prompt color to a different color each time it's called.
  *
@@ -51,7 +183,8 @@ static void set_prompt_color(char prompt[]) {
 
     static int COLOR_NUMBER = RED;
 
-    sprintf(prompt, "\033[1;%dm 殻 " RESET, COLOR_NUMBER);
+    sprintf(prompt, IGNORE_START "\033[1;%dm" IGNORE_END " 殻 "
+                    IGNORE_START RESET IGNORE_END, COLOR_NUMBER);
 
     COLOR_NUMBER++;
     if (COLOR_NUMBER == LAST_COLOR + 1) {
@@ -59,33 +192,429 @@ static void set_prompt_color(char prompt[]) {
     }
 }
 
-char* get_prompt(void) {
-    char* prompt = NULL;
+/**
+ * @brief Replaces text of the segment.
+ *
+ * @param[in,out] segment The segment.
+ * @param[in] text Allocated text, or NULL for empty segment.
+ */
+static void set_segment(struct Segment* segment, char* text) {
+    free(segment->text);
+    segment->text = text;
+    segment->length = text ? strlen(text) : 0;
+}
 
-    char* const CWD = getcwd(NULL, 0);
-    assert_alloc(CWD, "cwd");
+/**
+ * @brief Determine if path is the directory or inside it.
+ *
+ * @param[in] path The path to check.
+ * @param[in] directory The directory.
+ *
+ * @return True if directory is prefix of the path at component boundary.
+ */
+static bool is_inside(const char path[], const char directory[]) {
+    const size_t length = strlen(directory);
+    return !strncmp(path, directory, length)
+           && (path[length] == '/' || path[length] == '\0'
+               || (length && directory[length - 1] == '/'));
+}
 
-    size_t prompt_length = strlen(CWD) + strlen(KARA) + 1;
+/**
+ * @brief Joins path and file name.
+ *
+ * @param[in] path The directory path.
+ * @param[in] name The file name.
+ *
+ * @return Allocated path, or NULL if allocation failed.
+ */
+static char* join_path(const char path[], const char name[]) {
+    const size_t length = strlen(path) + strlen(name) + 2;
+    char* result = malloc(length);
+    if (!result) {
+        check_alloc(result, "prompt path");
+        return NULL;
+    }
+    snprintf(result, length, "%s/%s", path, name);
+    return result;
+}
 
-    const char* const HOME = check_getenv("HOME");
-    bool home_dir = strstr(CWD, HOME) == CWD;
-    if (home_dir) {
-        prompt_length = prompt_length - strlen(HOME) + strlen(TILDE);
+/**
+ * @brief Reads start of small file.
+ *
+ * @param[in] path The path to the file.
+ * @param[out] buffer The buffer of HEAD_SIZE bytes.
+ *
+ * @return False if file cannot be read.
+ */
+static bool read_small_file(const char path[], char buffer[]) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
     }
+    const ssize_t length = read(fd, buffer, HEAD_SIZE - 1);
+    close(fd);
+    if (length < 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return true;
+}
 
-    prompt = malloc(prompt_length);
-    assert_alloc(prompt, "prompt");
+/**
+ * @brief Finds git directory from ".git" entry of work tree.
+ *
+ * @details ".git" of linked work trees and submodules is a file with
+ * "gitdir: path" line, path is relative to the work tree.
+ *
+ * @param[in] dot_git Path to ".git" entry.
+ * @param[in] root_length Length of work tree path in dot_git.
+ * @param[in] is_directory True if ".git" is a directory.
+ *
+ * @return Allocated path to git directory, or NULL.
+ */
+static char* find_git_directory(const char dot_git[], size_t root_length,
+                                bool is_directory) {
+    if (is_directory) {
+        char* copy = strdup(dot_git);
+        check_alloc(copy, "prompt path");
+        return copy;
+    }
+    char buffer[HEAD_SIZE];
+    static const char PREFIX[] = "gitdir: ";
+    if (!read_small_file(dot_git, buffer)
+        || strncmp(buffer, PREFIX, sizeof(PREFIX) - 1)) {
+        return NULL;
+    }
+    const char* path = buffer + sizeof(PREFIX) - 1;
+    if (path[0] == '/') {
+        char* copy = strdup(path);
+        check_alloc(copy, "prompt path");
+        return copy;
+    }
+    const size_t length = root_length + strlen(path) + 2;
+    char* result = malloc(length);
+    if (!result) {
+        check_alloc(result, "prompt path");
+        return NULL;
+    }
+    snprintf(result, length, "%.*s/%s", (int) root_length, dot_git, path);
+    return result;
+}
 
-    if (home_dir) {
-        strcpy(prompt, TILDE);
-        strcat(prompt, CWD + strlen(HOME));
+/**
+ * @brief Describes HEAD of the repository.
+ *
+ * @param[in] git_directory The git directory.
+ *
+ * @return Allocated git segment, or NULL.
+ */
+static char* describe_head(const char git_directory[]) {
+    char* path = join_path(git_directory, "HEAD");
+    char buffer[HEAD_SIZE];
+    const bool is_read = path && read_small_file(path, buffer);
+    free(path);
+    if (!is_read) {
+        return NULL;
+    }
+
+    static const char BRANCH[] = "ref: refs/heads/";
+    static const char REF[] = "ref: ";
+    const char* name = buffer;
+    if (!strncmp(buffer, BRANCH, sizeof(BRANCH) - 1)) {
+        name += sizeof(BRANCH) - 1;
+    } else if (!strncmp(buffer, REF, sizeof(REF) - 1)) {
+        name += sizeof(REF) - 1;
     } else {
-        strcpy(prompt, CWD);
+        buffer[HASH_LENGTH] = '\0';
+    }
+
+    // Operations in progress are marked like in git prompt of other shells
+    static const char* const STATES[][2] = {
+            {"rebase-merge", "|REBASE"},
+            {"rebase-apply", "|REBASE"},
+            {"MERGE_HEAD",   "|MERGING"},
+    };
+    const char* state = "";
+    for (size_t i = 0; i < sizeof(STATES) / sizeof(*STATES) && !*state; ++i) {
+        char* marker = join_path(git_directory, STATES[i][0]);
+        if (marker && !access(marker, F_OK)) {
+            state = STATES[i][1];
+        }
+        free(marker);
     }
 
+    const size_t length = strlen(name) + strlen(state) + sizeof(BRANCH_COLOR)
+                          + sizeof(RESET) + 16;
+    char* text = malloc(length);
+    if (!text) {
+        check_alloc(text, "prompt git");
+        return NULL;
+    }
+    snprintf(text, length, " " IGNORE_START BRANCH_COLOR IGNORE_END "(%s%s)"
+             IGNORE_START RESET IGNORE_END, name, state);
+    return text;
+}
+
+/**
+ * @brief Finds repository containing the directory and describes it.
+ *
+ * @param[in] directory The directory.
+ * @param[out] root Allocated work tree of the repository, NULL if it is not
+ * found.
+ *
+ * @return Allocated git segment, or NULL.
+ */
+static char* describe_repository(const char directory[], char** root) {
+    *root = NULL;
+    size_t length = strlen(directory);
+    char* path = malloc(length + sizeof("/.git"));
+    if (!path) {
+        check_alloc(path, "prompt path");
+        return NULL;
+    }
+    memcpy(path, directory, length);
+
+    while (true) {
+        memcpy(path + length, "/.git", sizeof("/.git"));
+        struct stat status;
+        if (!stat(path, &status)) {
+            char* git_directory = find_git_directory(
+                    path, length, S_ISDIR(status.st_mode));
+            path[length] = '\0';
+            char* text = git_directory ? describe_head(git_directory) : NULL;
+            free(git_directory);
+            *root = path;
+            return text;
+        }
+        if (!length) {
+            break;
+        }
+        while (length && path[length - 1] != '/') {
+            --length;
+        }
+        length -= length > 0;
+    }
+    free(path);
+    return NULL;
+}
+
+/**
+ * @brief Describes requested directories until the shell exits.
+ *
+ * @param[in] arg Unused.
+ *
+ * @return Never returns.
+ */
+static void* git_worker(void* arg) {
+    (void) arg;
+    pthread_mutex_lock(&GIT_MUTEX);
+    while (true) {
+        while (FINISHED == REQUESTED) {
+            pthread_cond_wait(&GIT_CONDITION, &GIT_MUTEX);
+        }
+        const unsigned long request = REQUESTED;
+        char* directory = REQUESTED_DIRECTORY;
+        REQUESTED_DIRECTORY = NULL;
+        pthread_mutex_unlock(&GIT_MUTEX);
+
+        char* root = NULL;
+        char* text = directory ? describe_repository(directory, &root) : NULL;
+        free(directory);
+
+        pthread_mutex_lock(&GIT_MUTEX);
+        free(FOUND_ROOT);
+        free(FOUND_TEXT);
+        FOUND_ROOT = root;
+        FOUND_TEXT = text;
+        FINISHED = request;
+
+        const uint64_t done = 1;
+        const ssize_t written = write(WORKER_FD, &done, sizeof(done));
+        (void) written;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts git worker with all signals blocked, so signals are handled
+ * by the shell thread only.
+ *
+ * @return True if worker is running.
+ */
+static bool start_worker(void) {
+    if (IS_WORKER_STARTED || IS_WORKER_FAILED) {
+        return IS_WORKER_STARTED;
+    }
+    WORKER_FD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (WORKER_FD < 0) {
+        print_errno();
+        IS_WORKER_FAILED = true;
+        return false;
+    }
+
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+
+    pthread_t worker;
+    const int error = pthread_create(&worker, NULL, git_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (error) {
+        printf(BOLD_RED "kara: prompt: %s" RESET "\n", strerror(error));
+        close(WORKER_FD);
+        WORKER_FD = -1;
+        IS_WORKER_FAILED = true;
+        return false;
+    }
+    pthread_detach(worker);
+    IS_WORKER_STARTED = true;
+    return true;
+}
+
+/**
+ * @brief Asks git worker to describe the directory.
+ *
+ * @param[in] directory The directory.
+ */
+static void request_git(const char directory[]) {
+    if (!start_worker()) {
+        return;
+    }
+    char* copy = strdup(directory);
+    if (!check_alloc(copy, "prompt path")) {
+        return;
+    }
+    pthread_mutex_lock(&GIT_MUTEX);
+    free(REQUESTED_DIRECTORY);
+    REQUESTED_DIRECTORY = copy;
+    ++REQUESTED;
+    pthread_cond_signal(&GIT_CONDITION);
+    pthread_mutex_unlock(&GIT_MUTEX);
+}
+
+/**
+ * @brief Takes result of the last request if it is finished.
+ *
+ * @return True if git segment changed.
+ */
+static bool take_git_result(void) {
+    pthread_mutex_lock(&GIT_MUTEX);
+    if (FINISHED != REQUESTED || SHOWN == FINISHED) {
+        pthread_mutex_unlock(&GIT_MUTEX);
+        return false;
+    }
+    SHOWN = FINISHED;
+    char* root = FOUND_ROOT;
+    char* text = FOUND_TEXT;
+    FOUND_ROOT = NULL;
+    FOUND_TEXT = NULL;
+    pthread_mutex_unlock(&GIT_MUTEX);
+
+    free(GIT_ROOT);
+    GIT_ROOT = root;
+    if (GIT.text && text && !strcmp(GIT.text, text)) {
+        free(text);
+        return false;
+    }
+    if (!GIT.text && !text) {
+        return false;
+    }
+    set_segment(&GIT, text);
+    return true;
+}
+
+/**
+ * @brief Formats directory segment again if PWD or HOME changed.
+ *
+ * @return True if logical current directory changed.
+ */
+static bool update_directory(void) {
+    if (IS_DIRECTORY_SET && SEEN_VERSION == variables_version) {
+        return false;
+    }
+    SEEN_VERSION = variables_version;
+    IS_DIRECTORY_SET = true;
+
+    const char* pwd = get_variable("PWD", strlen("PWD"));
+    char* cwd = NULL;
+    if (!pwd || pwd[0] != '/') {
+        cwd = getcwd(NULL, 0);
+        assert_alloc(cwd, "cwd");
+        pwd = cwd;
+        // Without PWD changes of directory are not seen by version
+        IS_DIRECTORY_SET = false;
+    }
+
+    const char* home = get_variable("HOME", strlen("HOME"));
+    const bool home_dir = home && *home && is_inside(pwd, home);
+    const char* rest = home_dir ? pwd + strlen(home) : pwd;
+    const size_t length = (home_dir ? strlen(TILDE) : 0) + strlen(rest) + 1;
+    char* text = malloc(length);
+    assert_alloc(text, "prompt");
+    snprintf(text, length, "%s%s", home_dir ? TILDE : "", rest);
+    set_segment(&DIRECTORY, text);
+
+    const bool is_changed = !SHOWN_PWD || strcmp(SHOWN_PWD, pwd);
+    if (is_changed) {
+        free(SHOWN_PWD);
+        SHOWN_PWD = strdup(pwd);
+        assert_alloc(SHOWN_PWD, "prompt");
+    }
+    free(cwd);
+    return is_changed;
+}
+
+/**
+ * @brief Concatenates segments into PROMPT.
+ */
+static void compose(void) {
+    const size_t kara_length = strlen(KARA);
+    const size_t length = DIRECTORY.length + GIT.length + kara_length + 1;
+    if (length > PROMPT_CAPACITY) {
+        free(PROMPT);
+        PROMPT = malloc(length);
+        assert_alloc(PROMPT, "prompt");
+        PROMPT_CAPACITY = length;
+    }
+    if (DIRECTORY.text) {
+        memcpy(PROMPT, DIRECTORY.text, DIRECTORY.length);
+    }
+    if (GIT.text) {
+        memcpy(PROMPT + DIRECTORY.length, GIT.text, GIT.length);
+    }
+    memcpy(PROMPT + DIRECTORY.length + GIT.length, KARA, kara_length + 1);
+}
+
+const char* get_prompt(void) {
+    if (update_directory() && GIT_ROOT && !is_inside(SHOWN_PWD, GIT_ROOT)) {
+        // Branch of repository which was left must not stay until redraw
+        set_segment(&GIT, NULL);
+        free(GIT_ROOT);
+        GIT_ROOT = NULL;
+    }
+
+    // HEAD may change without changing directory, so it is read every time
+    request_git(SHOWN_PWD);
+    take_git_result();
+
     set_prompt_color(KARA);
-    strcat(prompt, KARA);
+    compose();
+    return PROMPT;
+}
+
+int get_prompt_fd(void) {
+    return WORKER_FD;
+}
 
-    free(CWD);
-    return prompt;
+void refresh_prompt(void) {
+    uint64_t done;
+    while (read(WORKER_FD, &done, sizeof(done)) > 0) {
+    }
+    if (take_git_result()) {
+        compose();
+        rl_set_prompt(PROMPT);
+        rl_forced_update_display();
+    }
 }
@@ -28,10 +28,29 @@
 /**
  * @brief Generate prompt represented as C-style string.
  *
- * @details Substitute path read from HOME environment variable with "~" symbol.
+ * @details Prompt is composed of segments: logical current directory from
+ * PWD with HOME replaced by "~" symbol, branch of git repository and the
+ * kara symbol. Directory segment is formatted again only when variables
+ * change. Git segment is read by a background thread, so the prompt is shown
+ * with the previous value at once and redrawn by refresh_prompt() when the
+ * new value differs.
  *
- * @return Shell prompt.
+ * @return Shell prompt, valid until the next call.
  */
-char* get_prompt(void);
+const char* get_prompt(void);
+
+/**
+ * @brief Returns descriptor which becomes readable when git segment is read.
+ *
+ * @return Eventfd of the git worker, -1 if it is not started.
+ */
+int get_prompt_fd(void);
+
+/**
+ * @brief Redraws prompt being edited by readline if git segment changed.
+ *
+ * @details Called by the event loop when get_prompt_fd() is readable.
+ */
+void refresh_prompt(void);
 
 #endif //KARASHI_PROMPT_H
@@ -17,84 +17,486 @@
 /**
  * @file scanner.c
  *
- * @brief Get user input via GNU readline library and split it into tokens.
+ * @brief Get user input via GNU readline library or from script and split it
+ * into tokens.
  */
 
 #include "scanner.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <poll.h>
 
 // Including GNU readline library.
 #include <readline.h>
-#include <history.h>
 
+#include "arena.h"
+#include "child.h"
+#include "classify.h"
+#include "events.h"
+#include "executor.h"
+#include "expansion.h"
+#include "histfile.h"
 #include "prompt.h"
+#include "trace.h"
 #include "utility.h"
 
+#define READ_SIZE (64 * 1024) ///< Minimal size of single read from script.
+#define TOKENS_CAPACITY 16     ///< Initial capacity of Tokens data array.
+
+/**
+ * @brief Buffered reader of non-interactive input.
+ */
+struct Script {
+    int fd;         ///< File descriptor to read from, -1 if all in buffer.
+    char* buffer;   ///< Read data, lines are terminated in place.
+    size_t size;    ///< Allocated size of buffer without terminator byte.
+    size_t start;   ///< Offset of the first not consumed byte.
+    size_t end;     ///< Offset after the last read byte.
+    bool is_shared; ///< True if commands read the same descriptor.
+    off_t offset;   ///< File offset of end, -1 if fd is not seekable.
+    off_t synced;   ///< File offset left to commands after the last line.
+};
+
+/**
+ * @brief Script reader, NULL when shell is interactive.
+ */
+static struct Script* SCRIPT = NULL;
+
 /**
  * @brief Used to return on fail in tokenize().
  */
-static const struct Tokens INVALID_TOKENS = {INVALID, NULL, 0};
+static const struct Tokens INVALID_TOKENS = {INVALID, NULL, NULL, 0};
 
 /**
- * @brief Frees Tokens structure and C-style string generated by GNU readline.
+ * @brief Allocates script reader.
  *
- * @details Used in exceptional cases in the tokenize() function.
+ * @param[in] fd The file descriptor to read from.
+ * @param[in] size Initial size of buffer.
  *
- * @param[in] string The string that was read from the user.
- * @param[in] tokens Tokens that was spilled from string.
+ * @return True if allocation succeeded, otherwise false.
  */
-static void free_resources(char* string, struct Tokens tokens) {
-    rl_free(string);
-    free_tokens(tokens);
+static bool create_script(int fd, size_t size) {
+    SCRIPT = calloc(1, sizeof(struct Script));
+    if (!check_alloc(SCRIPT, "script reader")) {
+        return false;
+    }
+    SCRIPT->buffer = malloc(size + 1);
+    if (!check_alloc(SCRIPT->buffer, "script buffer")) {
+        free(SCRIPT);
+        SCRIPT = NULL;
+        return false;
+    }
+    SCRIPT->fd = fd;
+    SCRIPT->size = size;
+    SCRIPT->start = 0;
+    SCRIPT->end = 0;
+    SCRIPT->is_shared = false;
+    SCRIPT->offset = -1;
+    SCRIPT->synced = -1;
+    return true;
+}
+
+bool read_script_fd(int fd) {
+    if (!create_script(fd, READ_SIZE)) {
+        return false;
+    }
+    // Launched commands inherit stdin and may read the rest of the script
+    if (fd == STDIN_FILENO) {
+        SCRIPT->is_shared = true;
+        SCRIPT->offset = lseek(fd, 0, SEEK_CUR);
+        SCRIPT->synced = SCRIPT->offset;
+    }
+    return true;
+}
+
+bool read_script_string(const char string[]) {
+    const size_t length = strlen(string);
+    if (!create_script(-1, length)) {
+        return false;
+    }
+    memcpy(SCRIPT->buffer, string, length);
+    SCRIPT->end = length;
+    return true;
 }
 
 /**
- * @brief Split string into Tokens structure.
+ * @brief Reads more data into script buffer.
  *
- * @param[in] string The string to tokenize.
+ * @details Moves not consumed data to the beginning of the buffer and grows
+ * the buffer when it is full. Shared descriptor which is not seekable is read
+ * byte by byte, so nothing after the current line is taken from commands.
  *
- * @return A struct Tokens.
+ * @return False on end of file or error, otherwise true.
  */
-static struct Tokens tokenize(char* string) {
-    struct Tokens tokens = {VALID, NULL, 0};
+static bool fill_script(void) {
+    if (SCRIPT->fd == -1) {
+        return false;
+    }
 
-    char* tok = strtok(string, " \t\n");
+    if (SCRIPT->start) {
+        memmove(SCRIPT->buffer, SCRIPT->buffer + SCRIPT->start,
+                SCRIPT->end - SCRIPT->start);
+        SCRIPT->end -= SCRIPT->start;
+        SCRIPT->start = 0;
+    }
+    const size_t read_size = (SCRIPT->is_shared && SCRIPT->offset < 0)
+                             ? 1 : READ_SIZE;
+    if (SCRIPT->size - SCRIPT->end < read_size) {
+        char* buffer = realloc(SCRIPT->buffer, SCRIPT->size * 2 + 1);
+        if (!check_alloc(buffer, "script buffer")) {
+            return false;
+        }
+        SCRIPT->buffer = buffer;
+        SCRIPT->size *= 2;
+    }
+
+    ssize_t length;
+    do {
+        length = read(SCRIPT->fd, SCRIPT->buffer + SCRIPT->end,
+                      (read_size == 1) ? 1 : SCRIPT->size - SCRIPT->end);
+    } while (length < 0 && errno == EINTR);
 
-    while (tok) {
-        tokens.data = realloc(tokens.data, (tokens.amount + 1) * sizeof(char*));
-        if (!check_alloc(tokens.data, "tokens")) {
-            free_resources(string, tokens);
-            return INVALID_TOKENS;
+    if (length <= 0) {
+        if (length < 0) {
+            print_errno();
         }
+        // Seekable input is read again if a command moves its offset back
+        if (SCRIPT->offset < 0) {
+            SCRIPT->fd = -1;
+        }
+        return false;
+    }
+    SCRIPT->end += (size_t) length;
+    if (SCRIPT->offset >= 0) {
+        SCRIPT->offset += length;
+    }
+    return true;
+}
+
+/**
+ * @brief Takes back buffered input of shared seekable descriptor.
+ *
+ * @details Commands of the previous line saw the offset just after it. If
+ * they did not move it, buffered data is still valid and the offset returns
+ * to its end, otherwise buffer is dropped and reading continues from where
+ * the commands stopped.
+ */
+static void resume_script(void) {
+    const off_t current = lseek(SCRIPT->fd, 0, SEEK_CUR);
+    if (current == SCRIPT->synced) {
+        lseek(SCRIPT->fd, SCRIPT->offset, SEEK_SET);
+    } else if (current >= 0) {
+        SCRIPT->start = 0;
+        SCRIPT->end = 0;
+        SCRIPT->offset = current;
+    }
+}
 
-        size_t extra_len = 0;
-        if (tok[0] == '~') {
-            extra_len = strlen(check_getenv("HOME"));
-        } else if (tok[0] == '$' && getenv(tok + 1)) {
-            extra_len = strlen(getenv(tok + 1));
+/**
+ * @brief Reads next line from script.
+ *
+ * @details Line is terminated in place and stays valid until the next call.
+ * Offset of shared seekable descriptor is kept just after the returned line
+ * while it runs.
+ *
+ * @return Line without new line character, or NULL if script is over.
+ */
+static char* read_script_line(void) {
+    if (SCRIPT->offset >= 0) {
+        resume_script();
+    }
+    char* new_line;
+    size_t scanned = SCRIPT->start;
+    while (!(new_line = memchr(SCRIPT->buffer + scanned, '\n',
+                               SCRIPT->end - scanned))) {
+        const size_t consumed = SCRIPT->end - SCRIPT->start;
+        if (!fill_script()) {
+            break;
         }
-        tokens.data[tokens.amount] = malloc(strlen(tok) + extra_len + 1);
-        if (!check_alloc(tokens.data, "token")) {
-            free_resources(string, tokens);
-            return INVALID_TOKENS;
+        scanned = SCRIPT->start + consumed;
+    }
+
+    if (SCRIPT->start == SCRIPT->end) {
+        return NULL;
+    }
+
+    char* line = SCRIPT->buffer + SCRIPT->start;
+    if (new_line) {
+        *new_line = '\0';
+        SCRIPT->start = (size_t) (new_line - SCRIPT->buffer) + 1;
+    } else { // Last line without new line character
+        SCRIPT->buffer[SCRIPT->end] = '\0';
+        SCRIPT->start = SCRIPT->end;
+    }
+    // Commands of the line continue reading input right after it
+    if (SCRIPT->offset >= 0) {
+        SCRIPT->synced = SCRIPT->offset - (off_t) (SCRIPT->end - SCRIPT->start);
+        lseek(SCRIPT->fd, SCRIPT->synced, SEEK_SET);
+    }
+    return line;
+}
+
+/**
+ * @brief Determine if character ends unquoted word.
+ *
+ * @param[in] c The character to check.
+ * @param[in] is_nested True inside process substitution, where ")" ends it.
+ *
+ * @return True for whitespace, operator characters and string terminator.
+ */
+static bool is_separator(char c, bool is_nested) {
+    return isspace((unsigned char) c) || c == '|' || c == '&' || c == ';' ||
+           c == '<' || c == '>' || c == '\0' || (is_nested && c == ')');
+}
+
+/**
+ * @brief Scans word till the first unquoted separator.
+ *
+ * @details Separators inside "${...}" belong to the word. Plain runs of
+ * characters are skipped by vectorized find_class(), except inside process
+ * substitution, which is short and ends with ")" that is not an operator
+ * class.
+ *
+ * @param[in] line The line to scan.
+ * @param[in] length Length of the line.
+ * @param[in,out] index Offset of the word start, set to offset after word.
+ * @param[in] is_nested True inside process substitution.
+ * @param[out] is_quoted Set to true if word contains quotes or backslashes.
+ *
+ * @return False if quote is not terminated, otherwise true.
+ */
+static bool scan_word(const char line[], size_t length, size_t* index,
+                      bool is_nested, bool* is_quoted) {
+    size_t i = *index;
+    *is_quoted = false;
+
+    while (!is_separator(line[i], is_nested)) {
+        if (line[i] == '\'') {
+            *is_quoted = true;
+            const char* end = memchr(line + i + 1, '\'', length - i - 1);
+            if (!end) {
+                return false;
+            }
+            i = (size_t) (end - line) + 1;
+
+        } else if (line[i] == '"') {
+            *is_quoted = true;
+            for (++i; line[i] != '"'; ++i) {
+                if (line[i] == '\0') {
+                    return false;
+                }
+                if (line[i] == '\\' && line[i + 1] != '\0') {
+                    ++i;
+                }
+            }
+            ++i;
+
+        } else if (line[i] == '\\') {
+            *is_quoted = true;
+            i += line[i + 1] ? 2 : 1;
+
+        } else if (line[i] == '$' && line[i + 1] == '{') {
+            // Unterminated one is left to expansion, which reports it
+            const size_t close = find_brace(line, length, i + 2);
+            i = (close < length) ? close + 1 : i + 2;
+
+        } else if (is_nested) {
+            ++i;
+        } else {
+            ++i;
+            i += find_class(line + i, length - i,
+                            WORD_END_CLASSES | DOLLAR_CLASS);
+        }
+    }
+
+    *index = i;
+    return true;
+}
+
+/**
+ * @brief Splits line into views of words and operators.
+ *
+ * @details Single pass over the line, nothing is copied.
+ *
+ * @param[in] line The line to scan.
+ * @param[in] length Length of the line.
+ * @param[out] tokens Tokens to append views to.
+ *
+ * @return False on syntax error or allocation failure, otherwise true.
+ */
+static bool scan(const char line[], size_t length, struct Tokens* tokens) {
+    size_t capacity = 0;
+    size_t depth = 0; // Nesting of process substitutions
+    size_t i = 0;
+
+    while (true) {
+        while (isspace((unsigned char) line[i])) {
+            ++i;
+        }
+        if (line[i] == '\0' || line[i] == '#') {
+            if (depth) {
+                printf(BOLD_RED "kara: unterminated process substitution"
+                       RESET "\n");
+                return false;
+            }
+            return true;
         }
 
-        if (tok[0] == '~') {
-            strcpy(tokens.data[tokens.amount], getenv("HOME"));
-            strcat(tokens.data[tokens.amount], tok + 1);
-        } else if (tok[0] == '$' && extra_len) {
-            strcpy(tokens.data[tokens.amount], getenv(tok + 1));
+        if (tokens->amount == capacity) {
+            capacity = capacity ? capacity * 2 : TOKENS_CAPACITY;
+            struct Token* data = arena_alloc(&line_arena,
+                                             capacity * sizeof(struct Token));
+            if (!data) {
+                return false;
+            }
+            if (tokens->amount) {
+                memcpy(data, tokens->data,
+                       tokens->amount * sizeof(struct Token));
+            }
+            tokens->data = data;
+        }
+
+        struct Token* token = &tokens->data[tokens->amount++];
+        token->offset = i;
+        token->is_quoted = false;
+        token->is_expandable = false;
+        token->is_assignment = false;
+        token->text = NULL;
+
+        if (line[i] == '|' && line[i + 1] == '|') {
+            token->kind = OR;
+            i += 2;
+        } else if (line[i] == '&' && line[i + 1] == '&') {
+            token->kind = AND;
+            i += 2;
+        } else if (line[i] == ';') {
+            token->kind = SEMICOLON;
+            ++i;
+        } else if ((line[i] == '<' || line[i] == '>') && line[i + 1] == '(') {
+            token->kind = (line[i] == '<') ? PROCESS_IN : PROCESS_OUT;
+            ++depth;
+            i += 2;
+        } else if (line[i] == ')' && depth) {
+            token->kind = CLOSE;
+            --depth;
+            ++i;
+        } else if (line[i] == '|') {
+            token->kind = PIPE;
+            ++i;
+        } else if (line[i] == '<') {
+            token->kind = REDIRECT_IN;
+            ++i;
+        } else if (line[i] == '>') {
+            token->kind = REDIRECT_OUT;
+            ++i;
+        } else if (line[i] == '&') {
+            token->kind = BACKGROUND;
+            ++i;
+        } else if (line[i] == '2' && line[i + 1] == '>') {
+            token->kind = REDIRECT_ERR;
+            i += 2;
         } else {
-            strcpy(tokens.data[tokens.amount], tok);
+            token->kind = WORD;
+            if (!scan_word(line, length, &i, depth, &token->is_quoted)) {
+                printf(BOLD_RED "kara: unterminated quote" RESET "\n");
+                return false;
+            }
         }
-        tokens.amount++;
+        token->length = i - token->offset;
+    }
+}
+
+/**
+ * @brief Removes quotes and backslashes from word in place.
+ *
+ * @param[in,out] word The word to unquote.
+ * @param[in] length Length of the word.
+ *
+ * @return Length of unquoted word.
+ */
+static size_t unquote(char word[], size_t length) {
+    size_t out = 0;
+    char quote = '\0';
 
-        tok = strtok(NULL, " \t\n");
+    for (size_t i = 0; i < length; ++i) {
+        const char c = word[i];
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = '\0';
+            } else {
+                word[out++] = c;
+            }
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = '\0';
+            } else if (c == '\\' && i + 1 < length &&
+                       strchr("\"\\$`", word[i + 1])) {
+                word[out++] = word[++i];
+            } else {
+                word[out++] = c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '\\' && i + 1 < length) {
+            word[out++] = word[++i];
+        } else {
+            word[out++] = c;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Sets word text, keeping raw text of words to expand.
+ *
+ * @details Words are terminated and unquoted in place, words with expansions
+ * are expanded when their command is launched.
+ *
+ * @param[in,out] line The line token refers to.
+ * @param[in,out] token The word token.
+ */
+static void materialize(char line[], struct Token* token) {
+    char* word = line + token->offset;
+    token->is_assignment = is_assignment(word, token->length);
+    token->is_expandable = needs_expansion(word, token->length);
+    const size_t length = (token->is_quoted && !token->is_expandable)
+                          ? unquote(word, token->length) : token->length;
+    word[length] = '\0';
+    token->text = word;
+}
+
+/**
+ * @brief Split line into Tokens structure.
+ *
+ * @details Quotes, backslash escapes and operators are recognized without
+ * surrounding whitespace. Everything after unquoted "#" at the beginning of
+ * a word is a comment. The line is modified and must stay valid while tokens
+ * are used.
+ *
+ * @param[in] line The line to tokenize.
+ *
+ * @return A struct Tokens.
+ */
+static struct Tokens tokenize(char* line) {
+    struct Tokens tokens = {VALID, line, NULL, 0};
+
+    // Words are terminated in place, so operators must be scanned beforehand
+    if (!scan(line, strlen(line), &tokens)) {
+        arena_reset(&line_arena);
+        return INVALID_TOKENS;
+    }
+    for (size_t i = 0; i < tokens.amount; ++i) {
+        if (tokens.data[i].kind == WORD) {
+            materialize(line, &tokens.data[i]);
+        }
     }
 
-    rl_free(string);
     return tokens;
 }
 
@@ -108,39 +510,155 @@ static struct Tokens tokenize(char* string) {
 static bool is_skip(const char* string) {
     // EOF check
     if (!string) {
-        putchar('\n');
-        exit(EXIT_SUCCESS);
+        if (!SCRIPT) {
+            putchar('\n');
+        }
+        exit(last_status);
     }
-    while (isspace(*string)) {
-        ++string;
+    const size_t length = strlen(string);
+    return find_class(string, length, ~(unsigned) SPACE_CLASS) == length;
+}
+
+/**
+ * @brief Tokenizes line and records "scan" span when tracing.
+ *
+ * @param[in,out] line The line to tokenize.
+ *
+ * @return Tokens struct.
+ */
+static struct Tokens trace_tokenize(char* line) {
+    if (!is_tracing) {
+        return tokenize(line);
+    }
+    const uint64_t start = trace_now();
+    struct Tokens tokens = tokenize(line);
+    trace_span("scan", "shell", start, trace_now(), 0, NULL);
+    return tokens;
+}
+
+/**
+ * @brief Line accepted by readline callback, NULL on EOF.
+ */
+static char* ACCEPTED_LINE = NULL;
+
+/**
+ * @brief Whether readline callback delivered ACCEPTED_LINE.
+ */
+static bool IS_LINE_ACCEPTED = false;
+
+/**
+ * @brief Readline callback called when user accepts line.
+ *
+ * @param[in] line The line, NULL on EOF.
+ */
+static void accept_line(char* line) {
+    rl_callback_handler_remove();
+    ACCEPTED_LINE = line;
+    IS_LINE_ACCEPTED = true;
+}
+
+/**
+ * @brief Discards edited line after ^C and starts new one.
+ */
+static void cancel_line(void) {
+    rl_callback_sigcleanup();
+    rl_echo_signal_char(SIGINT);
+    rl_replace_line("", 0);
+    rl_crlf();
+    rl_set_prompt(get_prompt());
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+/**
+ * @brief Prints changed background jobs above edited line.
+ */
+static void report_jobs(void) {
+    rl_clear_visible_line();
+    collect_jobs(true);
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+/**
+ * @brief Reads line with readline in callback mode.
+ *
+ * @details Terminal input is one of descriptors of the event loop, so jobs
+ * finished in background are reported and ^C discards the line while user
+ * types it. Readline does not install signal handlers, since signals are
+ * read by the loop.
+ *
+ * @return The line allocated by readline, NULL on EOF.
+ */
+static char* read_terminal_line(void) {
+    rl_catch_signals = 0;
+    IS_LINE_ACCEPTED = false;
+    take_interrupt();
+    rl_callback_handler_install(get_prompt(), accept_line);
+
+    while (!IS_LINE_ACCEPTED) {
+        struct pollfd fds[] = {
+                {STDIN_FILENO,    POLLIN, 0},
+                {get_prompt_fd(), POLLIN, 0},
+        };
+        if (wait_events(fds, sizeof(fds) / sizeof(fds[0])) < 0) {
+            rl_callback_handler_remove();
+            return NULL;
+        }
+        if (take_interrupt()) {
+            cancel_line();
+        }
+        if (has_job_reports()) {
+            report_jobs();
+        }
+        if (fds[1].revents) {
+            refresh_prompt();
+        }
+        if (fds[0].revents) {
+            rl_callback_read_char();
+        }
     }
-    return *string == '\0';
+    return ACCEPTED_LINE;
+}
+
+bool is_interactive(void) {
+    return !SCRIPT;
 }
 
 struct Tokens input(void) {
     char* string = NULL;
 
+    if (SCRIPT) {
+        collect_jobs(false);
+        const uint64_t start = is_tracing ? trace_now() : 0;
+        do {
+            string = read_script_line();
+        } while (is_skip(string));
+        if (is_tracing) {
+            trace_span("read", "shell", start, trace_now(), 0, NULL);
+        }
+        return trace_tokenize(string);
+    }
+
+    const uint64_t start = is_tracing ? trace_now() : 0;
     while (true) {
-        char* prompt = get_prompt();
-        string = readline(prompt);
-        free(prompt);
+        collect_jobs(true);
+        string = read_terminal_line();
 
         if (!is_skip(string)) {
             break;
         }
         rl_free(string);
     }
-    add_history(string);
-
-    return tokenize(string);
-}
-
-void free_tokens(struct Tokens tokens) {
-    if (!tokens.data || tokens.state == INVALID) {
-        return;
+    remember_line(string);
+    if (is_tracing) {
+        trace_span("read", "shell", start, trace_now(), 0, NULL);
     }
-    for (size_t i = 0; i < tokens.amount; ++i) {
-        free(tokens.data[i]);
+
+    char* line = arena_strndup(&line_arena, string, strlen(string));
+    rl_free(string);
+    if (!line) {
+        return INVALID_TOKENS;
     }
-    free(tokens.data);
+    return trace_tokenize(line);
 }
@@ -25,6 +25,7 @@
 #ifndef KARASHI_SCANNER_H
 #define KARASHI_SCANNER_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /**
@@ -35,31 +36,92 @@ enum TokensState {
     INVALID, ///< Invalid Tokens state. It is unsafe to use such Tokens.
 };
 
+/**
+ * @brief Kind of Token structure.
+ */
+enum TokenKind {
+    WORD,         ///< Command name, argument or file path.
+    PIPE,         ///< Pipe operator "|".
+    REDIRECT_IN,  ///< Stdin redirection operator "<".
+    REDIRECT_OUT, ///< Stdout redirection operator ">".
+    REDIRECT_ERR, ///< Stderr redirection operator "2>".
+    BACKGROUND,   ///< Background job operator "&".
+    SEMICOLON,    ///< Sequence operator ";".
+    AND,          ///< Run next pipeline on success "&&".
+    OR,           ///< Run next pipeline on failure "||".
+    PROCESS_IN,   ///< Process substitution read by command "<(".
+    PROCESS_OUT,  ///< Process substitution written by command ">(".
+    CLOSE,        ///< End of process substitution ")".
+};
+
+/**
+ * @brief View of a single token in the input line.
+ */
+struct Token {
+    enum TokenKind kind; ///< Represent kind of Token structure.
+    size_t offset;       ///< Offset of the token in the line.
+    size_t length;       ///< Length of the token in the line.
+    bool is_quoted;      ///< True if word contains quotes or backslashes.
+    bool is_expandable;  ///< True if word keeps raw text for expansion.
+    bool is_assignment;  ///< True if word starts with "NAME=".
+    char* text;          ///< Word value, NULL for operators.
+};
+
 /**
  * @brief Array of tokens.
  *
- * @details Each token represented as C-style string.
+ * @details Word text points into the line itself, quotes are removed in
+ * place. Words with "$" or leading "~" keep their quotes and are expanded
+ * when command is launched. Tokens are allocated in line_arena and released
+ * together with AbstractSyntaxTree.
  */
 struct Tokens {
     enum TokensState state; ///< Represent state of Tokens structure.
-    char** data;            ///< Array of tokens.
+    char* line;             ///< Line the tokens refer to.
+    struct Token* data;     ///< Array of tokens.
     size_t amount;          ///< Amount of allocated tokens.
 };
 
 /**
- * @brief Takes user input and converts it into tokens.
+ * @brief Switches input to non-interactive mode reading from file descriptor.
  *
- * @details Reads a line from the user, tokenizes it, and returns the tokens.
+ * @details Lines are read with large buffered reads and tokenized straight
+ * from the buffer, no prompt is rendered and no history is kept. Commands
+ * inherit stdin, so when it is the script, they must see the rest of it:
+ * seekable stdin is still buffered and its offset is moved back after every
+ * line, while pipe is read byte by byte, as bash does.
  *
- * @return Tokens struct.
+ * @param[in] fd The file descriptor to read commands from.
+ *
+ * @return True on success, otherwise false.
  */
-struct Tokens input(void);
+bool read_script_fd(int fd);
 
 /**
- * @brief Frees the memory allocated for the tokens.
+ * @brief Switches input to non-interactive mode reading from string.
+ *
+ * @param[in] string Commands separated by new lines.
  *
- * @param[in] tokens The Tokens to free.
+ * @return True on success, otherwise false.
  */
-void free_tokens(struct Tokens tokens);
+bool read_script_string(const char string[]);
+
+/**
+ * @brief Determine if shell reads commands from the user.
+ *
+ * @return False in script mode, otherwise true.
+ */
+bool is_interactive(void);
+
+/**
+ * @brief Takes user input and converts it into tokens.
+ *
+ * @details Reads a line from the user or from the script, tokenizes it, and
+ * returns the tokens. Finished background jobs are collected before each
+ * line and reported before each prompt. Quits the shell when input is over.
+ *
+ * @return Tokens struct.
+ */
+struct Tokens input(void);
 
 #endif //KARASHI_SCANNER_H
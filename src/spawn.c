@@ -0,0 +1,145 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file spawn.c
+ *
+ * @brief Launch external commands without copying shell address space.
+ */
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include <spawn.h>
+#include <unistd.h>
+
+#include "utility.h"
+
+extern char** environ;
+
+enum LaunchBackend launch_backend = SPAWN_BACKEND;
+
+void set_launch_backend(void) {
+    const char* value = getenv(LAUNCH_ENV);
+    if (!value || !strcmp(value, "spawn")) {
+        launch_backend = SPAWN_BACKEND;
+    } else if (!strcmp(value, "fork")) {
+        launch_backend = FORK_BACKEND;
+    } else {
+        printf(BOLD_RED);
+        printf("kara: unknown %s value %s, using spawn\n", LAUNCH_ENV, value);
+        printf(RESET);
+        launch_backend = SPAWN_BACKEND;
+    }
+}
+
+bool can_spawn(const struct Command* command) {
+    return launch_backend == SPAWN_BACKEND && command->type == EXTERNAL &&
+           !command->assignments;
+}
+
+/**
+ * @brief Fills spawn file actions with redirections and pipes.
+ *
+ * @param[in,out] actions Initialized spawn file actions.
+ * @param[in] command The command to launch.
+ * @param[in] fds File descriptors to use as stdin, stdout and stderr.
+ *
+ * @return Zero on success, otherwise error number.
+ */
+static int add_file_actions(posix_spawn_file_actions_t* actions,
+                            const struct Command* command, const int fds[]) {
+    int error = 0;
+    for (int i = 0; i < TOTAL_STREAMS && !error; ++i) {
+        if (command->redirect[i]) {
+            error = posix_spawn_file_actions_addopen(actions, i,
+                                                     command->redirect[i],
+                                                     REDIRECT_FLAGS,
+                                                     REDIRECT_MODE);
+        }
+    }
+    for (int i = 0; i < TOTAL_STREAMS && !error; ++i) {
+        if (fds[i] != i) {
+            error = posix_spawn_file_actions_adddup2(actions, fds[i], i);
+        }
+    }
+    return error;
+}
+
+/**
+ * @brief Fills spawn attributes with process group and signal mask.
+ *
+ * @param[in,out] attributes Initialized spawn attributes.
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
+ *
+ * @return Zero on success, otherwise error number.
+ */
+static int set_attributes(posix_spawnattr_t* attributes, pid_t pgid) {
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    int error = posix_spawnattr_setsigmask(attributes, &mask);
+    if (!error && pgid != -1) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        error = posix_spawnattr_setpgroup(attributes, pgid);
+    }
+    if (!error) {
+        error = posix_spawnattr_setflags(attributes, flags);
+    }
+    return error;
+}
+
+pid_t spawn_command(const struct Command* command, const char path[],
+                    const int fds[], pid_t pgid) {
+    posix_spawn_file_actions_t actions;
+    int error = posix_spawn_file_actions_init(&actions);
+    if (error) {
+        printf(BOLD_RED "kara: %s" RESET "\n", strerror(error));
+        return -1;
+    }
+    posix_spawnattr_t attributes;
+    error = posix_spawnattr_init(&attributes);
+    if (error) {
+        posix_spawn_file_actions_destroy(&actions);
+        printf(BOLD_RED "kara: %s" RESET "\n", strerror(error));
+        return -1;
+    }
+
+    pid_t pid = -1;
+    error = add_file_actions(&actions, command, fds);
+    if (!error) {
+        error = set_attributes(&attributes, pgid);
+    }
+    if (!error) {
+        error = posix_spawn(&pid, path, &actions, &attributes,
+                            command->args, environ);
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error) {
+        printf(BOLD_RED "kara: failed to run %s: %s" RESET "\n",
+               command->name, strerror(error));
+        return -1;
+    }
+    return pid;
+}
@@ -0,0 +1,89 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file spawn.h
+ *
+ * @brief Fast launch path for external commands via posix_spawn().
+ *
+ * @see spawn.c
+ */
+
+#ifndef KARASHI_SPAWN_H
+#define KARASHI_SPAWN_H
+
+#include <stdbool.h>
+
+#include <sys/types.h>
+#include <fcntl.h>
+
+#include "parser.h"
+
+#define LAUNCH_ENV "KARA_LAUNCH" ///< Environment variable to select backend.
+
+#define REDIRECT_FLAGS (O_RDWR | O_CREAT) ///< Flags to open redirect files.
+/// Permissions of files created by redirections.
+#define REDIRECT_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
+
+/**
+ * @brief Way to launch external commands.
+ */
+enum LaunchBackend {
+    FORK_BACKEND,  ///< Classic fork() and exec() pair.
+    SPAWN_BACKEND, ///< posix_spawn(), which does not copy shell page tables.
+};
+
+extern enum LaunchBackend launch_backend; ///< Currently selected backend.
+
+/**
+ * @brief Selects launch backend from LAUNCH_ENV environment variable.
+ *
+ * @details Accepts "fork" and "spawn", default is spawn backend.
+ */
+void set_launch_backend(void);
+
+/**
+ * @brief Determine if command can be launched with posix_spawn().
+ *
+ * @details Only external commands without assignments in front of them are
+ * supported, everything else must fall back to fork().
+ *
+ * @param[in] command The command to check.
+ *
+ * @return True if spawn backend is selected and command is supported.
+ */
+bool can_spawn(const struct Command* command);
+
+/**
+ * @brief Launches external command with posix_spawn().
+ *
+ * @details Redirections and pipe file descriptors are applied via spawn file
+ * actions in the same order as fork backend does. Child starts with empty
+ * signal mask, since shell keeps signals of the event loop blocked.
+ *
+ * @param[in] command The command to launch.
+ * @param[in] path The path to the command executable.
+ * @param[in] fds File descriptors to use as stdin, stdout and stderr, equal
+ * to stream number if stream is inherited.
+ * @param[in] pgid Process group to join, 0 for a new group, -1 to stay in
+ * shell group.
+ *
+ * @return Process id of the new child process, or -1 on failure.
+ */
+pid_t spawn_command(const struct Command* command, const char path[],
+                    const int fds[], pid_t pgid);
+
+#endif //KARASHI_SPAWN_H
@@ -0,0 +1,211 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file substitution.c
+ *
+ * @brief Process substitution "<(list)" and ">(list)" over /dev/fd.
+ *
+ * @details Nothing is written to disk, the command and the subshell talk
+ * through a pipe. Subshells belong to the job of the command, so the shell
+ * waits for them and job control signals reach them too.
+ */
+
+#define _GNU_SOURCE
+
+#include "substitution.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "arena.h"
+#include "executor.h"
+#include "trace.h"
+#include "utility.h"
+
+#define FD_PATH_SIZE 32 ///< Enough for "/dev/fd/" and any descriptor.
+
+size_t count_substitutions(const struct Command* command) {
+    size_t amount = 0;
+    for (const struct Substitution* substitution = command->substitutions;
+         substitution; substitution = substitution->next) {
+        ++amount;
+    }
+    return amount;
+}
+
+/**
+ * @brief Called after fork in subshell of process substitution.
+ *
+ * @param[in] substitution The substitution to run.
+ * @param[in] stream Pipe end of the subshell.
+ * @param[in] inherited Pipes kept by the shell to close.
+ * @param[in] inherited_amount Amount of inherited pipes.
+ */
+static void substitution_process_handler(
+        const struct Substitution* substitution, int stream,
+        const int inherited[], size_t inherited_amount) {
+    detach_jobs();
+    detach_trace();
+    // Stages of the pipeline are waiting for the shell to release the gate
+    release_start_gate();
+
+    for (size_t i = 0; i < inherited_amount; ++i) {
+        if (inherited[i] != -1) {
+            close(inherited[i]);
+        }
+    }
+    const int std_stream = substitution->is_output ? STDIN_FILENO
+                                                   : STDOUT_FILENO;
+    if (dup2(stream, std_stream) == -1) {
+        print_errno();
+        _exit(EXIT_FAILURE);
+    }
+    close(stream);
+
+    const int status = execute_node(substitution->list);
+    fflush(stdout);
+    flush_trace();
+    _exit(status);
+}
+
+/**
+ * @brief Replaces argument of the command by /dev/fd/N path.
+ *
+ * @param[in,out] command Copy of the command, its arguments are copied before
+ * the first replacement.
+ * @param[in] is_copied True if arguments are already copied.
+ * @param[in] arg Index of the argument.
+ * @param[in] fd The file descriptor to refer to.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool replace_arg(struct Command* command, bool is_copied, size_t arg,
+                        int fd) {
+    if (!is_copied) {
+        char** args = arena_alloc(&line_arena,
+                                  command->args_amount * sizeof(char*));
+        if (!args) {
+            return false;
+        }
+        memcpy(args, command->args, command->args_amount * sizeof(char*));
+        command->args = args;
+    }
+    char* path = arena_alloc(&line_arena, FD_PATH_SIZE);
+    if (!path) {
+        return false;
+    }
+    snprintf(path, FD_PATH_SIZE, "/dev/fd/%d", fd);
+    command->args[arg] = path;
+    return true;
+}
+
+int* launch_substitutions(struct Command* command, int fds[], int next_pipe,
+                          struct Job* job) {
+    const size_t amount = count_substitutions(command);
+    // Subshell closes streams of the command, the next pipe and ends of
+    // substitutions launched before it
+    int* inherited = arena_alloc(&line_arena,
+                                 (TOTAL_STREAMS + 1 + amount) * sizeof(int));
+    if (!inherited) {
+        return NULL;
+    }
+    int* ends = inherited + TOTAL_STREAMS + 1;
+    for (size_t i = 0; i < amount; ++i) {
+        ends[i] = -1;
+    }
+
+    size_t i = 0;
+    bool is_copied = false;
+    for (const struct Substitution* substitution = command->substitutions;
+         substitution; substitution = substitution->next, ++i) {
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC)) {
+            print_errno();
+            close_substitutions(ends, amount);
+            return NULL;
+        }
+        const int shell_end = pipe_fds[substitution->is_output ? 1 : 0];
+        const int subshell_end = pipe_fds[substitution->is_output ? 0 : 1];
+
+        for (int j = 0; j < TOTAL_STREAMS; ++j) {
+            inherited[j] = (fds[j] != j) ? fds[j] : -1;
+        }
+        inherited[TOTAL_STREAMS] = next_pipe;
+
+        const pid_t pgid = job->is_background ? job->pgid : -1;
+        const pid_t pid = fork();
+        if (pid < 0) {
+            print_errno();
+            close(shell_end);
+            close(subshell_end);
+            close_substitutions(ends, amount);
+            return NULL;
+        } else if (!pid) { // Subshell
+            if (pgid != -1) {
+                setpgid(0, pgid);
+            }
+            close(shell_end);
+            substitution_process_handler(substitution, subshell_end,
+                                         inherited,
+                                         TOTAL_STREAMS + 1 + amount);
+        }
+        if (pgid != -1) {
+            setpgid(pid, pgid ? pgid : pid);
+        }
+        close(subshell_end);
+        if (!add_process(job, pid)) {
+            kill(pid, SIGKILL);
+        }
+
+        const int std_stream = substitution->std_stream;
+        if (std_stream != -1) {
+            // Redirection wins over the pipe, like redirection to a file
+            if (fds[std_stream] != std_stream) {
+                close(fds[std_stream]);
+            }
+            fds[std_stream] = shell_end;
+            command->redirect[std_stream] = NULL;
+            command->multios[std_stream] = NULL;
+            continue;
+        }
+        ends[i] = shell_end;
+        // Command opens the pipe by path, so it must survive exec
+        fcntl(shell_end, F_SETFD, 0);
+        if (!replace_arg(command, is_copied, substitution->arg, shell_end)) {
+            close_substitutions(ends, amount);
+            return NULL;
+        }
+        is_copied = true;
+    }
+    return ends;
+}
+
+void close_substitutions(const int ends[], size_t amount) {
+    if (!ends) {
+        return;
+    }
+    for (size_t i = 0; i < amount; ++i) {
+        if (ends[i] != -1) {
+            close(ends[i]);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+
+/**
+ * @file substitution.h
+ *
+ * @brief Process substitution "<(list)" and ">(list)" over /dev/fd.
+ *
+ * @see substitution.c
+ */
+
+#ifndef KARASHI_SUBSTITUTION_H
+#define KARASHI_SUBSTITUTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "child.h"
+#include "parser.h"
+
+/**
+ * @brief Counts process substitutions of the command.
+ *
+ * @param[in] command The command to count substitutions of.
+ *
+ * @return Amount of substitutions.
+ */
+size_t count_substitutions(const struct Command* command);
+
+/**
+ * @brief Launches subshell for every process substitution of the command
+ * and adds them to the job.
+ *
+ * @details Every subshell is connected to the shell with a pipe. Substituted
+ * argument is replaced by /dev/fd/N path of the pipe end kept by the shell,
+ * which is made inheritable, so the command opens it by the path. Substituted
+ * redirection replaces the stream in fds. Subshells close pipes of the
+ * pipeline kept by the shell.
+ *
+ * @param[in,out] command Copy of the command, its arguments and redirections
+ * are replaced.
+ * @param[in,out] fds Streams of the command, equal to stream number if stream
+ * is not piped.
+ * @param[in] next_pipe The read end of the next pipe, -1 for none.
+ * @param[in,out] job The job of the pipeline.
+ *
+ * @return Pipe ends of substituted arguments to close after the command is
+ * launched, count_substitutions() of them, -1 for redirections. NULL on
+ * failure.
+ */
+int* launch_substitutions(struct Command* command, int fds[], int next_pipe,
+                          struct Job* job);
+
+/**
+ * @brief Closes pipe ends of substituted arguments kept by the shell.
+ *
+ * @param[in] ends Pipe ends returned by launch_substitutions(), may be NULL.
+ * @param[in] amount Amount of pipe ends.
+ */
+void close_substitutions(const int ends[], size_t amount);
+
+#endif //KARASHI_SUBSTITUTION_H
@@ -0,0 +1,190 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file timing.c
+ *
+ * @brief Format resource usage of pipeline stages.
+ */
+
+#include "timing.h"
+
+#include <stdio.h>
+
+#include <sys/time.h>
+
+/**
+ * @brief Converts timeval to seconds.
+ *
+ * @param[in] time The time to convert.
+ *
+ * @return Seconds.
+ */
+static double to_seconds(struct timeval time) {
+    return (double) time.tv_sec + (double) time.tv_usec / 1e6;
+}
+
+/**
+ * @brief Subtracts timevals.
+ *
+ * @param[in] before The earlier time.
+ * @param[in] after The later time.
+ *
+ * @return Difference, never negative.
+ */
+static struct timeval subtract_time(struct timeval before,
+                                    struct timeval after) {
+    struct timeval result;
+    timersub(&after, &before, &result);
+    if (result.tv_sec < 0) {
+        result.tv_sec = 0;
+        result.tv_usec = 0;
+    }
+    return result;
+}
+
+double get_elapsed(const struct timespec* start, const struct timespec* end) {
+    return (double) (end->tv_sec - start->tv_sec) +
+           (double) (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+struct rusage subtract_usage(const struct rusage* before,
+                             const struct rusage* after) {
+    struct rusage usage = *after;
+    usage.ru_utime = subtract_time(before->ru_utime, after->ru_utime);
+    usage.ru_stime = subtract_time(before->ru_stime, after->ru_stime);
+    usage.ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+    usage.ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+    usage.ru_inblock = after->ru_inblock - before->ru_inblock;
+    usage.ru_oublock = after->ru_oublock - before->ru_oublock;
+    return usage;
+}
+
+/**
+ * @brief Formats size in KiB with binary unit.
+ *
+ * @param[out] buffer Where to write.
+ * @param[in] size Size of the buffer.
+ * @param[in] kibibytes The size to format.
+ */
+static void format_size(char buffer[], size_t size, long kibibytes) {
+    static const char* const UNITS[] = {"KiB", "MiB", "GiB", "TiB"};
+
+    double value = (double) kibibytes;
+    size_t unit = 0;
+    while (value >= 1024 && unit + 1 < sizeof(UNITS) / sizeof(UNITS[0])) {
+        value /= 1024;
+        ++unit;
+    }
+    snprintf(buffer, size, "%.1f %s", value, UNITS[unit]);
+}
+
+/**
+ * @brief Prints single row of human readable table.
+ *
+ * @param[in] fd The file descriptor to print to.
+ * @param[in] label Stage number or "total".
+ * @param[in] name The command name.
+ * @param[in] real Wall time in seconds.
+ * @param[in] usage Resource usage.
+ * @param[in] status Exit status text.
+ */
+static void print_row(int fd, const char label[], const char name[],
+                      double real, const struct rusage* usage,
+                      const char status[]) {
+    char rss[32];
+    char switches[48];
+    char blocks[48];
+    format_size(rss, sizeof(rss), usage->ru_maxrss);
+    snprintf(switches, sizeof(switches), "%ld/%ld",
+             usage->ru_nvcsw, usage->ru_nivcsw);
+    snprintf(blocks, sizeof(blocks), "%ld/%ld",
+             usage->ru_inblock, usage->ru_oublock);
+    dprintf(fd, "%-6s %-12.12s %9.3fs %9.3fs %9.3fs %11s %13s %13s %7s\n",
+            label, name, real, to_seconds(usage->ru_utime),
+            to_seconds(usage->ru_stime), rss, switches, blocks, status);
+}
+
+/**
+ * @brief Prints single line of portable format.
+ *
+ * @param[in] fd The file descriptor to print to.
+ * @param[in] label Stage number or "total".
+ * @param[in] stage Timing of the stage, NULL for total.
+ * @param[in] real Wall time in seconds.
+ * @param[in] usage Resource usage.
+ */
+static void print_pairs(int fd, const char label[],
+                        const struct StageTiming* stage, double real,
+                        const struct rusage* usage) {
+    dprintf(fd, "stage=%s", label);
+    if (stage) {
+        dprintf(fd, " command=%s", stage->name);
+        if (stage->pid == NOT_RUN_PID) {
+            dprintf(fd, " pid=-");
+        } else {
+            dprintf(fd, " pid=%d", (int) stage->pid);
+        }
+        dprintf(fd, " status=%d", stage->status);
+    }
+    dprintf(fd, " real=%.6f user=%.6f sys=%.6f maxrss_kib=%ld"
+                " nvcsw=%ld nivcsw=%ld inblock=%ld oublock=%ld\n",
+            real, to_seconds(usage->ru_utime), to_seconds(usage->ru_stime),
+            usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw,
+            usage->ru_inblock, usage->ru_oublock);
+}
+
+void print_timing(int fd, enum TimeFormat format,
+                  const struct StageTiming stages[], size_t amount,
+                  double real) {
+    if (format == HUMAN_TIME) {
+        dprintf(fd, "%-6s %-12s %10s %10s %10s %11s %13s %13s %7s\n",
+                "stage", "command", "real", "user", "sys", "max rss",
+                "ctxsw v/i", "blocks i/o", "status");
+    }
+
+    struct rusage total = {0};
+    for (size_t i = 0; i < amount; ++i) {
+        const struct rusage* usage = &stages[i].usage;
+        timeradd(&total.ru_utime, &usage->ru_utime, &total.ru_utime);
+        timeradd(&total.ru_stime, &usage->ru_stime, &total.ru_stime);
+        if (usage->ru_maxrss > total.ru_maxrss) {
+            total.ru_maxrss = usage->ru_maxrss;
+        }
+        total.ru_nvcsw += usage->ru_nvcsw;
+        total.ru_nivcsw += usage->ru_nivcsw;
+        total.ru_inblock += usage->ru_inblock;
+        total.ru_oublock += usage->ru_oublock;
+
+        char label[32];
+        snprintf(label, sizeof(label), "%zu", i + 1);
+        if (format == PORTABLE_TIME) {
+            print_pairs(fd, label, &stages[i], stages[i].real, usage);
+            continue;
+        }
+        char status[32] = "not run";
+        if (stages[i].pid != NOT_RUN_PID) {
+            snprintf(status, sizeof(status), "%d", stages[i].status);
+        }
+        print_row(fd, label, stages[i].name, stages[i].real, usage, status);
+    }
+
+    if (format == PORTABLE_TIME) {
+        print_pairs(fd, "total", NULL, real, &total);
+    } else {
+        print_row(fd, "total", "", real, &total, "");
+    }
+}
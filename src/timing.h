@@ -0,0 +1,91 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file timing.h
+ *
+ * @brief Report of resource usage of pipeline stages for "time" keyword.
+ *
+ * @see timing.c
+ */
+
+#ifndef KARASHI_TIMING_H
+#define KARASHI_TIMING_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "parser.h"
+
+#define NOT_RUN_PID (-1) ///< Process id of stage which was not launched.
+#define IN_SHELL_PID 0   ///< Process id of built-in run inside shell.
+
+/**
+ * @brief Measurements of single pipeline stage.
+ */
+struct StageTiming {
+    const char* name;     ///< Name of the command.
+    pid_t pid;            ///< Process id, NOT_RUN_PID or IN_SHELL_PID.
+    int status;           ///< Exit status of the stage.
+    double real;          ///< Wall time in seconds.
+    struct rusage usage;  ///< Resource usage of the stage.
+};
+
+/**
+ * @brief Computes seconds between two moments.
+ *
+ * @param[in] start The earlier moment.
+ * @param[in] end The later moment.
+ *
+ * @return Elapsed time in seconds.
+ */
+double get_elapsed(const struct timespec* start, const struct timespec* end);
+
+/**
+ * @brief Computes usage of code run between two getrusage() calls.
+ *
+ * @details Max RSS is taken from after, since it is not additive.
+ *
+ * @param[in] before Usage before the code.
+ * @param[in] after Usage after the code.
+ *
+ * @return Difference of usages.
+ */
+struct rusage subtract_usage(const struct rusage* before,
+                             const struct rusage* after);
+
+/**
+ * @brief Prints timing of every stage and total of the pipeline.
+ *
+ * @details Human format is a table, portable format is a line of key=value
+ * pairs per stage followed by "stage=total" line. Total user and sys time,
+ * context switches and block I/O are sums over stages, max RSS is the
+ * largest one, real time is wall time of the whole pipeline.
+ *
+ * @param[in] fd The file descriptor to print to.
+ * @param[in] format The report format.
+ * @param[in] stages Timings of stages.
+ * @param[in] amount Amount of stages.
+ * @param[in] real Wall time of the whole pipeline in seconds.
+ */
+void print_timing(int fd, enum TimeFormat format,
+                  const struct StageTiming stages[], size_t amount,
+                  double real);
+
+#endif //KARASHI_TIMING_H
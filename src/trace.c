@@ -0,0 +1,190 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file trace.c
+ *
+ * @brief Buffer trace events and append them to trace file.
+ *
+ * @details The file is a JSON array of complete ("X") events, one per line.
+ * The array is left open, which the format explicitly allows, so subshells
+ * can append events even after the shell exits.
+ */
+
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "utility.h"
+
+#define TRACE_BUFFER_SIZE (64 * 1024) ///< Size of events buffer.
+#define MAX_EVENT_SIZE 1024           ///< Max length of single event.
+
+bool is_tracing = false;
+
+/**
+ * @brief Trace file, -1 when tracing is disabled.
+ */
+static int TRACE_FD = -1;
+
+/**
+ * @brief Process which owns buffered events.
+ */
+static pid_t OWNER_PID;
+
+/**
+ * @brief Buffered events.
+ */
+static char BUFFER[TRACE_BUFFER_SIZE];
+
+/**
+ * @brief Amount of buffered bytes.
+ */
+static size_t USED = 0;
+
+void flush_trace(void) {
+    if (TRACE_FD == -1 || getpid() != OWNER_PID) {
+        return;
+    }
+    const char* data = BUFFER;
+    size_t length = USED;
+    while (length) {
+        const ssize_t written = write(TRACE_FD, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0) {
+            break;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    USED = 0;
+}
+
+void set_tracing(void) {
+    const char* path = getenv(TRACE_ENV);
+    if (!path || !*path) {
+        return;
+    }
+    // Subshells write through their own buffers, O_APPEND keeps their events
+    // from overwriting each other after the old trace is truncated
+    TRACE_FD = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (TRACE_FD < 0) {
+        print_errno();
+        return;
+    }
+    OWNER_PID = getpid();
+    is_tracing = true;
+
+    USED = (size_t) snprintf(BUFFER, sizeof(BUFFER),
+                             "[{\"name\":\"process_name\",\"ph\":\"M\","
+                             "\"pid\":%d,\"tid\":0,"
+                             "\"args\":{\"name\":\"kara\"}}\n",
+                             (int) OWNER_PID);
+    // Header goes to the file before any subshell can append its events
+    flush_trace();
+    atexit(flush_trace);
+}
+
+uint64_t trace_time(const struct timespec* time) {
+    return (uint64_t) time->tv_sec * 1000000 +
+           (uint64_t) time->tv_nsec / 1000;
+}
+
+uint64_t trace_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return trace_time(&now);
+}
+
+/**
+ * @brief Copies string escaping JSON special characters.
+ *
+ * @param[out] out Where to write.
+ * @param[in] size Size of out, result is truncated to fit.
+ * @param[in] string The string to escape.
+ */
+static void escape_json(char out[], size_t size, const char string[]) {
+    size_t used = 0;
+    for (; *string && used + 7 < size; ++string) {
+        const unsigned char c = (unsigned char) *string;
+        if (c == '"' || c == '\\') {
+            out[used++] = '\\';
+            out[used++] = (char) c;
+        } else if (c < 0x20) {
+            used += (size_t) snprintf(out + used, size - used, "\\u%04x", c);
+        } else {
+            out[used++] = (char) c;
+        }
+    }
+    out[used] = '\0';
+}
+
+void trace_span(const char name[], const char category[], uint64_t start,
+                uint64_t end, pid_t tid, const char detail[]) {
+    if (TRACE_BUFFER_SIZE - USED < MAX_EVENT_SIZE) {
+        flush_trace();
+    }
+
+    char escaped[MAX_EVENT_SIZE / 2] = "";
+    if (detail) {
+        escape_json(escaped, sizeof(escaped), detail);
+    }
+    const int length = snprintf(
+            BUFFER + USED, MAX_EVENT_SIZE,
+            ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,"
+            "\"dur\":%llu,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"command\":\"%s\"}}\n",
+            name, category, (unsigned long long) start,
+            (unsigned long long) (end > start ? end - start : 0),
+            (int) OWNER_PID, (int) tid, escaped);
+    if (length > 0 && length < MAX_EVENT_SIZE) {
+        USED += (size_t) length;
+    }
+}
+
+uint64_t* create_trace_stamps(size_t amount) {
+    void* stamps = mmap(NULL, 2 * amount * sizeof(uint64_t),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+    if (stamps == MAP_FAILED) {
+        print_errno();
+        return NULL;
+    }
+    return stamps;
+}
+
+void free_trace_stamps(uint64_t* stamps, size_t amount) {
+    if (!stamps) {
+        return;
+    }
+    munmap(stamps, 2 * amount * sizeof(uint64_t));
+}
+
+void detach_trace(void) {
+    USED = 0;
+    OWNER_PID = getpid();
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file trace.h
+ *
+ * @brief Opt-in tracing of shell phases and child processes in Chrome trace
+ * event format.
+ *
+ * @see trace.c
+ */
+
+#ifndef KARASHI_TRACE_H
+#define KARASHI_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#define TRACE_ENV "KARA_TRACE" ///< Path of the trace file.
+
+/**
+ * @brief True if TRACE_ENV is set and trace file is opened.
+ *
+ * @details Every tracing call site is guarded by this flag, so disabled
+ * tracing costs a single predictable branch.
+ */
+extern bool is_tracing;
+
+/**
+ * @brief Opens trace file named by TRACE_ENV environment variable.
+ */
+void set_tracing(void);
+
+/**
+ * @brief Returns current monotonic time.
+ *
+ * @return Microseconds since unspecified point.
+ */
+uint64_t trace_now(void);
+
+/**
+ * @brief Converts monotonic timespec to trace time.
+ *
+ * @param[in] time The time to convert.
+ *
+ * @return Microseconds since unspecified point.
+ */
+uint64_t trace_time(const struct timespec* time);
+
+/**
+ * @brief Records complete event.
+ *
+ * @param[in] name Name of the span.
+ * @param[in] category Category of the span, "shell" or "child".
+ * @param[in] start Start of the span.
+ * @param[in] end End of the span.
+ * @param[in] tid Thread lane of the span, child pid or 0 for shell.
+ * @param[in] detail Command line shown in span arguments, may be NULL.
+ */
+void trace_span(const char name[], const char category[], uint64_t start,
+                uint64_t end, pid_t tid, const char detail[]);
+
+/**
+ * @brief Allocates launch and exec timestamps of pipeline stages.
+ *
+ * @details Memory is shared with forked children, which write their exec
+ * timestamp right before exec. Stage i uses stamps[i] for launch and
+ * stamps[amount + i] for exec.
+ *
+ * @param[in] amount Amount of stages.
+ *
+ * @return Zeroed stamps, or NULL on failure.
+ */
+uint64_t* create_trace_stamps(size_t amount);
+
+/**
+ * @brief Releases memory allocated by create_trace_stamps().
+ *
+ * @param[in] stamps The stamps to release.
+ * @param[in] amount Amount of stages.
+ */
+void free_trace_stamps(uint64_t* stamps, size_t amount);
+
+/**
+ * @brief Writes buffered events to trace file.
+ */
+void flush_trace(void);
+
+/**
+ * @brief Drops events buffered by the parent in forked subshell.
+ *
+ * @details Subshell appends its own events to the same file.
+ */
+void detach_trace(void);
+
+#endif //KARASHI_TRACE_H
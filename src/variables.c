@@ -0,0 +1,366 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file variables.c
+ *
+ * @brief Hash table of shell variables synchronized with the environment.
+ */
+
+#define _GNU_SOURCE
+
+#include "variables.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "built-in.h"
+#include "utility.h"
+
+#define BUCKETS 256 ///< Amount of hash table buckets, power of two.
+
+extern char** environ;
+
+pid_t shell_pid;
+unsigned long variables_version = 0;
+
+/**
+ * @brief Single shell variable.
+ */
+struct Variable {
+    char* name;             ///< Name of the variable.
+    size_t length;          ///< Length of the name.
+    char* value;            ///< Value of the variable.
+    bool is_exported;       ///< True if variable is in the environment.
+    bool is_readonly;       ///< True if variable cannot be changed.
+    struct Variable* next;  ///< Next variable in the same bucket.
+};
+
+/**
+ * @brief Hash table with separate chaining.
+ */
+static struct Variable* TABLE[BUCKETS];
+
+/**
+ * @brief FNV-1a hash of the name.
+ *
+ * @param[in] name The name to hash.
+ * @param[in] length Length of the name.
+ *
+ * @return Bucket index.
+ */
+static size_t hash_name(const char name[], size_t length) {
+    size_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash & (BUCKETS - 1);
+}
+
+bool is_variable_name(const char name[], size_t length) {
+    if (!length || (name[0] >= '0' && name[0] <= '9')) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        const char c = name[i];
+        if (c != '_' && !(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') &&
+            !(c >= '0' && c <= '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Finds variable in the table.
+ *
+ * @param[in] name The name of the variable, not necessarily terminated.
+ * @param[in] length Length of the name.
+ *
+ * @return The variable, or NULL if it does not exist.
+ */
+static struct Variable* find_variable(const char name[], size_t length) {
+    for (struct Variable* variable = TABLE[hash_name(name, length)];
+         variable; variable = variable->next) {
+        if (variable->length == length &&
+            !memcmp(variable->name, name, length)) {
+            return variable;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds variable in the table, or adds unset one.
+ *
+ * @param[in] name The name of the variable, not necessarily terminated.
+ * @param[in] length Length of the name.
+ *
+ * @return The variable, or NULL on allocation failure.
+ */
+static struct Variable* get_entry(const char name[], size_t length) {
+    struct Variable* variable = find_variable(name, length);
+    if (variable) {
+        return variable;
+    }
+
+    variable = calloc(1, sizeof(struct Variable));
+    if (!check_alloc(variable, "variable")) {
+        return NULL;
+    }
+    variable->name = strndup(name, length);
+    if (!check_alloc(variable->name, "variable name")) {
+        free(variable);
+        return NULL;
+    }
+    variable->length = length;
+
+    const size_t index = hash_name(name, length);
+    variable->next = TABLE[index];
+    TABLE[index] = variable;
+    return variable;
+}
+
+/**
+ * @brief Replaces value of the variable, ignoring read-only flag.
+ *
+ * @param[in,out] variable The variable to change.
+ * @param[in] value The new value.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool assign(struct Variable* variable, const char value[]) {
+    char* copy = strdup(value);
+    if (!check_alloc(copy, "variable value")) {
+        return false;
+    }
+    free(variable->value);
+    variable->value = copy;
+    ++variables_version;
+
+    if (variable->is_exported && setenv(variable->name, copy, 1)) {
+        print_errno();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Prints error about change of read-only variable.
+ *
+ * @param[in] fds File descriptors of built-in command, NULL for the shell.
+ * @param[in] name The name of the variable.
+ */
+static void print_readonly_error(const int fds[], const char name[]) {
+    if (fds) {
+        print_builtin_error(fds, "%s: readonly variable", name);
+    } else {
+        printf(BOLD_RED "kara: %s: readonly variable" RESET "\n", name);
+    }
+}
+
+/**
+ * @brief Exports PWD unless it is absolute path of the current directory.
+ */
+static void init_pwd(void) {
+    struct Variable* variable = get_entry("PWD", strlen("PWD"));
+    if (!variable) {
+        return;
+    }
+    variable->is_exported = true;
+
+    struct stat logical;
+    struct stat physical;
+    if (variable->value && variable->value[0] == '/'
+        && !stat(variable->value, &logical) && !stat(".", &physical)
+        && logical.st_dev == physical.st_dev
+        && logical.st_ino == physical.st_ino) {
+        return;
+    }
+
+    char* cwd = getcwd(NULL, 0);
+    if (!cwd) {
+        print_errno();
+        return;
+    }
+    assign(variable, cwd);
+    free(cwd);
+}
+
+void init_variables(void) {
+    shell_pid = getpid();
+    for (char** entry = environ; *entry; ++entry) {
+        const char* equals = strchr(*entry, '=');
+        if (!equals) {
+            continue;
+        }
+        struct Variable* variable = get_entry(*entry,
+                                              (size_t) (equals - *entry));
+        if (!variable) {
+            return;
+        }
+        variable->value = strdup(equals + 1);
+        if (!check_alloc(variable->value, "variable value")) {
+            return;
+        }
+        variable->is_exported = true;
+    }
+    init_pwd();
+}
+
+const char* get_variable(const char name[], size_t length) {
+    const struct Variable* variable = find_variable(name, length);
+    return variable ? variable->value : NULL;
+}
+
+bool set_variable(const char name[], const char value[]) {
+    struct Variable* variable = get_entry(name, strlen(name));
+    if (!variable) {
+        return false;
+    }
+    if (variable->is_readonly) {
+        print_readonly_error(NULL, name);
+        return false;
+    }
+    return assign(variable, value);
+}
+
+/**
+ * @brief Applies "NAME[=VALUE]" argument of export and readonly.
+ *
+ * @param[in] fds File descriptors of the built-in command.
+ * @param[in] arg The argument.
+ * @param[in] is_exported True to export the variable.
+ * @param[in] is_readonly True to make the variable read-only.
+ *
+ * @return True on success, otherwise false.
+ */
+static bool declare(const int fds[], const char arg[], bool is_exported,
+                    bool is_readonly) {
+    const char* equals = strchrnul(arg, '=');
+    const size_t length = (size_t) (equals - arg);
+    if (!is_variable_name(arg, length)) {
+        print_builtin_error(fds, "%s: not a valid identifier", arg);
+        return false;
+    }
+
+    struct Variable* variable = get_entry(arg, length);
+    if (!variable) {
+        return false;
+    }
+    if (*equals && variable->is_readonly) {
+        print_readonly_error(fds, variable->name);
+        return false;
+    }
+    if (is_exported && !variable->is_exported) {
+        variable->is_exported = true;
+        if (variable->value && setenv(variable->name, variable->value, 1)) {
+            print_builtin_error(fds, "%s: %s", arg, strerror(errno));
+            return false;
+        }
+    }
+    if (*equals && !assign(variable, equals + 1)) {
+        return false;
+    }
+    variable->is_readonly |= is_readonly;
+    return true;
+}
+
+/**
+ * @brief Prints variables with the flag set, so they can be read back.
+ *
+ * @param[in] fd The file descriptor to print to.
+ * @param[in] command Name of the built-in command.
+ * @param[in] is_readonly True to list read-only variables, otherwise
+ * exported ones.
+ */
+static void print_variables(int fd, const char command[], bool is_readonly) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        for (const struct Variable* variable = TABLE[i]; variable;
+             variable = variable->next) {
+            if (is_readonly ? !variable->is_readonly
+                            : !variable->is_exported) {
+                continue;
+            }
+            if (variable->value) {
+                dprintf(fd, "%s %s='%s'\n", command, variable->name,
+                        variable->value);
+            } else {
+                dprintf(fd, "%s %s\n", command, variable->name);
+            }
+        }
+    }
+}
+
+int export_builtin(int argc, char* argv[], const int fds[]) {
+    if (argc < 2) {
+        print_variables(fds[STDOUT_FILENO], argv[0], false);
+        return EXIT_SUCCESS;
+    }
+    bool is_done = true;
+    for (int i = 1; i < argc; ++i) {
+        is_done &= declare(fds, argv[i], true, false);
+    }
+    return is_done ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int readonly_builtin(int argc, char* argv[], const int fds[]) {
+    if (argc < 2) {
+        print_variables(fds[STDOUT_FILENO], argv[0], true);
+        return EXIT_SUCCESS;
+    }
+    bool is_done = true;
+    for (int i = 1; i < argc; ++i) {
+        is_done &= declare(fds, argv[i], false, true);
+    }
+    return is_done ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int unset_builtin(int argc, char* argv[], const int fds[]) {
+    bool is_done = true;
+    for (int i = 1; i < argc; ++i) {
+        const size_t length = strlen(argv[i]);
+        const size_t index = hash_name(argv[i], length);
+        struct Variable** link = &TABLE[index];
+        while (*link && strcmp((*link)->name, argv[i])) {
+            link = &(*link)->next;
+        }
+
+        struct Variable* variable = *link;
+        if (!variable) {
+            continue;
+        } else if (variable->is_readonly) {
+            print_readonly_error(fds, argv[i]);
+            is_done = false;
+            continue;
+        }
+        if (variable->is_exported) {
+            unsetenv(variable->name);
+        }
+        *link = variable->next;
+        ++variables_version;
+        free(variable->name);
+        free(variable->value);
+        free(variable);
+    }
+    return is_done ? EXIT_SUCCESS : EXIT_FAILURE;
+}
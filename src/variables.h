@@ -0,0 +1,129 @@
+/****************************************************************************
+ * Copyright (c) 2022 Andrey Sikorin.                                       *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, version 3.                                 *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful, but      *
+ * WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU         *
+ * General Public License for more details.                                 *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.     *
+ ****************************************************************************/
+
+/**
+ * @file variables.h
+ *
+ * @brief Shell variables: locals, exported and read-only ones.
+ *
+ * @see variables.c
+ */
+
+#ifndef KARASHI_VARIABLES_H
+#define KARASHI_VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+extern pid_t shell_pid; ///< Process id of the shell, value of "$$".
+
+/**
+ * @brief Incremented on every change of any variable value.
+ *
+ * @details Lets caches of values derived from variables check a single
+ * number instead of comparing values.
+ */
+extern unsigned long variables_version;
+
+/**
+ * @brief Imports environment of the shell as exported variables.
+ *
+ * @details PWD is kept if it names the current directory, otherwise it is
+ * set to the physical path, so PWD is the logical current directory.
+ */
+void init_variables(void);
+
+/**
+ * @brief Determine if string is valid variable name.
+ *
+ * @param[in] name The name to check, not necessarily terminated.
+ * @param[in] length Length of the name.
+ *
+ * @return True for letters, digits and underscores not starting with digit.
+ */
+bool is_variable_name(const char name[], size_t length);
+
+/**
+ * @brief Finds value of variable.
+ *
+ * @details Name is a slice of any string, so expansion does not have to copy
+ * it. Environment is never scanned, it is imported once at startup.
+ *
+ * @param[in] name The name of the variable, not necessarily terminated.
+ * @param[in] length Length of the name.
+ *
+ * @return Value of the variable, or NULL if it is not set. The value is
+ * valid until the variable is changed.
+ */
+const char* get_variable(const char name[], size_t length);
+
+/**
+ * @brief Assigns value to variable, creating it if needed.
+ *
+ * @details Exported variable is updated in the environment too. Error is
+ * printed if the variable is read-only.
+ *
+ * @param[in] name The name of the variable.
+ * @param[in] value The new value.
+ *
+ * @return True on success, otherwise false.
+ */
+bool set_variable(const char name[], const char value[]);
+
+/**
+ * @brief Implementation of export built-in command.
+ *
+ * @details "export NAME[=VALUE]..." marks variables as exported, without
+ * arguments lists exported variables.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero on success, otherwise one.
+ */
+int export_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Implementation of readonly built-in command.
+ *
+ * @details "readonly NAME[=VALUE]..." forbids further changes of variables,
+ * without arguments lists read-only variables.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero on success, otherwise one.
+ */
+int readonly_builtin(int argc, char* argv[], const int fds[]);
+
+/**
+ * @brief Implementation of unset built-in command.
+ *
+ * @details "unset NAME..." removes variables and their environment entries.
+ *
+ * @param[in] argc Amount of arguments including command name.
+ * @param[in] argv Command arguments, argv[0] is command name.
+ * @param[in] fds File descriptors of stdin, stdout and stderr to use.
+ *
+ * @return Zero on success, otherwise one.
+ */
+int unset_builtin(int argc, char* argv[], const int fds[]);
+
+#endif //KARASHI_VARIABLES_H
@@ -3,15 +3,33 @@ cd src
 cat < main.c > ./main.copy.c
 tail -6 main.copy.c
 rm main.copy.c
+echo [a-c]*.h ../**/cases.sh
+cd ../test/..; pwd; echo $OLDPWD
+./kara -c false || echo script failed
+printf 'cat\nshared input\n' | ./kara
+seq 1000 | sed 's/.*/ | cat/;1s/^/echo long/' | tr -d '\n' | prlimit --nofile=256 ./kara
 
 cd ~
 ls
 
 echo $USER
+GREETING=hi; echo ${GREETING}-there$HOME ${UNSET:-default value} $?
+printf "%s has %d builtins\n" kara 10 > /tmp/kara.printf
+cat /tmp/kara.printf
+echo 'single  quoted' "double \"quoted\""|cat # comment
+echo background | cat &
+wait
+false || echo fallback && echo chained; echo sequence
+time echo timed | cat
+pipesize 256K echo sized | cat
+echo copied > /dev/null > /dev/null | cat
+diff <(echo same) <(echo same) && echo substituted
+parallel -j 2 echo item ::: 1 2 2> /dev/null | sort
 
 find / 2> /dev/null | grep karashi | grep parser | grep c$
 
 unknown_command
+hash
 
 pwd | cd /
 